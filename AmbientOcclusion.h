@@ -0,0 +1,275 @@
+#ifndef AMBIENT_OCCLUSION_H
+#define AMBIENT_OCCLUSION_H
+
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "Model.h"
+#include "GpuTimer.h"
+
+// Затенение окружения в экранном пространстве для фонового члена освещения.
+// Стадии кадра (проходы RenderGraph): глубина сцены - из буфера видимости или предварительного
+// прохода, если кадр рисует их до сцены, иначе свой проход по потокам позиций (DrawDepth); расчёт
+// в пониженном разрешении (ssao_compute.glsl), накопление по кадрам с перепроецированием
+// (ssao_temporal.glsl, история хранится здесь) и повышение разрешения с учётом глубины
+// (ssao_upsample.glsl). Уровни качества задают делитель разрешения и число выборок;
+// время на GPU замеряется отдельно для каждого уровня.
+// Converged() сообщает, что камера и сцена неподвижны достаточно долго, чтобы история сошлась:
+// только тогда результат можно запоминать вместе с кэшем статического слоя.
+class AmbientOcclusion {
+public:
+    enum Quality { AO_OFF, AO_LOW, AO_MEDIUM, AO_HIGH };
+    static const int QUALITY_COUNT = 4;
+    static const int UNIT = 5;   // текстурный блок результата в основном шейдере
+    static const int CONVERGED_FRAMES = 24;   // вклад первого кадра после них 0.8^24 < 1%
+
+    struct Tier {
+        const char* name;
+        int divisor;     // делитель разрешения
+        int samples;
+    };
+
+    struct Stats {
+        unsigned int frames = 0;
+        Quality quality = AO_OFF;
+        int width = 0;                      // пониженное разрешение последнего кадра
+        int height = 0;
+        double tierMs[QUALITY_COUNT] = {};  // все стадии на GPU, среднее по уровням за период
+    };
+
+    // radius - радиус выборок в мировых единицах
+    AmbientOcclusion(Model& model, float radius)
+        : model(model), radius(radius), depthShader("depth_vertex.glsl", "depth_fragment.glsl"),
+        aoShader("ssao_compute.glsl"), temporalShader("ssao_temporal.glsl"), upsampleShader("ssao_upsample.glsl") {
+        model.EnablePositionStreams();
+        for (int q = 0; q < QUALITY_COUNT; ++q)
+            timers[q].reset(new GpuTimer(true));
+    }
+
+    static const Tier& TierOf(Quality quality) {
+        static const Tier tiers[QUALITY_COUNT] = {
+            { "off", 1, 0 }, { "low", 4, 8 }, { "medium", 2, 8 }, { "high", 2, 16 } };
+        return tiers[quality];
+    }
+
+    void SetQuality(Quality newQuality) {
+        if (newQuality != quality)
+            historyValid = false;
+        quality = newQuality;
+    }
+
+    Quality GetQuality() const {
+        return quality;
+    }
+
+    // История накоплена при неподвижных камере и мешах (после Accumulate этого кадра)
+    bool Converged() const {
+        return stillFrames >= CONVERGED_FRAMES;
+    }
+
+    // Пониженное разрешение для кадра renderWidth x renderHeight
+    int LowWidth(int renderWidth) const {
+        return std::max(1, (renderWidth + TierOf(quality).divisor - 1) / TierOf(quality).divisor);
+    }
+
+    int LowHeight(int renderHeight) const {
+        return std::max(1, (renderHeight + TierOf(quality).divisor - 1) / TierOf(quality).divisor);
+    }
+
+    // Камера кадра (без команд GL: вызывается при построении графа)
+    void BeginFrame(const glm::mat4& newView, const glm::mat4& newProjection, bool newLateLatched, int renderWidth, int renderHeight) {
+        view = newView;
+        projection = newProjection;
+        lateLatched = newLateLatched;
+        width = renderWidth;
+        height = renderHeight;
+    }
+
+    // Своя глубина сцены в привязанный кадровый буфер, когда кадр не рисует её до сцены; входит в замер уровня
+    void DrawDepth() {
+        beginTimer();
+        glViewport(0, 0, width, height);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader.use();
+        depthShader.setMat4("view", view);
+        depthShader.setMat4("projection", projection);
+        depthShader.setBool("lateLatched", lateLatched);
+        model.Draw(depthShader, Model::DRAW_ALL, true);
+    }
+
+    // Затенение в пониженном разрешении: depthTexture (depthWidth x depthHeight, кадр в левом нижнем углу)
+    // -> rawTexture (RG16F, LowWidth x LowHeight)
+    void Compute(unsigned int depthTexture, int depthWidth, int depthHeight, unsigned int rawTexture) {
+        beginTimer();
+        const Tier& tier = TierOf(quality);
+        glm::vec2 lowSize(LowWidth(width), LowHeight(height));
+        aoShader.use();
+        aoShader.setVec2("outputSize", lowSize);
+        aoShader.setVec2("uvScale", glm::vec2((float)width / depthWidth, (float)height / depthHeight));
+        aoShader.setMat4("projection", projection);
+        aoShader.setMat4("inverseProjection", glm::inverse(projection));
+        aoShader.setInt("sampleCount", tier.samples);
+        aoShader.setFloat("radius", radius);
+        aoShader.setUint("frameIndex", frameIndex);
+        glBindTextureUnit(0, depthTexture);
+        glBindImageTexture(0, rawTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+        dispatch(lowSize);
+    }
+
+    // Накопление rawTexture с историей прошлых кадров
+    void Accumulate(unsigned int rawTexture) {
+        int lowWidth = LowWidth(width), lowHeight = LowHeight(height);
+        resizeHistory(lowWidth, lowHeight);
+        int previous = current;
+        current = 1 - current;
+
+        temporalShader.use();
+        temporalShader.setVec2("outputSize", glm::vec2(lowWidth, lowHeight));
+        temporalShader.setMat4("inverseProjection", glm::inverse(projection));
+        temporalShader.setMat4("inverseView", glm::inverse(view));
+        temporalShader.setMat4("previousViewProjection", previousViewProjection);
+        temporalShader.setBool("historyValid", historyValid);
+        temporalShader.setFloat("blend", BLEND);
+        glBindTextureUnit(0, rawTexture);
+        glBindTextureUnit(1, history[previous]);
+        glBindImageTexture(0, history[current], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+        dispatch(glm::vec2(lowWidth, lowHeight));
+
+        glm::mat4 viewProjection = projection * view;
+        bool still = historyValid && viewProjection == previousViewProjection && sceneUnchanged();
+        stillFrames = still ? stillFrames + 1 : 0;
+        previousViewProjection = viewProjection;
+        historyValid = true;
+        frameIndex++;
+    }
+
+    // Результат в полном разрешении: outputTexture (R8) того же размера, что depthTexture
+    void Upsample(unsigned int depthTexture, int depthWidth, int depthHeight, unsigned int outputTexture) {
+        upsampleShader.use();
+        upsampleShader.setVec2("outputSize", glm::vec2(width, height));
+        upsampleShader.setVec2("lowSize", glm::vec2(LowWidth(width), LowHeight(height)));
+        upsampleShader.setVec2("uvScale", glm::vec2((float)width / depthWidth, (float)height / depthHeight));
+        upsampleShader.setMat4("inverseProjection", glm::inverse(projection));
+        glBindTextureUnit(0, depthTexture);
+        glBindTextureUnit(1, history[current]);
+        glBindImageTexture(0, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+        dispatch(glm::vec2(width, height));
+        glBindTextureUnit(1, 0);
+        glBindTextureUnit(0, 0);
+
+        timers[quality]->End();
+        timing = false;
+        period.frames++;
+        period.width = LowWidth(width);
+        period.height = LowHeight(height);
+    }
+
+    // Результат для основного шейдера; texture = 0 - без затенения окружения
+    static void Bind(Shader& shader, unsigned int texture) {
+        shader.use();
+        shader.setBool("ambientOcclusion", texture != 0);
+        shader.setInt("ambientOcclusionMap", UNIT);
+        glBindTextureUnit(UNIT, texture);
+    }
+
+    // Средние по уровням с прошлого вызова; уровни, не работавшие за период, - последний замер
+    Stats TakeStats() {
+        Stats stats = period;
+        stats.quality = quality;
+        for (int q = 1; q < QUALITY_COUNT; ++q) {
+            stats.tierMs[q] = timers[q]->TakeAverageMs();
+            if (stats.tierMs[q] == 0.0)
+                stats.tierMs[q] = timers[q]->LastMs();
+        }
+        period = Stats();
+        return stats;
+    }
+
+    // Ожидание всех замеров (для бенчмарков)
+    void FinishTimers() {
+        for (int q = 0; q < QUALITY_COUNT; ++q)
+            timers[q]->Finish();
+    }
+
+private:
+    Model& model;
+    float radius;
+    Quality quality = AO_MEDIUM;
+    Shader depthShader;
+    Shader aoShader;
+    Shader temporalShader;
+    Shader upsampleShader;
+    std::unique_ptr<GpuTimer> timers[QUALITY_COUNT];
+    Stats period;
+
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    bool lateLatched = false;
+    int width = 0;
+    int height = 0;
+    unsigned int frameIndex = 0;
+    bool timing = false;
+
+    // История по кругу из двух текстур (ao, линейная глубина)
+    unsigned int history[2] = {};
+    int historyWidth = 0;
+    int historyHeight = 0;
+    int current = 0;
+    bool historyValid = false;
+    int stillFrames = 0;                  // кадров подряд без движения камеры и мешей
+    std::vector<glm::mat4> lastTransforms;
+    std::vector<char> lastVisible;
+
+    static constexpr float BLEND = 0.2f;  // доля нового кадра в истории
+
+    // Сравнение положений и видимости мешей с прошлым кадром; запоминает текущие
+    bool sceneUnchanged() {
+        bool unchanged = lastTransforms.size() == model.meshes.size() && lastVisible == model.meshVisible;
+        lastTransforms.resize(model.meshes.size());
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            glm::mat4 world = model.WorldTransform(i);
+            if (world != lastTransforms[i])
+                unchanged = false;
+            lastTransforms[i] = world;
+        }
+        lastVisible = model.meshVisible;
+        return unchanged;
+    }
+
+    void beginTimer() {
+        if (timing)
+            return;
+        timers[quality]->Begin();
+        timing = true;
+    }
+
+    void dispatch(const glm::vec2& size) {
+        glDispatchCompute(((unsigned int)size.x + 7) / 8, ((unsigned int)size.y + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    void resizeHistory(int newWidth, int newHeight) {
+        if (newWidth == historyWidth && newHeight == historyHeight)
+            return;
+        historyWidth = newWidth;
+        historyHeight = newHeight;
+        historyValid = false;
+        if (history[0])
+            glDeleteTextures(2, history);
+        glCreateTextures(GL_TEXTURE_2D, 2, history);
+        for (unsigned int texture : history) {
+            glTextureStorage2D(texture, 1, GL_RG16F, historyWidth, historyHeight);
+            glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+};
+
+#endif // AMBIENT_OCCLUSION_H
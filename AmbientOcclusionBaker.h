@@ -0,0 +1,294 @@
+#ifndef AMBIENT_OCCLUSION_BAKER_H
+#define AMBIENT_OCCLUSION_BAKER_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <glm.hpp>
+#include "Model.h"
+#include "Bvh.h"
+#include "JobSystem.h"
+
+// Запекание затенения окружения по вершинам статических мешей (meshStatic): из каждой вершины
+// в полусферу вокруг нормали выпускаются лучи до radius по статическим экземплярам SceneBvh
+// (подвижные меши сдвинутся, а запечённая от них тень осталась бы на месте), доля
+// незакрытых лучей записывается байтом в поток затенения меша (Mesh::SetOcclusion).
+// Вершины всех мешей к запеканию делятся на отрезки JobSystem, поэтому запекание идёт
+// на всех ядрах независимо от размеров отдельных мешей.
+// Результаты хранятся в файле кэша по ключу меша (геометрия, положение, параметры лучей и соседи
+// в пределах radius): Update запекает только меши, ключа которых нет в кэше или которые изменились
+// с прошлого вызова, в том числе из-за сдвига соседнего меша.
+// Геометрия, общая для нескольких мешей (копии), не запекается: поток затенения у неё один,
+// а затенение у каждого размещения своё, поэтому такие меши остаются без запечённого затенения.
+class AmbientOcclusionBaker {
+public:
+    struct Stats {
+        unsigned int staticMeshes = 0;   // статические меши со своей геометрией
+        unsigned int shared = 0;         // статические, пропущены из-за общей геометрии
+        unsigned int baked = 0;
+        unsigned int cached = 0;         // взяты из файла кэша
+        unsigned int unchanged = 0;      // уже загружены прошлым Update
+        size_t vertices = 0;             // запечено вершин
+        size_t rays = 0;
+        double bakeMs = 0.0;
+        unsigned int threads = 0;
+    };
+
+    // cachePath пустой - без файла кэша
+    AmbientOcclusionBaker(const std::string& cachePath, float radius, int rayCount = 64)
+        : cachePath(cachePath), radius(radius), rayCount(rayCount) {
+        loadCache();
+    }
+
+    // Меши, которые запекаются: статические и единственные пользователи своей геометрии
+    static std::vector<char> BakedMeshes(const Model& model) {
+        std::vector<int> users(model.meshes.size(), 0);
+        for (size_t i = 0; i < model.meshes.size(); ++i)
+            users[model.meshGeometry[i]]++;
+        std::vector<char> baked(model.meshes.size(), 0);
+        for (size_t i = 0; i < model.meshes.size(); ++i)
+            baked[i] = model.meshStatic[i] && model.meshGeometry[i] == (int)i && users[i] == 1;
+        return baked;
+    }
+
+    // scene должна соответствовать текущим преобразованиям модели. Вызывается на основном потоке jobs
+    // (с GL-контекстом): запекание идёт задачами рабочих потоков, загрузка в буферы мешей - задачами
+    // основного потока после него
+    Stats Update(Model& model, const SceneBvh& scene, JobSystem& jobs) {
+        Stats stats;
+        stats.threads = jobs.WorkerCount() + 1;
+        applied.resize(model.meshes.size(), 0);
+        std::vector<char> baked = BakedMeshes(model);
+        SceneBvh occluders = staticInstances(model, scene);
+        std::vector<uint64_t> geometryHashes(model.meshes.size(), 0);
+        for (size_t i = 0; i < model.meshes.size(); ++i)
+            if (model.meshGeometry[i] == (int)i)
+                geometryHashes[i] = geometryHash(model.meshes[i]);
+
+        // Отрезки вершин мешей к запеканию подряд, work[k] - первая вершина меша k
+        std::vector<size_t> pending;
+        std::vector<uint64_t> pendingKeys;
+        std::vector<size_t> work;
+        size_t totalVertices = 0;
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (!baked[i]) {
+                if (model.meshStatic[i])
+                    stats.shared++;
+                continue;
+            }
+            stats.staticMeshes++;
+            uint64_t key = meshKey(model, occluders, i, geometryHashes);
+            if (applied[i] == key) {
+                stats.unchanged++;
+                continue;
+            }
+            auto entry = cache.find(key);
+            if (entry != cache.end() && entry->second.size() == model.meshes[i].vertices.size()) {
+                model.meshes[i].SetOcclusion(entry->second);
+                applied[i] = key;
+                stats.cached++;
+                continue;
+            }
+            pending.push_back(i);
+            pendingKeys.push_back(key);
+            work.push_back(totalVertices);
+            totalVertices += model.meshes[i].vertices.size();
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::vector<unsigned char>> results(pending.size());
+        for (size_t k = 0; k < pending.size(); ++k)
+            results[k].resize(model.meshes[pending[k]].vertices.size());
+        JobSystem::JobHandle bake = jobs.ParallelForAsync(totalVertices, 256, [&](size_t begin, size_t end) {
+            size_t k = std::upper_bound(work.begin(), work.end(), begin) - work.begin() - 1;
+            for (size_t v = begin; v < end; ++v) {
+                while (k + 1 < work.size() && v >= work[k + 1])
+                    ++k;
+                size_t meshIndex = pending[k];
+                results[k][v - work[k]] = bakeVertex(occluders, model.meshes[meshIndex].vertices[v - work[k]],
+                    model.WorldTransform(meshIndex), (uint32_t)v);
+            }
+        });
+        std::vector<JobSystem::JobHandle> uploads;
+        for (size_t k = 0; k < pending.size(); ++k) {
+            uploads.push_back(jobs.ScheduleOnMainThread([&, k]() {
+                model.meshes[pending[k]].SetOcclusion(results[k]);
+            }, { bake }));
+        }
+        jobs.Wait(bake);
+        stats.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        jobs.WaitAll(uploads);
+
+        for (size_t k = 0; k < pending.size(); ++k) {
+            applied[pending[k]] = pendingKeys[k];
+            cache[pendingKeys[k]] = std::move(results[k]);
+        }
+        stats.baked = (unsigned int)pending.size();
+        stats.vertices = totalVertices;
+        stats.rays = totalVertices * rayCount;
+        if (!pending.empty())
+            saveCache();
+        return stats;
+    }
+
+private:
+    static const uint32_t CACHE_MAGIC = 0x3142414F;   // "OAB1"
+
+    std::string cachePath;
+    float radius;
+    int rayCount;
+    std::unordered_map<uint64_t, std::vector<unsigned char>> cache;
+    std::vector<uint64_t> applied;   // ключ загруженных значений по мешу, 0 - нет
+
+    static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Копия scene только со статическими экземплярами; иерархии мешей общие с scene
+    static SceneBvh staticInstances(const Model& model, const SceneBvh& scene) {
+        SceneBvh occluders = scene;
+        occluders.instances.erase(std::remove_if(occluders.instances.begin(), occluders.instances.end(),
+            [&](const SceneBvh::Instance& instance) { return !model.meshStatic[instance.meshIndex]; }),
+            occluders.instances.end());
+        if (!occluders.instances.empty())
+            occluders.Rebuild();
+        return occluders;
+    }
+
+    static uint64_t geometryHash(const Mesh& mesh) {
+        uint64_t hash = 14695981039346656037ull;
+        hash = hashBytes(hash, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+        hash = hashBytes(hash, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+        return hash;
+    }
+
+    // Кроме самого меша в ключ входят все статические экземпляры, чьи границы пересекают его границы,
+    // расширенные на radius: только они закрывают его лучи. Сосед, сдвинутый в эту область,
+    // внутри неё или из неё, меняет ключ - и меш запекается заново
+    uint64_t meshKey(const Model& model, const SceneBvh& scene, size_t meshIndex, const std::vector<uint64_t>& geometryHashes) const {
+        glm::mat4 world = model.WorldTransform(meshIndex);
+        uint64_t hash = geometryHashes[meshIndex];
+        hash = hashBytes(hash, &world[0][0], sizeof(glm::mat4));
+        hash = hashBytes(hash, &radius, sizeof(radius));
+        hash = hashBytes(hash, &rayCount, sizeof(rayCount));
+
+        glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+        for (const SceneBvh::Instance& instance : scene.instances) {
+            if (instance.meshIndex == (int)meshIndex) {
+                boundsMin = instance.boundsMin - glm::vec3(radius);
+                boundsMax = instance.boundsMax + glm::vec3(radius);
+            }
+        }
+        for (const SceneBvh::Instance& instance : scene.instances) {
+            if (instance.meshIndex == (int)meshIndex || glm::any(glm::lessThan(instance.boundsMax, boundsMin)) ||
+                glm::any(glm::greaterThan(instance.boundsMin, boundsMax)))
+                continue;
+            hash = hashBytes(hash, &instance.meshIndex, sizeof(instance.meshIndex));
+            hash = hashBytes(hash, &geometryHashes[model.meshGeometry[instance.meshIndex]], sizeof(uint64_t));
+            hash = hashBytes(hash, &instance.transform[0][0], sizeof(glm::mat4));
+        }
+        return hash ? hash : 1;
+    }
+
+    // Лучи по косинусу в полусфере (последовательность Хаммерсли), поворот своей для каждой вершины
+    unsigned char bakeVertex(const SceneBvh& scene, const Vertex& vertex, const glm::mat4& world, uint32_t seed) const {
+        glm::vec3 position = glm::vec3(world * glm::vec4(vertex.Position, 1.0f));
+        glm::vec3 normal = glm::mat3(glm::transpose(glm::inverse(world))) * vertex.Normal;
+        if (glm::dot(normal, normal) < 1e-12f)
+            return 255;
+        normal = glm::normalize(normal);
+        glm::vec3 helper = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 tangent = glm::normalize(glm::cross(helper, normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+
+        seed = seed * 747796405u + 2891336453u;
+        float rotation = (float)((seed >> 8) & 0xFFFF) / 65536.0f * 6.2831853f;
+        Ray ray;
+        ray.origin = position + normal * radius * 1e-3f;
+        ray.tMax = radius;
+        int open = 0;
+        for (int r = 0; r < rayCount; ++r) {
+            float u = (r + 0.5f) / rayCount;
+            uint32_t bits = (uint32_t)r;
+            bits = (bits << 16) | (bits >> 16);
+            bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+            bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+            bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+            bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+            float phi = (float)bits * 2.3283064e-10f * 6.2831853f + rotation;
+            float sinTheta = std::sqrt(u), cosTheta = std::sqrt(1.0f - u);
+            ray.direction = tangent * (std::cos(phi) * sinTheta) + bitangent * (std::sin(phi) * sinTheta) + normal * cosTheta;
+            if (!scene.Occluded(ray))
+                open++;
+        }
+        return (unsigned char)std::lround(255.0f * open / rayCount);
+    }
+
+    // Файл: CACHE_MAGIC, число записей, записи (ключ, число вершин, байты)
+    void loadCache() {
+        if (cachePath.empty())
+            return;
+        std::ifstream file(cachePath, std::ios::binary);
+        if (!file)
+            return;
+        uint32_t magic = 0, count = 0;
+        file.read((char*)&magic, sizeof(magic));
+        file.read((char*)&count, sizeof(count));
+        if (!file || magic != CACHE_MAGIC) {
+            std::cerr << "ERROR::AO_BAKER::CACHE_INVALID: " << cachePath << std::endl;
+            return;
+        }
+        for (uint32_t e = 0; e < count; ++e) {
+            uint64_t key = 0;
+            uint32_t size = 0;
+            file.read((char*)&key, sizeof(key));
+            file.read((char*)&size, sizeof(size));
+            std::vector<unsigned char> values(size);
+            file.read((char*)values.data(), size);
+            if (!file) {
+                std::cerr << "ERROR::AO_BAKER::CACHE_TRUNCATED: " << cachePath << std::endl;
+                cache.clear();
+                return;
+            }
+            cache[key] = std::move(values);
+        }
+    }
+
+    // Сохраняются только записи мешей модели: устаревшие ключи отбрасываются
+    void saveCache() {
+        if (cachePath.empty())
+            return;
+        std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "ERROR::AO_BAKER::CACHE_NOT_WRITTEN: " << cachePath << std::endl;
+            return;
+        }
+        std::vector<uint64_t> keys;
+        for (size_t i = 0; i < applied.size(); ++i)
+            if (applied[i] && cache.count(applied[i]) && std::find(keys.begin(), keys.end(), applied[i]) == keys.end())
+                keys.push_back(applied[i]);
+        uint32_t magic = CACHE_MAGIC, count = (uint32_t)keys.size();
+        file.write((const char*)&magic, sizeof(magic));
+        file.write((const char*)&count, sizeof(count));
+        for (uint64_t key : keys) {
+            const std::vector<unsigned char>& values = cache[key];
+            uint32_t size = (uint32_t)values.size();
+            file.write((const char*)&key, sizeof(key));
+            file.write((const char*)&size, sizeof(size));
+            file.write((const char*)values.data(), size);
+        }
+    }
+};
+
+#endif // AMBIENT_OCCLUSION_BAKER_H
@@ -0,0 +1,665 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <cfloat>
+#include <cmath>
+#include <cassert>
+#include <glm.hpp>
+#include "Model.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define BVH_SSE 1
+#include <emmintrin.h>
+#endif
+
+// Двухуровневая иерархия ограничивающих объёмов для лучевых запросов и выбора мышью.
+// Нижний уровень (MeshBvh) строится по SAH один раз на меш в локальных координатах,
+// верхний (SceneBvh) - по экземплярам мешей; при изменении преобразований мешей он только
+// пересчитывает объёмы узлов (Refit), топология не меняется.
+// Запросы константны и могут выполняться из нескольких потоков одновременно, но не во время Refit.
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float tMax = FLT_MAX;
+};
+
+struct RayHit {
+    float t = FLT_MAX;
+    int instance = -1;
+    int meshIndex = -1;
+    unsigned int triangle = 0;
+    float u = 0.0f, v = 0.0f;
+};
+
+struct BvhNode {
+    glm::vec3 boundsMin;
+    unsigned int leftFirst; // лист: первый примитив, иначе левый потомок (правый = левый + 1)
+    glm::vec3 boundsMax;
+    unsigned int count;     // 0 - внутренний узел
+
+    bool isLeaf() const { return count > 0; }
+};
+
+namespace bvh_detail {
+
+    inline bool intersectBox(const glm::vec3& o, const glm::vec3& invDir, const glm::vec3& bmin,
+        const glm::vec3& bmax, float tMax, float& tNear) {
+        glm::vec3 t0 = (bmin - o) * invDir;
+        glm::vec3 t1 = (bmax - o) * invDir;
+        glm::vec3 lo = glm::min(t0, t1), hi = glm::max(t0, t1);
+        tNear = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+        float tFar = std::min(std::min(hi.x, hi.y), std::min(hi.z, tMax));
+        return tNear <= tFar;
+    }
+
+    inline glm::vec3 safeInverse(const glm::vec3& d) {
+        return glm::vec3(d.x != 0.0f ? 1.0f / d.x : FLT_MAX,
+            d.y != 0.0f ? 1.0f / d.y : FLT_MAX,
+            d.z != 0.0f ? 1.0f / d.z : FLT_MAX);
+    }
+
+    inline float surfaceArea(const glm::vec3& bmin, const glm::vec3& bmax) {
+        glm::vec3 e = glm::max(bmax - bmin, glm::vec3(0.0f));
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Глубина дерева ограничена при построении, поэтому стек обхода фиксированного размера
+    // (не больше глубины + 1 узлов) не переполняется
+    const int MAX_DEPTH = 48;
+    const int STACK_SIZE = 64;
+
+    // Построение по SAH с 12 корзинами на ось; order - перестановка примитивов по листьям.
+    // Узлы на глубине MAX_DEPTH остаются листьями независимо от числа примитивов
+    inline void build(std::vector<BvhNode>& nodes, std::vector<unsigned int>& order,
+        const std::vector<glm::vec3>& primMin, const std::vector<glm::vec3>& primMax, unsigned int maxLeaf) {
+        const int BINS = 12;
+        size_t count = primMin.size();
+        order.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            order[i] = (unsigned int)i;
+        nodes.clear();
+        nodes.reserve(count * 2 + 1);
+        nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), (unsigned int)count });
+
+        std::vector<std::pair<unsigned int, int>> stack = { { 0u, 0 } };
+        while (!stack.empty()) {
+            unsigned int nodeIndex = stack.back().first;
+            int depth = stack.back().second;
+            stack.pop_back();
+
+            BvhNode node = nodes[nodeIndex];
+            unsigned int first = node.leftFirst, n = node.count;
+            glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX), cmin(FLT_MAX), cmax(-FLT_MAX);
+            for (unsigned int i = first; i < first + n; ++i) {
+                unsigned int p = order[i];
+                bmin = glm::min(bmin, primMin[p]);
+                bmax = glm::max(bmax, primMax[p]);
+                glm::vec3 c = (primMin[p] + primMax[p]) * 0.5f;
+                cmin = glm::min(cmin, c);
+                cmax = glm::max(cmax, c);
+            }
+            nodes[nodeIndex].boundsMin = bmin;
+            nodes[nodeIndex].boundsMax = bmax;
+            if (n <= maxLeaf || depth >= MAX_DEPTH)
+                continue;
+
+            int bestAxis = -1, bestSplit = 0;
+            float bestCost = surfaceArea(bmin, bmax) * n;
+            for (int axis = 0; axis < 3; ++axis) {
+                float extent = cmax[axis] - cmin[axis];
+                if (extent <= 0.0f)
+                    continue;
+
+                glm::vec3 binMin[BINS], binMax[BINS];
+                unsigned int binCount[BINS] = {};
+                for (int b = 0; b < BINS; ++b) {
+                    binMin[b] = glm::vec3(FLT_MAX);
+                    binMax[b] = glm::vec3(-FLT_MAX);
+                }
+                float scale = BINS / extent;
+                for (unsigned int i = first; i < first + n; ++i) {
+                    unsigned int p = order[i];
+                    float c = (primMin[p][axis] + primMax[p][axis]) * 0.5f;
+                    int b = std::min(BINS - 1, (int)((c - cmin[axis]) * scale));
+                    binCount[b]++;
+                    binMin[b] = glm::min(binMin[b], primMin[p]);
+                    binMax[b] = glm::max(binMax[b], primMax[p]);
+                }
+
+                float leftArea[BINS - 1];
+                unsigned int leftCount[BINS - 1];
+                glm::vec3 lmin(FLT_MAX), lmax(-FLT_MAX);
+                unsigned int sum = 0;
+                for (int b = 0; b < BINS - 1; ++b) {
+                    sum += binCount[b];
+                    lmin = glm::min(lmin, binMin[b]);
+                    lmax = glm::max(lmax, binMax[b]);
+                    leftCount[b] = sum;
+                    leftArea[b] = sum ? surfaceArea(lmin, lmax) : 0.0f;
+                }
+                glm::vec3 rmin(FLT_MAX), rmax(-FLT_MAX);
+                sum = 0;
+                for (int b = BINS - 1; b > 0; --b) {
+                    sum += binCount[b];
+                    rmin = glm::min(rmin, binMin[b]);
+                    rmax = glm::max(rmax, binMax[b]);
+                    if (leftCount[b - 1] == 0 || sum == 0)
+                        continue;
+                    float cost = leftArea[b - 1] * leftCount[b - 1] + surfaceArea(rmin, rmax) * sum;
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = b;
+                    }
+                }
+            }
+            if (bestAxis < 0)
+                continue;
+
+            float scale = BINS / (cmax[bestAxis] - cmin[bestAxis]);
+            unsigned int* mid = std::partition(&order[first], &order[first] + n, [&](unsigned int p) {
+                float c = (primMin[p][bestAxis] + primMax[p][bestAxis]) * 0.5f;
+                return std::min(BINS - 1, (int)((c - cmin[bestAxis]) * scale)) < bestSplit;
+            });
+            unsigned int leftCount = (unsigned int)(mid - &order[first]);
+            if (leftCount == 0 || leftCount == n)
+                continue;
+
+            unsigned int left = (unsigned int)nodes.size();
+            nodes.push_back({ glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount });
+            nodes.push_back({ glm::vec3(0.0f), first + leftCount, glm::vec3(0.0f), n - leftCount });
+            nodes[nodeIndex].leftFirst = left;
+            nodes[nodeIndex].count = 0;
+            stack.push_back({ left, depth + 1 });
+            stack.push_back({ left + 1, depth + 1 });
+        }
+    }
+
+#ifdef BVH_SSE
+    // Пакет из четырёх лучей в виде структуры массивов
+    struct RayPacket4 {
+        __m128 ox, oy, oz, dx, dy, dz, rdx, rdy, rdz;
+    };
+
+    inline __m128 rcpSafe(__m128 d) {
+        __m128 zero = _mm_cmpeq_ps(d, _mm_setzero_ps());
+        return _mm_or_ps(_mm_and_ps(zero, _mm_set1_ps(FLT_MAX)), _mm_andnot_ps(zero, _mm_div_ps(_mm_set1_ps(1.0f), d)));
+    }
+
+    inline int intersectBox4(const RayPacket4& p, const BvhNode& node, __m128 tMax) {
+        __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), p.ox), p.rdx);
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), p.ox), p.rdx);
+        __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), p.oy), p.rdy);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), p.oy), p.rdy);
+        __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), p.oz), p.rdz);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), p.oz), p.rdz);
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+            _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+            _mm_min_ps(_mm_max_ps(tz0, tz1), tMax));
+        return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+#endif
+
+} // namespace bvh_detail
+
+class MeshBvh {
+public:
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+        unsigned int index;
+    };
+
+    std::vector<BvhNode> nodes;
+    std::vector<Triangle> triangles;
+
+    MeshBvh(const Mesh& mesh) {
+        size_t count = mesh.indices.size() / 3;
+        std::vector<glm::vec3> primMin(count), primMax(count);
+        for (size_t t = 0; t < count; ++t) {
+            const glm::vec3& a = mesh.vertices[mesh.indices[3 * t]].Position;
+            const glm::vec3& b = mesh.vertices[mesh.indices[3 * t + 1]].Position;
+            const glm::vec3& c = mesh.vertices[mesh.indices[3 * t + 2]].Position;
+            primMin[t] = glm::min(a, glm::min(b, c));
+            primMax[t] = glm::max(a, glm::max(b, c));
+        }
+
+        std::vector<unsigned int> order;
+        bvh_detail::build(nodes, order, primMin, primMax, 4);
+
+        triangles.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            unsigned int t = order[i];
+            const glm::vec3& a = mesh.vertices[mesh.indices[3 * t]].Position;
+            const glm::vec3& b = mesh.vertices[mesh.indices[3 * t + 1]].Position;
+            const glm::vec3& c = mesh.vertices[mesh.indices[3 * t + 2]].Position;
+            triangles[i] = { a, b - a, c - a, t };
+        }
+    }
+
+    glm::vec3 boundsMin() const { return nodes[0].boundsMin; }
+    glm::vec3 boundsMax() const { return nodes[0].boundsMax; }
+
+    // Луч в локальных координатах меша; hit.t сужается при каждом попадании
+    bool Intersect(const glm::vec3& o, const glm::vec3& d, RayHit& hit, bool anyHit) const {
+        if (triangles.empty())
+            return false;
+        glm::vec3 invDir = bvh_detail::safeInverse(d);
+        unsigned int stack[bvh_detail::STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        bool found = false;
+
+        while (sp > 0) {
+            const BvhNode& node = nodes[stack[--sp]];
+            float tNear;
+            if (!bvh_detail::intersectBox(o, invDir, node.boundsMin, node.boundsMax, hit.t, tNear))
+                continue;
+
+            if (node.isLeaf()) {
+                for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                    if (intersectTriangle(triangles[i], o, d, hit)) {
+                        found = true;
+                        if (anyHit)
+                            return true;
+                    }
+                }
+                continue;
+            }
+
+            // Сначала ближний потомок
+            const BvhNode& left = nodes[node.leftFirst];
+            const BvhNode& right = nodes[node.leftFirst + 1];
+            float tLeft, tRight;
+            bool hitLeft = bvh_detail::intersectBox(o, invDir, left.boundsMin, left.boundsMax, hit.t, tLeft);
+            bool hitRight = bvh_detail::intersectBox(o, invDir, right.boundsMin, right.boundsMax, hit.t, tRight);
+            if (hitLeft && hitRight) {
+                bool leftFirst = tLeft <= tRight;
+                assert(sp + 2 <= bvh_detail::STACK_SIZE);
+                stack[sp++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+                stack[sp++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+            }
+            else if (hitLeft) {
+                assert(sp < bvh_detail::STACK_SIZE);
+                stack[sp++] = node.leftFirst;
+            }
+            else if (hitRight) {
+                assert(sp < bvh_detail::STACK_SIZE);
+                stack[sp++] = node.leftFirst + 1;
+            }
+        }
+        return found;
+    }
+
+#ifdef BVH_SSE
+    // Пакетный обход: узел посещается, если его пересекает хотя бы один активный луч
+    void Intersect4(const bvh_detail::RayPacket4& p, int activeMask, RayHit hits[4], int instance, int meshIndex) const {
+        if (triangles.empty())
+            return;
+        alignas(16) float tMax[4] = { hits[0].t, hits[1].t, hits[2].t, hits[3].t };
+        unsigned int stack[bvh_detail::STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+
+        while (sp > 0) {
+            const BvhNode& node = nodes[stack[--sp]];
+            if ((bvh_detail::intersectBox4(p, node, _mm_load_ps(tMax)) & activeMask) == 0)
+                continue;
+
+            if (!node.isLeaf()) {
+                assert(sp + 2 <= bvh_detail::STACK_SIZE);
+                stack[sp++] = node.leftFirst + 1;
+                stack[sp++] = node.leftFirst;
+                continue;
+            }
+
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                const Triangle& tri = triangles[i];
+                // Мёллер-Трумбор для четырёх лучей
+                __m128 e1x = _mm_set1_ps(tri.e1.x), e1y = _mm_set1_ps(tri.e1.y), e1z = _mm_set1_ps(tri.e1.z);
+                __m128 e2x = _mm_set1_ps(tri.e2.x), e2y = _mm_set1_ps(tri.e2.y), e2z = _mm_set1_ps(tri.e2.z);
+                __m128 hx = _mm_sub_ps(_mm_mul_ps(p.dy, e2z), _mm_mul_ps(p.dz, e2y));
+                __m128 hy = _mm_sub_ps(_mm_mul_ps(p.dz, e2x), _mm_mul_ps(p.dx, e2z));
+                __m128 hz = _mm_sub_ps(_mm_mul_ps(p.dx, e2y), _mm_mul_ps(p.dy, e2x));
+                __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+                __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+                __m128 sx = _mm_sub_ps(p.ox, _mm_set1_ps(tri.v0.x));
+                __m128 sy = _mm_sub_ps(p.oy, _mm_set1_ps(tri.v0.y));
+                __m128 sz = _mm_sub_ps(p.oz, _mm_set1_ps(tri.v0.z));
+                __m128 u = _mm_mul_ps(invDet, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+                __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                __m128 v = _mm_mul_ps(invDet, _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.dx, qx), _mm_mul_ps(p.dy, qy)), _mm_mul_ps(p.dz, qz)));
+                __m128 t = _mm_mul_ps(invDet, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+                __m128 eps = _mm_set1_ps(1e-8f);
+                __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+                __m128 ok = _mm_and_ps(_mm_cmpgt_ps(absDet, eps), _mm_cmpge_ps(u, _mm_setzero_ps()));
+                ok = _mm_and_ps(ok, _mm_cmpge_ps(v, _mm_setzero_ps()));
+                ok = _mm_and_ps(ok, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+                ok = _mm_and_ps(ok, _mm_cmpgt_ps(t, eps));
+                ok = _mm_and_ps(ok, _mm_cmplt_ps(t, _mm_load_ps(tMax)));
+                int mask = _mm_movemask_ps(ok) & activeMask;
+                if (mask == 0)
+                    continue;
+
+                alignas(16) float ts[4], us[4], vs[4];
+                _mm_store_ps(ts, t);
+                _mm_store_ps(us, u);
+                _mm_store_ps(vs, v);
+                for (int k = 0; k < 4; ++k) {
+                    if (!(mask & (1 << k)))
+                        continue;
+                    tMax[k] = ts[k];
+                    hits[k] = { ts[k], instance, meshIndex, tri.index, us[k], vs[k] };
+                }
+            }
+        }
+    }
+#endif
+
+private:
+    static bool intersectTriangle(const Triangle& tri, const glm::vec3& o, const glm::vec3& d, RayHit& hit) {
+        glm::vec3 h = glm::cross(d, tri.e2);
+        float det = glm::dot(tri.e1, h);
+        if (std::fabs(det) < 1e-8f)
+            return false;
+        float invDet = 1.0f / det;
+        glm::vec3 s = o - tri.v0;
+        float u = invDet * glm::dot(s, h);
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, tri.e1);
+        float v = invDet * glm::dot(d, q);
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = invDet * glm::dot(tri.e2, q);
+        if (t <= 1e-8f || t >= hit.t)
+            return false;
+
+        hit.t = t;
+        hit.triangle = tri.index;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+};
+
+class SceneBvh {
+public:
+    struct Instance {
+        int meshIndex;
+        glm::mat4 transform;
+        glm::mat4 inverse;
+        glm::vec3 boundsMin, boundsMax; // в мировых координатах
+    };
+
+    std::vector<Instance> instances;
+
+    // По экземпляру на каждый меш модели с текущими преобразованиями;
+    // меши с общей геометрией используют одну иерархию нижнего уровня
+    SceneBvh(const Model& model) {
+        meshBvhs = std::make_shared<std::vector<MeshBvh>>();
+        std::vector<int> bvhOfGeometry(model.meshes.size(), -1);
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            int geometry = model.meshGeometry[i];
+            if (bvhOfGeometry[geometry] < 0) {
+                bvhOfGeometry[geometry] = (int)meshBvhs->size();
+                meshBvhs->emplace_back(model.meshes[geometry]);
+            }
+            meshBvhIndex.push_back(bvhOfGeometry[geometry]);
+        }
+        for (size_t i = 0; i < model.meshes.size(); ++i)
+            AddInstance((int)i, model.WorldTransform(i));
+        Rebuild();
+    }
+
+    void AddInstance(int meshIndex, const glm::mat4& transform) {
+        Instance instance;
+        instance.meshIndex = meshIndex;
+        setTransform(instance, transform);
+        instances.push_back(instance);
+    }
+
+    // Полное перестроение верхнего уровня (после добавления экземпляров)
+    void Rebuild() {
+        std::vector<glm::vec3> primMin, primMax;
+        for (const Instance& instance : instances) {
+            primMin.push_back(instance.boundsMin);
+            primMax.push_back(instance.boundsMax);
+        }
+        bvh_detail::build(nodes, order, primMin, primMax, 1);
+    }
+
+    // Пересчёт объёмов верхнего уровня без изменения топологии; transforms - по экземпляру
+    void Refit(const std::vector<glm::mat4>& transforms) {
+        for (size_t i = 0; i < instances.size() && i < transforms.size(); ++i)
+            setTransform(instances[i], transforms[i]);
+
+        // Потомки всегда лежат после родителя, поэтому достаточно обратного прохода
+        for (size_t n = nodes.size(); n-- > 0;) {
+            BvhNode& node = nodes[n];
+            glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+            if (node.isLeaf()) {
+                for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                    bmin = glm::min(bmin, instances[order[i]].boundsMin);
+                    bmax = glm::max(bmax, instances[order[i]].boundsMax);
+                }
+            }
+            else {
+                const BvhNode& left = nodes[node.leftFirst];
+                const BvhNode& right = nodes[node.leftFirst + 1];
+                bmin = glm::min(left.boundsMin, right.boundsMin);
+                bmax = glm::max(left.boundsMax, right.boundsMax);
+            }
+            node.boundsMin = bmin;
+            node.boundsMax = bmax;
+        }
+    }
+
+    // Ближайшее пересечение
+    bool Intersect(const Ray& ray, RayHit& hit) const {
+        hit = RayHit();
+        hit.t = ray.tMax;
+        return traverse(ray, hit, false);
+    }
+
+    // Есть ли хоть одно пересечение на [0, tMax)
+    bool Occluded(const Ray& ray) const {
+        RayHit hit;
+        hit.t = ray.tMax;
+        return traverse(ray, hit, true);
+    }
+
+    // Ближайшие пересечения для пакета из четырёх лучей; возвращает маску попаданий
+    int Intersect4(const Ray rays[4], RayHit hits[4]) const {
+        for (int k = 0; k < 4; ++k) {
+            hits[k] = RayHit();
+            hits[k].t = rays[k].tMax;
+        }
+        if (instances.empty())
+            return 0;
+#ifdef BVH_SSE
+        bvh_detail::RayPacket4 world = makePacket(rays);
+        unsigned int stack[bvh_detail::STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        while (sp > 0) {
+            const BvhNode& node = nodes[stack[--sp]];
+            __m128 tMax = _mm_setr_ps(hits[0].t, hits[1].t, hits[2].t, hits[3].t);
+            int mask = bvh_detail::intersectBox4(world, node, tMax);
+            if (mask == 0)
+                continue;
+            if (!node.isLeaf()) {
+                assert(sp + 2 <= bvh_detail::STACK_SIZE);
+                stack[sp++] = node.leftFirst + 1;
+                stack[sp++] = node.leftFirst;
+                continue;
+            }
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                const Instance& instance = instances[order[i]];
+                Ray local[4];
+                for (int k = 0; k < 4; ++k) {
+                    local[k].origin = glm::vec3(instance.inverse * glm::vec4(rays[k].origin, 1.0f));
+                    local[k].direction = glm::vec3(instance.inverse * glm::vec4(rays[k].direction, 0.0f));
+                }
+                (*meshBvhs)[meshBvhIndex[instance.meshIndex]].Intersect4(makePacket(local), mask, hits, (int)order[i], instance.meshIndex);
+            }
+        }
+#else
+        for (int k = 0; k < 4; ++k)
+            traverse(rays[k], hits[k], false);
+#endif
+        int result = 0;
+        for (int k = 0; k < 4; ++k)
+            if (hits[k].instance >= 0)
+                result |= 1 << k;
+        return result;
+    }
+
+    // Пропускная способность в миллионах лучей в секунду
+    static void Benchmark(const SceneBvh& scene, const char* label, int rayCount = 1 << 20) {
+        glm::vec3 bmin = scene.nodes[0].boundsMin, bmax = scene.nodes[0].boundsMax;
+        glm::vec3 center = (bmin + bmax) * 0.5f;
+        float radius = glm::length(bmax - bmin) * 0.5f + 1e-3f;
+
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> uni(-1.0f, 1.0f);
+        std::vector<Ray> rays(rayCount);
+        for (Ray& ray : rays) {
+            glm::vec3 dir;
+            do { dir = glm::vec3(uni(rng), uni(rng), uni(rng)); } while (glm::dot(dir, dir) > 1.0f || glm::dot(dir, dir) < 1e-4f);
+            ray.origin = center + glm::normalize(dir) * radius;
+            glm::vec3 target = center + glm::vec3(uni(rng), uni(rng), uni(rng)) * (bmax - bmin) * 0.5f;
+            ray.direction = glm::normalize(target - ray.origin);
+        }
+
+        auto measure = [&](auto&& body) {
+            auto start = std::chrono::high_resolution_clock::now();
+            body();
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            return rayCount / seconds / 1e6;
+        };
+
+        int hitCount = 0;
+        double closest = measure([&]() {
+            RayHit hit;
+            for (const Ray& ray : rays)
+                hitCount += scene.Intersect(ray, hit) ? 1 : 0;
+        });
+        double anyHit = measure([&]() {
+            for (const Ray& ray : rays)
+                scene.Occluded(ray);
+        });
+        double packet = measure([&]() {
+            RayHit hits[4];
+            for (size_t i = 0; i + 3 < rays.size(); i += 4)
+                scene.Intersect4(&rays[i], hits);
+        });
+
+        unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+        double parallel = measure([&]() {
+            std::vector<std::thread> workers;
+            for (unsigned int w = 0; w < threads; ++w) {
+                workers.emplace_back([&, w]() {
+                    RayHit hit;
+                    for (size_t i = w; i < rays.size(); i += threads)
+                        scene.Intersect(rays[i], hit);
+                });
+            }
+            for (std::thread& worker : workers)
+                worker.join();
+        });
+
+        std::cout << "BVH [" << label << "]: " << scene.instances.size() << " instances, "
+            << rayCount << " rays, " << (100.0 * hitCount / rayCount) << "% hit" << std::endl
+            << "  closest hit: " << closest << " Mrays/s, any hit: " << anyHit << " Mrays/s, packet4: "
+            << packet << " Mrays/s, closest hit x" << threads << " threads: " << parallel << " Mrays/s" << std::endl;
+    }
+
+private:
+    std::shared_ptr<std::vector<MeshBvh>> meshBvhs; // общие для копий сцены
+    std::vector<int> meshBvhIndex;                  // меш модели -> иерархия нижнего уровня
+    std::vector<BvhNode> nodes;
+    std::vector<unsigned int> order;
+
+    void setTransform(Instance& instance, const glm::mat4& transform) {
+        const MeshBvh& mesh = (*meshBvhs)[meshBvhIndex[instance.meshIndex]];
+        instance.transform = transform;
+        instance.inverse = glm::inverse(transform);
+
+        glm::vec3 lmin = mesh.boundsMin(), lmax = mesh.boundsMax();
+        instance.boundsMin = glm::vec3(FLT_MAX);
+        instance.boundsMax = glm::vec3(-FLT_MAX);
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 corner((i & 1) ? lmax.x : lmin.x, (i & 2) ? lmax.y : lmin.y, (i & 4) ? lmax.z : lmin.z);
+            glm::vec3 world = glm::vec3(transform * glm::vec4(corner, 1.0f));
+            instance.boundsMin = glm::min(instance.boundsMin, world);
+            instance.boundsMax = glm::max(instance.boundsMax, world);
+        }
+    }
+
+    bool traverse(const Ray& ray, RayHit& hit, bool anyHit) const {
+        if (instances.empty())
+            return false;
+        glm::vec3 invDir = bvh_detail::safeInverse(ray.direction);
+        unsigned int stack[bvh_detail::STACK_SIZE];
+        int sp = 0;
+        stack[sp++] = 0;
+        bool found = false;
+
+        while (sp > 0) {
+            const BvhNode& node = nodes[stack[--sp]];
+            float tNear;
+            if (!bvh_detail::intersectBox(ray.origin, invDir, node.boundsMin, node.boundsMax, hit.t, tNear))
+                continue;
+            if (!node.isLeaf()) {
+                assert(sp + 2 <= bvh_detail::STACK_SIZE);
+                stack[sp++] = node.leftFirst + 1;
+                stack[sp++] = node.leftFirst;
+                continue;
+            }
+
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                const Instance& instance = instances[order[i]];
+                glm::vec3 o = glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f));
+                glm::vec3 d = glm::vec3(instance.inverse * glm::vec4(ray.direction, 0.0f));
+                if ((*meshBvhs)[meshBvhIndex[instance.meshIndex]].Intersect(o, d, hit, anyHit)) {
+                    hit.instance = (int)order[i];
+                    hit.meshIndex = instance.meshIndex;
+                    found = true;
+                    if (anyHit)
+                        return true;
+                }
+            }
+        }
+        return found;
+    }
+
+#ifdef BVH_SSE
+    static bvh_detail::RayPacket4 makePacket(const Ray rays[4]) {
+        bvh_detail::RayPacket4 p;
+        p.ox = _mm_setr_ps(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x);
+        p.oy = _mm_setr_ps(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y);
+        p.oz = _mm_setr_ps(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z);
+        p.dx = _mm_setr_ps(rays[0].direction.x, rays[1].direction.x, rays[2].direction.x, rays[3].direction.x);
+        p.dy = _mm_setr_ps(rays[0].direction.y, rays[1].direction.y, rays[2].direction.y, rays[3].direction.y);
+        p.dz = _mm_setr_ps(rays[0].direction.z, rays[1].direction.z, rays[2].direction.z, rays[3].direction.z);
+        p.rdx = bvh_detail::rcpSafe(p.dx);
+        p.rdy = bvh_detail::rcpSafe(p.dy);
+        p.rdz = bvh_detail::rcpSafe(p.dz);
+        return p;
+    }
+#endif
+};
+
+#endif // BVH_H
@@ -0,0 +1,213 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "GpuTimer.h"
+
+// Точечный источник в формате std430: центр и радиус действия, цвет
+struct PointLight {
+    glm::vec4 positionRadius;
+    glm::vec4 color;
+};
+
+// Кластерное прямое освещение. Пирамида видимости делится на GRID_X x GRID_Y экранных плиток
+// и GRID_Z слоёв по глубине (экспоненциально); каждый кадр вычислительный шейдер cluster_lights.glsl
+// раскладывает источники по кластерам, и фрагментный шейдер перебирает только источники своего кластера.
+// Списки всех кластеров лежат подряд в общем буфере индексов (у кластера - начало и число).
+// Сколько индексов понадобилось кадру, читается без ожидания через забор; если буфер мал,
+// он увеличивается для следующих кадров, а не поместившиеся индексы учитываются в TakeDroppedIndices.
+// Размеры сетки продублированы в cluster_lights.glsl и fragment_shader.glsl.
+class ClusteredLights {
+public:
+    static const unsigned int GRID_X = 16;
+    static const unsigned int GRID_Y = 9;
+    static const unsigned int GRID_Z = 24;
+    static const unsigned int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static const unsigned int INITIAL_INDEX_CAPACITY = CLUSTER_COUNT * 16;
+
+    // layout(binding = ...) в шейдерах
+    static const unsigned int LIGHTS_BINDING = 4;
+    static const unsigned int RANGES_BINDING = 5;
+    static const unsigned int INDICES_BINDING = 6;
+    static const unsigned int TOTALS_BINDING = 15;
+
+    // Отключение кластеров (перебор всех источников во фрагментном шейдере) - для сравнения
+    bool clustered = true;
+
+    ClusteredLights()
+        : binShader("cluster_lights.glsl") {
+        std::vector<unsigned int> emptyRanges(CLUSTER_COUNT * 2, 0);
+        glCreateBuffers(1, &rangeBuffer);
+        glNamedBufferStorage(rangeBuffer, emptyRanges.size() * sizeof(unsigned int), emptyRanges.data(), 0);
+        glCreateBuffers(1, &totalsBuffer);
+        glNamedBufferStorage(totalsBuffer, 2 * sizeof(unsigned int), NULL, 0);
+
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &readbackBuffer);
+        glNamedBufferStorage(readbackBuffer, 2 * sizeof(unsigned int), NULL, flags);
+        readbackMapped = glMapNamedBufferRange(readbackBuffer, 0, 2 * sizeof(unsigned int), flags);
+
+        resizeIndices(INITIAL_INDEX_CAPACITY);
+        SetLights(std::vector<PointLight>());
+    }
+
+    // Загрузка списка источников (в мировых координатах)
+    void SetLights(const std::vector<PointLight>& newLights) {
+        lights = newLights;
+        // Неизменяемое хранилище пересоздаётся только при росте; пустой буфер привязывать нельзя,
+        // поэтому хотя бы один элемент
+        if (!lightBuffer || lights.size() > lightCapacity) {
+            if (lightBuffer)
+                glDeleteBuffers(1, &lightBuffer);
+            lightCapacity = std::max<size_t>(lights.size(), 1);
+            glCreateBuffers(1, &lightBuffer);
+            glNamedBufferStorage(lightBuffer, lightCapacity * sizeof(PointLight), NULL, GL_DYNAMIC_STORAGE_BIT);
+        }
+        if (!lights.empty())
+            glNamedBufferSubData(lightBuffer, 0, lights.size() * sizeof(PointLight), lights.data());
+    }
+
+    const std::vector<PointLight>& Lights() const {
+        return lights;
+    }
+
+    // Раскладка источников по кластерам для текущей камеры; zNear/zFar - как в projection
+    void Update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar) {
+        depthRange = glm::vec2(zNear, zFar);
+        if (!clustered || lights.empty())
+            return;
+        readTotals(false);
+
+        timer.Begin();
+        glClearNamedBufferData(totalsBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+        binShader.use();
+        binShader.setMat4("view", view);
+        binShader.setMat4("inverseProjection", glm::inverse(projection));
+        binShader.setVec2("clusterDepthRange", depthRange);
+        binShader.setUint("lightCount", (unsigned int)lights.size());
+        binShader.setUint("indexCapacity", indexCapacity);
+        bindBuffers();
+        glDispatchCompute((CLUSTER_COUNT + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        timer.End();
+
+        // Итоги кадра копируются, только когда прошлые уже прочитаны
+        if (!totalsFence) {
+            glCopyNamedBufferSubData(totalsBuffer, readbackBuffer, 0, 0, 2 * sizeof(unsigned int));
+            totalsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+
+    // Ожидание итогов последней раскладки: буфер индексов дорастает до нужного ей размера (для бенчмарков)
+    void SettleCapacity() {
+        readTotals(true);
+    }
+
+    unsigned int IndexCapacity() const {
+        return indexCapacity;
+    }
+
+    // Индексов в последнем прочитанном кадре
+    unsigned int RequiredIndices() const {
+        return requiredIndices;
+    }
+
+    // Индексы (пары кластер - источник), не поместившиеся в буфер, в прочитанных с прошлого вызова кадрах
+    unsigned int TakeDroppedIndices() {
+        unsigned int dropped = droppedIndices;
+        droppedIndices = 0;
+        return dropped;
+    }
+
+    // Параметры освещения для шейдера сцены; width/height - размер кадра
+    void Bind(Shader& shader, int width, int height) {
+        shader.use();
+        shader.setUint("pointLightCount", (unsigned int)lights.size());
+        shader.setBool("clusteredLights", clustered);
+        shader.setVec2("clusterDepthRange", depthRange);
+        shader.setVec2("screenSize", glm::vec2(std::max(width, 1), std::max(height, 1)));
+        bindBuffers();
+    }
+
+    // Время раскладки на GPU, среднее с прошлого вызова, мс
+    double TakeBinningMs() {
+        return timer.TakeAverageMs();
+    }
+
+    void FinishTimers() {
+        timer.Finish();
+    }
+
+    // Случайные источники внутри параллелепипеда; радиус порядка десятой доли его размера
+    static std::vector<PointLight> Scatter(size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, unsigned int seed = 1234) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        glm::vec3 size = boundsMax - boundsMin;
+        float radius = std::max(glm::length(size) * 0.1f, 0.05f);
+
+        std::vector<PointLight> result(count);
+        for (PointLight& light : result) {
+            glm::vec3 position = boundsMin + size * glm::vec3(unit(rng), unit(rng), unit(rng));
+            light.positionRadius = glm::vec4(position, radius * (0.5f + unit(rng)));
+            light.color = glm::vec4(glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.6f, 1.0f);
+        }
+        return result;
+    }
+
+private:
+    Shader binShader;
+    unsigned int lightBuffer = 0, rangeBuffer = 0, indexBuffer = 0, totalsBuffer = 0;
+    size_t lightCapacity = 0;
+    unsigned int indexCapacity = 0;
+    unsigned int requiredIndices = 0;
+    unsigned int droppedIndices = 0;
+    unsigned int readbackBuffer = 0;
+    void* readbackMapped = nullptr;
+    GLsync totalsFence = 0;
+    std::vector<PointLight> lights;
+    glm::vec2 depthRange = glm::vec2(0.1f, 100.0f);
+    GpuTimer timer;
+
+    void bindBuffers() {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHTS_BINDING, lightBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, RANGES_BINDING, rangeBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDICES_BINDING, indexBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TOTALS_BINDING, totalsBuffer);
+    }
+
+    void resizeIndices(unsigned int capacity) {
+        if (indexBuffer)
+            glDeleteBuffers(1, &indexBuffer);
+        indexCapacity = capacity;
+        glCreateBuffers(1, &indexBuffer);
+        glNamedBufferStorage(indexBuffer, (GLsizeiptr)indexCapacity * sizeof(unsigned int), NULL, 0);
+    }
+
+    // Итоги раскладки: wait - ждать забор, иначе только если он уже сработал
+    void readTotals(bool wait) {
+        if (!totalsFence)
+            return;
+        GLenum result = glClientWaitSync(totalsFence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+            return;
+        glDeleteSync(totalsFence);
+        totalsFence = 0;
+        if (result == GL_WAIT_FAILED)
+            return;
+
+        unsigned int totals[2];
+        std::memcpy(totals, readbackMapped, sizeof(totals));
+        requiredIndices = totals[0];
+        droppedIndices += totals[1];
+        if (requiredIndices > indexCapacity)
+            resizeIndices(requiredIndices + requiredIndices / 2);
+    }
+};
+
+#endif // CLUSTERED_LIGHTS_H
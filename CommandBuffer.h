@@ -0,0 +1,208 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glm.hpp>
+#include <GL/glew.h>
+
+// Команда отрисовки: простая структура без указателей, записывается без GL-вызовов
+struct RenderCommand {
+    enum Type : uint32_t {
+        BIND_PROGRAM,
+        BIND_FORMAT,       // a - общий VAO формата вершин
+        BIND_GEOMETRY,     // a - буфер вершин, b - буфер индексов, location - шаг вершины
+        BIND_STREAM,       // a - буфер дополнительного потока вершин (точка привязки 1), b - шаг
+        SET_MAT4,          // a - индекс в пуле матриц буфера
+        SET_INT,           // a - значение
+        DRAW,              // a - число индексов, b - смещение первого индекса в байтах
+        DRAW_INSTANCED,    // a - число индексов, b - число экземпляров
+        BEGIN_CONDITIONAL, // a - запрос видимости
+        END_CONDITIONAL
+    };
+
+    Type type;
+    int32_t location; // uniform для SET_*, шаг вершины для BIND_GEOMETRY
+    uint32_t a;
+    uint32_t b;
+};
+
+// Буфер команд отрисовки. Запись идёт из любого потока (по буферу на поток),
+// выполнение - на потоке с GL-контекстом. Команды группируются в пакеты с ключом сортировки;
+// Execute сливает пакеты всех буферов, упорядочивает по ключу и проигрывает их,
+// пропуская повторные привязки программы, формата вершин и буферов геометрии.
+class CommandBuffer {
+public:
+    struct Stats {
+        unsigned int packets = 0;
+        unsigned int commands = 0;
+        unsigned int programBinds = 0;
+        unsigned int formatBinds = 0;
+        unsigned int geometryBinds = 0;
+    };
+
+    // Программа (16 бит) | геометрия (24 бита) | порядок записи (24 бита)
+    static uint64_t MakeKey(uint32_t program, uint32_t geometry, uint32_t order) {
+        return ((uint64_t)(program & 0xFFFF) << 48) | ((uint64_t)(geometry & 0xFFFFFF) << 24) | (order & 0xFFFFFF);
+    }
+
+    void Clear() {
+        commands.clear();
+        packets.clear();
+        constants.clear();
+    }
+
+    void BeginPacket(uint64_t key) {
+        packets.push_back({ key, (uint32_t)commands.size(), 0 });
+    }
+
+    void BindProgram(uint32_t program) {
+        push({ RenderCommand::BIND_PROGRAM, -1, program, 0 });
+    }
+
+    void BindFormat(uint32_t vao) {
+        push({ RenderCommand::BIND_FORMAT, -1, vao, 0 });
+    }
+
+    // Буферы меша в точке привязки 0 текущего VAO формата
+    void BindGeometry(uint32_t vertexBuffer, uint32_t indexBuffer, int32_t stride) {
+        push({ RenderCommand::BIND_GEOMETRY, stride, vertexBuffer, indexBuffer });
+    }
+
+    // Дополнительный поток вершин в точке привязки 1 текущего VAO формата
+    void BindStream(uint32_t buffer, uint32_t stride) {
+        push({ RenderCommand::BIND_STREAM, -1, buffer, stride });
+    }
+
+    void SetMat4(int location, const glm::mat4& value) {
+        push({ RenderCommand::SET_MAT4, location, (uint32_t)constants.size(), 0 });
+        constants.push_back(value);
+    }
+
+    void SetInt(int location, int value) {
+        push({ RenderCommand::SET_INT, location, (uint32_t)value, 0 });
+    }
+
+    void Draw(uint32_t indexCount, uint32_t firstIndex = 0) {
+        push({ RenderCommand::DRAW, -1, indexCount, firstIndex * (uint32_t)sizeof(unsigned int) });
+    }
+
+    void DrawInstanced(uint32_t indexCount, uint32_t instanceCount) {
+        push({ RenderCommand::DRAW_INSTANCED, -1, indexCount, instanceCount });
+    }
+
+    void BeginConditional(uint32_t query) {
+        push({ RenderCommand::BEGIN_CONDITIONAL, -1, query, 0 });
+    }
+
+    void EndConditional() {
+        push({ RenderCommand::END_CONDITIONAL, -1, 0, 0 });
+    }
+
+    size_t PacketCount() const {
+        return packets.size();
+    }
+
+    // Выполнение пакетов всех буферов в порядке ключей; вызывается на потоке с GL-контекстом
+    static Stats Execute(const std::vector<CommandBuffer>& buffers) {
+        struct Entry {
+            uint64_t key;
+            uint32_t buffer;
+            uint32_t packet;
+        };
+
+        std::vector<Entry> order;
+        for (size_t b = 0; b < buffers.size(); ++b)
+            for (size_t p = 0; p < buffers[b].packets.size(); ++p)
+                order.push_back({ buffers[b].packets[p].key, (uint32_t)b, (uint32_t)p });
+        std::sort(order.begin(), order.end(), [](const Entry& x, const Entry& y) {
+            return x.key < y.key;
+        });
+
+        Stats stats;
+        uint32_t program = 0, format = 0, vertexBuffer = 0, indexBuffer = 0, streamBuffer = 0;
+        for (const Entry& entry : order) {
+            const CommandBuffer& buffer = buffers[entry.buffer];
+            const Packet& packet = buffer.packets[entry.packet];
+            const RenderCommand* command = &buffer.commands[packet.first];
+            stats.packets++;
+            stats.commands += packet.count;
+
+            for (uint32_t i = 0; i < packet.count; ++i, ++command) {
+                switch (command->type) {
+                case RenderCommand::BIND_PROGRAM:
+                    if (command->a != program) {
+                        program = command->a;
+                        glUseProgram(program);
+                        stats.programBinds++;
+                    }
+                    break;
+                case RenderCommand::BIND_FORMAT:
+                    if (command->a != format) {
+                        format = command->a;
+                        glBindVertexArray(format);
+                        vertexBuffer = indexBuffer = streamBuffer = 0;
+                        stats.formatBinds++;
+                    }
+                    break;
+                case RenderCommand::BIND_GEOMETRY:
+                    if (command->a != vertexBuffer) {
+                        vertexBuffer = command->a;
+                        glVertexArrayVertexBuffer(format, 0, vertexBuffer, 0, command->location);
+                        stats.geometryBinds++;
+                    }
+                    if (command->b != indexBuffer) {
+                        indexBuffer = command->b;
+                        glVertexArrayElementBuffer(format, indexBuffer);
+                    }
+                    break;
+                case RenderCommand::BIND_STREAM:
+                    if (command->a != streamBuffer) {
+                        streamBuffer = command->a;
+                        glVertexArrayVertexBuffer(format, 1, streamBuffer, 0, command->b);
+                    }
+                    break;
+                case RenderCommand::SET_MAT4:
+                    glUniformMatrix4fv(command->location, 1, GL_FALSE, &buffer.constants[command->a][0][0]);
+                    break;
+                case RenderCommand::SET_INT:
+                    glUniform1i(command->location, (int)command->a);
+                    break;
+                case RenderCommand::DRAW:
+                    glDrawElements(GL_TRIANGLES, command->a, GL_UNSIGNED_INT, (void*)(size_t)command->b);
+                    break;
+                case RenderCommand::DRAW_INSTANCED:
+                    glDrawElementsInstanced(GL_TRIANGLES, command->a, GL_UNSIGNED_INT, 0, command->b);
+                    break;
+                case RenderCommand::BEGIN_CONDITIONAL:
+                    glBeginConditionalRender(command->a, GL_QUERY_NO_WAIT);
+                    break;
+                case RenderCommand::END_CONDITIONAL:
+                    glEndConditionalRender();
+                    break;
+                }
+            }
+        }
+        glBindVertexArray(0);
+        return stats;
+    }
+
+private:
+    struct Packet {
+        uint64_t key;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    std::vector<RenderCommand> commands;
+    std::vector<Packet> packets;
+    std::vector<glm::mat4> constants;
+
+    void push(const RenderCommand& command) {
+        commands.push_back(command);
+        packets.back().count++;
+    }
+};
+
+#endif // COMMAND_BUFFER_H
@@ -0,0 +1,189 @@
+#ifndef CUBE_SHADOW_MAP_H
+#define CUBE_SHADOW_MAP_H
+
+#include <vector>
+#include <cfloat>
+#include <algorithm>
+#include <glm.hpp>
+#include <matrix_transform.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "Model.h"
+#include "MultiView.h"
+#include "GpuTimer.h"
+
+// Всенаправленные тени ключевого источника (light.position) в кубической карте. Шесть граней
+// рисуются одной отправкой через MultiView (слой = грань); глубина - расстояние до источника
+// (cube_depth_fragment.glsl). Карта перерисовывается, только когда сдвинулся источник или меш.
+// layered = false - по отправке на грань, для сравнения.
+class CubeShadowMap {
+public:
+    static const int SIZE = 1024;
+    static const int UNIT = 4;   // текстурный блок карты в основном шейдере
+
+    struct Stats {
+        unsigned int frames = 0;
+        unsigned int rebuilds = 0;
+        double passMs = 0.0;             // GPU, среднее на перерисовку
+        MultiView::Stats submission;
+    };
+
+    bool layered = true;
+
+    CubeShadowMap(Model& model)
+        : model(model), multiView(model), depthShader("multiview_vertex.glsl", "cube_depth_fragment.glsl") {
+        model.EnablePositionStreams();
+        computeSceneBounds();
+
+        glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texture);
+        glTextureStorage2D(texture, 1, GL_DEPTH_COMPONENT32F, SIZE, SIZE);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTextureParameteri(texture, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+        // Вложение всей кубической карты: грань выбирает gl_Layer
+        glCreateFramebuffers(1, &framebuffer);
+        glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, texture, 0);
+        glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+        glNamedFramebufferReadBuffer(framebuffer, GL_NONE);
+        if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::CUBE_SHADOW_MAP::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+
+    void SetLight(const glm::vec3& position) {
+        if (position != lightPosition)
+            valid = false;
+        lightPosition = position;
+        farPlane = 0.0f;
+        for (int c = 0; c < 8; ++c) {
+            glm::vec3 corner((c & 1) ? sceneMax.x : sceneMin.x, (c & 2) ? sceneMax.y : sceneMin.y, (c & 4) ? sceneMax.z : sceneMin.z);
+            farPlane = std::max(farPlane, glm::length(corner - position));
+        }
+        farPlane = std::max(farPlane, 0.1f);
+    }
+
+    // Перерисовка при изменениях; width/height - размер основного кадра для восстановления glViewport.
+    // Возвращает true, если тени изменились
+    bool Update(int width, int height) {
+        period.frames++;
+        if (valid && model.WorldTransforms() == cachedTransforms)
+            return false;
+
+        GLint target = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        timer.Begin();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, SIZE, SIZE);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader.use();
+        depthShader.setVec3("lightPosition", lightPosition);
+        depthShader.setFloat("farPlane", farPlane);
+
+        std::vector<glm::mat4> faces = FaceViewProjections();
+        if (layered) {
+            multiView.SetViews(faces);
+            multiView.Draw(depthShader, MultiView::TARGET_LAYERS, true);
+        }
+        else {
+            for (int face = 0; face < 6; ++face) {
+                multiView.SetViews({ faces[face] }, { face });
+                multiView.Draw(depthShader, MultiView::TARGET_LAYERS, true);
+            }
+        }
+        timer.End();
+
+        cachedTransforms = model.WorldTransforms();
+        valid = true;
+        period.rebuilds++;
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    // Следующий Update перерисует карту
+    void Invalidate() {
+        valid = false;
+    }
+
+    // Карта для основного шейдера (включает кубические тени вместо карт ShadowMap)
+    void Bind(Shader& shader) {
+        shader.use();
+        shader.setBool("cubeShadows", true);
+        shader.setInt("pointShadowMap", UNIT);
+        shader.setFloat("pointShadowFar", farPlane);
+        glBindTextureUnit(UNIT, texture);
+    }
+
+    // Грани в порядке GL_TEXTURE_CUBE_MAP_POSITIVE_X..NEGATIVE_Z
+    std::vector<glm::mat4> FaceViewProjections() const {
+        static const glm::vec3 directions[6] = {
+            { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+            { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f } };
+        static const glm::vec3 ups[6] = {
+            { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+            { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f } };
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, farPlane * 0.001f, farPlane);
+        std::vector<glm::mat4> faces(6);
+        for (int face = 0; face < 6; ++face)
+            faces[face] = projection * glm::lookAt(lightPosition, lightPosition + directions[face], ups[face]);
+        return faces;
+    }
+
+    Stats TakeStats() {
+        Stats stats = period;
+        stats.passMs = timer.TakeAverageMs();
+        if (stats.passMs == 0.0)
+            stats.passMs = timer.LastMs();
+        stats.submission = multiView.TakeStats();
+        period = Stats();
+        return stats;
+    }
+
+    // Ожидание всех замеров (для бенчмарков)
+    void FinishTimers() {
+        timer.Finish();
+    }
+
+private:
+    Model& model;
+    MultiView multiView;
+    Shader depthShader;
+    unsigned int texture = 0, framebuffer = 0;
+    glm::vec3 lightPosition = glm::vec3(0.0f);
+    glm::vec3 sceneMin = glm::vec3(-1.0f), sceneMax = glm::vec3(1.0f);
+    float farPlane = 1.0f;
+
+    bool valid = false;
+    std::vector<glm::mat4> cachedTransforms;
+    GpuTimer timer;
+    Stats period;
+
+    // Исходное положение всех мешей с запасом на ход подвижных деталей
+    void computeSceneBounds() {
+        if (model.meshes.empty())
+            return;
+        sceneMin = glm::vec3(FLT_MAX);
+        sceneMax = glm::vec3(-FLT_MAX);
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            const Mesh& mesh = model.meshes[i];
+            glm::mat4 world = model.WorldTransform(i);
+            for (int c = 0; c < 8; ++c) {
+                glm::vec3 corner((c & 1) ? mesh.aabbMax.x : mesh.aabbMin.x,
+                    (c & 2) ? mesh.aabbMax.y : mesh.aabbMin.y,
+                    (c & 4) ? mesh.aabbMax.z : mesh.aabbMin.z);
+                glm::vec3 p = glm::vec3(world * glm::vec4(corner, 1.0f));
+                sceneMin = glm::min(sceneMin, p);
+                sceneMax = glm::max(sceneMax, p);
+            }
+        }
+        glm::vec3 margin = (sceneMax - sceneMin) * 0.2f;
+        sceneMin -= margin;
+        sceneMax += margin;
+    }
+};
+
+#endif // CUBE_SHADOW_MAP_H
@@ -0,0 +1,169 @@
+#ifndef DEPTH_PREPASS_H
+#define DEPTH_PREPASS_H
+
+#include <deque>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "Model.h"
+
+// Предварительный проход по глубине. Сначала слой рисуется без цвета по потокам позиций
+// (Mesh::CreatePositionStream), затем основной проход идёт с отключённой записью глубины
+// и сравнением GL_EQUAL (или GL_LEQUAL), так что фрагментный шейдер освещения выполняется
+// по одному разу на пиксель. Перерисовка оценивается запросами GL_SAMPLES_PASSED:
+// фрагменты, прошедшие тест глубины в предварительном проходе, - столько затенялось бы без него.
+// Предварительный проход можно выполнить отдельно (DrawDepth в текстуру графа), чтобы его глубину
+// читали проходы до основного; DrawWithDepth затем копирует её и только затеняет.
+class DepthPrepass {
+public:
+    enum Mode { PREPASS_OFF, PREPASS_EQUAL, PREPASS_LEQUAL };
+
+    struct Stats {
+        unsigned int frames = 0;
+        double depthFragments = 0.0;   // на кадр: прошли тест глубины в предварительном проходе
+        double shadedFragments = 0.0;  // на кадр: затенены в основном проходе
+    };
+
+    DepthPrepass(Model& model)
+        : model(model), depthShader("depth_vertex.glsl", "depth_fragment.glsl") {
+        model.EnablePositionStreams();
+    }
+
+    void SetMode(Mode newMode) {
+        mode = newMode;
+    }
+
+    Mode GetMode() const {
+        return mode;
+    }
+
+    // Камера на кадр (те же матрицы, что у основного шейдера)
+    void SetCamera(const glm::mat4& view, const glm::mat4& projection, bool lateLatched) {
+        depthShader.use();
+        depthShader.setMat4("view", view);
+        depthShader.setMat4("projection", projection);
+        depthShader.setBool("lateLatched", lateLatched);
+    }
+
+    // Слой модели с предварительным проходом или, в режиме PREPASS_OFF, обычной отрисовкой
+    void Draw(Shader& shader, Model::DrawLayer layer = Model::DRAW_ALL) {
+        Query query;
+        if (mode != PREPASS_OFF) {
+            glGenQueries(2, query.ids);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glBeginQuery(GL_SAMPLES_PASSED, query.ids[0]);
+            model.Draw(depthShader, layer, true);
+            glEndQuery(GL_SAMPLES_PASSED);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+            glDepthMask(GL_FALSE);
+            glDepthFunc(mode == PREPASS_EQUAL ? GL_EQUAL : GL_LEQUAL);
+        }
+        else {
+            glGenQueries(1, &query.ids[1]);
+        }
+        shade(shader, layer, query);
+    }
+
+    // Только предварительный проход всей модели в привязанный буфер глубины
+    void DrawDepth() {
+        glClear(GL_DEPTH_BUFFER_BIT);
+        if (!depthQuery)
+            glGenQueries(1, &depthQuery);
+        glBeginQuery(GL_SAMPLES_PASSED, depthQuery);
+        model.Draw(depthShader, Model::DRAW_ALL, true);
+        glEndQuery(GL_SAMPLES_PASSED);
+    }
+
+    // Основной проход поверх глубины DrawDepth: depthTexture копируется в привязанный буфер
+    // (формат 24 + 8, как у основного), затем затенение с тем же сравнением, что и в Draw
+    void DrawWithDepth(Shader& shader, unsigned int depthTexture, int width, int height) {
+        GLint target = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        if (!copyFramebuffer)
+            glCreateFramebuffers(1, &copyFramebuffer);
+        glNamedFramebufferTexture(copyFramebuffer, GL_DEPTH_STENCIL_ATTACHMENT, depthTexture, 0);
+        glBlitNamedFramebuffer(copyFramebuffer, target, 0, 0, width, height, 0, 0, width, height,
+            GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        Query query;
+        query.ids[0] = depthQuery;
+        depthQuery = 0;
+        glGenQueries(1, &query.ids[1]);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(mode == PREPASS_LEQUAL ? GL_LEQUAL : GL_EQUAL);
+        shade(shader, Model::DRAW_ALL, query);
+    }
+
+    // Конец кадра для статистики (кадр может состоять из нескольких вызовов Draw)
+    void EndFrame() {
+        period.frames++;
+    }
+
+    // Средние на кадр с прошлого вызова
+    Stats TakeStats() {
+        Stats stats = period;
+        if (stats.frames > 0) {
+            stats.depthFragments /= stats.frames;
+            stats.shadedFragments /= stats.frames;
+        }
+        period = Stats();
+        return stats;
+    }
+
+    static const char* ModeName(Mode mode) {
+        static const char* names[] = { "off", "equal", "less or equal" };
+        return names[mode];
+    }
+
+private:
+    // ids[0] - предварительный проход (0, если его не было), ids[1] - основной
+    struct Query {
+        unsigned int ids[2] = {};
+    };
+
+    Model& model;
+    Shader depthShader;
+    Mode mode = PREPASS_OFF;
+    std::deque<Query> pending;
+    Stats period;
+    unsigned int depthQuery = 0;       // запрос последнего DrawDepth, переходит в DrawWithDepth
+    unsigned int copyFramebuffer = 0;
+
+    void shade(Shader& shader, Model::DrawLayer layer, const Query& query) {
+        shader.use();
+        glBeginQuery(GL_SAMPLES_PASSED, query.ids[1]);
+        model.Draw(shader, layer);
+        glEndQuery(GL_SAMPLES_PASSED);
+
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        pending.push_back(query);
+        collect();
+    }
+
+    // Готовые результаты забираются без ожидания, по порядку выпуска
+    void collect() {
+        while (!pending.empty()) {
+            Query& query = pending.front();
+            GLint available = 0;
+            glGetQueryObjectiv(query.ids[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+
+            GLuint64 shaded = 0, depth = 0;
+            glGetQueryObjectui64v(query.ids[1], GL_QUERY_RESULT, &shaded);
+            if (query.ids[0])
+                glGetQueryObjectui64v(query.ids[0], GL_QUERY_RESULT, &depth);
+            else
+                depth = shaded;
+            period.shadedFragments += (double)shaded;
+            period.depthFragments += (double)depth;
+
+            glDeleteQueries(2, query.ids);
+            pending.pop_front();
+        }
+    }
+};
+
+#endif // DEPTH_PREPASS_H
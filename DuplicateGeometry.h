@@ -0,0 +1,108 @@
+#ifndef DUPLICATE_GEOMETRY_H
+#define DUPLICATE_GEOMETRY_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <glm.hpp>
+#include <matrix_transform.hpp>
+#include "Mesh.h"
+
+// Поиск повторяющейся геометрии при импорте (болты, рельсы, кронштейны в CAD-экспорте).
+// Меши совпадают, если у них одинаковые индексы, а вершины переводятся друг в друга
+// одним жёстким преобразованием (поворот + перенос) с сохранением порядка вершин.
+namespace duplicate_geometry {
+
+    inline uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 1469598103934665603ull) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    inline glm::vec3 centroid(const std::vector<Vertex>& vertices) {
+        glm::vec3 sum(0.0f);
+        for (const Vertex& v : vertices)
+            sum += v.Position;
+        return vertices.empty() ? sum : sum / (float)vertices.size();
+    }
+
+    // Хэш, не зависящий от положения и поворота: индексы, число вершин
+    // и квантованная сумма квадратов расстояний до центра
+    inline uint64_t rigidSignature(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
+        uint64_t hash = fnv1a(indices.data(), indices.size() * sizeof(unsigned int));
+        uint64_t count = vertices.size();
+        hash = fnv1a(&count, sizeof(count), hash);
+
+        glm::vec3 c = centroid(vertices);
+        double spread = 0.0;
+        for (const Vertex& v : vertices)
+            spread += glm::dot(v.Position - c, v.Position - c);
+        int64_t quantized = (int64_t)std::llround(spread / std::max<size_t>(vertices.size(), 1) * 1e4);
+        return fnv1a(&quantized, sizeof(quantized), hash);
+    }
+
+    // Ортонормированный базис по центру и двум опорным вершинам
+    inline glm::mat3 frame(const std::vector<Vertex>& vertices, const glm::vec3& c, size_t a, size_t b) {
+        glm::vec3 x = glm::normalize(vertices[a].Position - c);
+        glm::vec3 z = glm::normalize(glm::cross(x, vertices[b].Position - c));
+        glm::vec3 y = glm::cross(z, x);
+        return glm::mat3(x, y, z);
+    }
+
+    // Жёсткое преобразование, переводящее вершины source в вершины target, если оно существует
+    inline bool findRigidTransform(const std::vector<Vertex>& source, const std::vector<unsigned int>& sourceIndices,
+        const std::vector<Vertex>& target, const std::vector<unsigned int>& targetIndices, glm::mat4& transform) {
+        if (source.size() != target.size() || source.empty() || sourceIndices != targetIndices)
+            return false;
+
+        glm::vec3 cs = centroid(source), ct = centroid(target);
+
+        // Опорные вершины: самая дальняя от центра и самая дальняя от прямой через неё
+        size_t a = 0;
+        float best = -1.0f;
+        for (size_t i = 0; i < source.size(); ++i) {
+            float d = glm::dot(source[i].Position - cs, source[i].Position - cs);
+            if (d > best) {
+                best = d;
+                a = i;
+            }
+        }
+        float scale = std::sqrt(best);
+        if (scale <= 0.0f)
+            return false;
+
+        glm::vec3 axis = (source[a].Position - cs) / scale;
+        size_t b = a;
+        best = 0.0f;
+        for (size_t i = 0; i < source.size(); ++i) {
+            float d = glm::length(glm::cross(axis, source[i].Position - cs));
+            if (d > best) {
+                best = d;
+                b = i;
+            }
+        }
+
+        glm::mat3 rotation(1.0f);
+        if (b != a && best > scale * 1e-3f)
+            rotation = frame(target, ct, a, b) * glm::transpose(frame(source, cs, a, b));
+        glm::vec3 translation = ct - rotation * cs;
+
+        float tolerance = scale * 1e-4f + 1e-6f;
+        for (size_t i = 0; i < source.size(); ++i) {
+            if (glm::length(rotation * source[i].Position + translation - target[i].Position) > tolerance)
+                return false;
+            if (glm::length(rotation * source[i].Normal - target[i].Normal) > 1e-3f)
+                return false;
+        }
+
+        transform = glm::mat4(rotation);
+        transform[3] = glm::vec4(translation, 1.0f);
+        return true;
+    }
+
+} // namespace duplicate_geometry
+
+#endif // DUPLICATE_GEOMETRY_H
@@ -0,0 +1,174 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <deque>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "GpuTimer.h"
+
+// Динамическое разрешение. Сцена рисуется в текстуру размера окна (временный ресурс RenderGraph),
+// но только в её левую нижнюю часть renderWidth x renderHeight; затем масштабируется в окно
+// (билинейно с повышением резкости, upscale_fragment.glsl). Масштаб подбирается по времени кадра
+// на GPU (метки GL_TIMESTAMP охватывают вложенные таймеры проходов): площадь кадра меняется
+// пропорционально запасу по бюджету, шагами STEP, не чаще раза в COOLDOWN_FRAMES кадров
+// (результаты замеров приходят с задержкой в несколько кадров).
+class DynamicResolution {
+public:
+    static const int HISTORY_SIZE = 600;
+    static const int COOLDOWN_FRAMES = 4;
+    static const int COLOR_UNIT = 0;
+
+    struct Sample {
+        float scale;   // доля ширины и высоты окна
+        float gpuMs;   // последний готовый замер на момент кадра
+    };
+
+    struct Stats {
+        unsigned int frames = 0;
+        float scale = 1.0f;
+        float minScale = 1.0f;
+        float maxScale = 1.0f;
+        float averageScale = 1.0f;
+        double gpuMs = 0.0;
+        double budgetMs = 0.0;
+        unsigned int changes = 0;
+    };
+
+    // budgetMs - бюджет кадра на GPU; масштаб не опускается ниже minScale
+    DynamicResolution(double budgetMs, float minScale = 0.5f)
+        : budgetMs(budgetMs), minScale(std::max(0.1f, std::min(minScale, 1.0f))),
+        upscaleShader("fullscreen_vertex.glsl", "upscale_fragment.glsl"), frameTimer(true) {
+        glGenVertexArrays(1, &emptyVAO);
+        // Текстура сцены приходит извне с любыми параметрами выборки
+        glGenSamplers(1, &linearSampler);
+        glSamplerParameteri(linearSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glSamplerParameteri(linearSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glSamplerParameteri(linearSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    void SetBudget(double newBudgetMs) {
+        budgetMs = newBudgetMs;
+    }
+
+    // Начало кадра: размер сцены на этот кадр (RenderWidth x RenderHeight)
+    void BeginFrame(int outputWidth, int outputHeight) {
+        width = outputWidth;
+        height = outputHeight;
+        renderWidth = std::max(1, (int)std::lround(outputWidth * scale));
+        renderHeight = std::max(1, (int)std::lround(outputHeight * scale));
+        frameTimer.Begin();
+    }
+
+    int RenderWidth() const {
+        return renderWidth;
+    }
+
+    int RenderHeight() const {
+        return renderHeight;
+    }
+
+    // Конец кадра: масштабирование sceneColor в привязанный кадровый буфер
+    // и новый масштаб по времени GPU
+    void EndFrame(unsigned int sceneColor) {
+        frameTimer.End();
+
+        glViewport(0, 0, width, height);
+        glDisable(GL_DEPTH_TEST);
+        upscaleShader.use();
+        upscaleShader.setInt("sceneColor", COLOR_UNIT);
+        upscaleShader.setVec2("renderSize", glm::vec2(renderWidth, renderHeight));
+        upscaleShader.setVec2("outputSize", glm::vec2(width, height));
+        upscaleShader.setFloat("sharpness", scale < 1.0f ? 0.5f + (1.0f - scale) : 0.0f);
+        glActiveTexture(GL_TEXTURE0 + COLOR_UNIT);
+        glBindTexture(GL_TEXTURE_2D, sceneColor);
+        glBindSampler(COLOR_UNIT, linearSampler);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBindSampler(COLOR_UNIT, 0);
+        glEnable(GL_DEPTH_TEST);
+
+        updateScale();
+    }
+
+    // Масштаб и время GPU по кадрам, последние HISTORY_SIZE
+    const std::deque<Sample>& History() const {
+        return history;
+    }
+
+    // Сводка с прошлого вызова
+    Stats TakeStats() {
+        Stats stats = period;
+        stats.scale = scale;
+        stats.budgetMs = budgetMs;
+        if (stats.frames > 0)
+            stats.averageScale = scaleSum / stats.frames;
+        else
+            stats.minScale = stats.maxScale = stats.averageScale = scale;
+        stats.gpuMs = frameTimer.TakeAverageMs();
+        period = Stats();
+        period.minScale = period.maxScale = scale;
+        scaleSum = 0.0f;
+        return stats;
+    }
+
+private:
+    static constexpr float STEP = 1.0f / 32.0f;
+
+    double budgetMs;
+    float minScale;
+    float scale = 1.0f;
+    int cooldown = 0;
+    int renderWidth = 0, renderHeight = 0;
+
+    Shader upscaleShader;
+    GpuTimer frameTimer;
+    unsigned int linearSampler = 0;
+    unsigned int emptyVAO = 0;
+    int width = 0;
+    int height = 0;
+
+    std::deque<Sample> history;
+    Stats period;
+    float scaleSum = 0.0f;
+
+    void updateScale() {
+        float gpuMs = (float)frameTimer.LastMs();
+        history.push_back({ scale, gpuMs });
+        if (history.size() > HISTORY_SIZE)
+            history.pop_front();
+        period.frames++;
+        period.minScale = std::min(period.minScale, scale);
+        period.maxScale = std::max(period.maxScale, scale);
+        scaleSum += scale;
+
+        if (cooldown > 0) {
+            cooldown--;
+            return;
+        }
+        if (gpuMs <= 0.0f)
+            return;
+
+        // Время кадра примерно пропорционально площади: целимся в 90% бюджета,
+        // за шаг площадь меняется не больше чем вдвое (или на четверть вверх)
+        float target = (float)budgetMs * 0.9f;
+        float areaRatio = std::max(0.5f, std::min(target / gpuMs, 1.25f));
+        float desired = scale * std::sqrt(areaRatio);
+        desired = std::max(minScale, std::min(std::floor(desired / STEP + 0.5f) * STEP, 1.0f));
+
+        // Вверх - только при заметном запасе, чтобы разрешение не колебалось
+        bool down = desired < scale && gpuMs > (float)budgetMs * 0.95f;
+        bool up = desired > scale && gpuMs < target;
+        if (down || up) {
+            scale = desired;
+            cooldown = COOLDOWN_FRAMES;
+            period.changes++;
+        }
+    }
+};
+
+#endif // DYNAMIC_RESOLUTION_H
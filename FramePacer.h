@@ -0,0 +1,207 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+#include <GLFW/glfw3.h>
+
+// Темп вывода кадров. Режимы: вертикальная синхронизация, адаптивная синхронизация
+// (без ожидания, если кадр опоздал; при отсутствии расширения - обычная),
+// собственная целевая частота (ожидание сном и затем активным циклом для точности лучше миллисекунды)
+// и без ограничения. Если кадры долго не укладываются в бюджет, частота снижается вдвое,
+// и возвращается обратно, когда запас снова появляется.
+// Вызывается на потоке с GL-контекстом: SetMode после создания, Wait перед SwapBuffers,
+// FramePresented после него. На Windows на время жизни объекта поднимается разрешение
+// системного таймера до 1 мс (по умолчанию сон округляется до ~15.6 мс).
+class FramePacer {
+public:
+    enum Mode { PACING_VSYNC, PACING_ADAPTIVE, PACING_TARGET, PACING_OFF };
+
+    struct Stats {
+        unsigned int frames = 0;
+        double targetMs = 0.0;
+        double meanMs = 0.0;
+        double varianceMs2 = 0.0;   // дисперсия интервала между кадрами, мс^2
+        double deviationMs = 0.0;   // среднее |интервал - цель|
+        unsigned int missedFrames = 0;
+        bool halfRate = false;
+    };
+
+    // displayRate - частота монитора (glfwGetVideoMode можно вызывать только с основного потока)
+    FramePacer(Mode mode, double targetRate, double displayRate)
+        : targetRate(targetRate), displayRate(displayRate > 0.0 ? displayRate : 60.0) {
+#ifdef _WIN32
+        timerPeriodRaised = timeBeginPeriod(1) == TIMERR_NOERROR;
+#endif
+        SetMode(mode);
+    }
+
+    ~FramePacer() {
+#ifdef _WIN32
+        if (timerPeriodRaised)
+            timeEndPeriod(1);
+#endif
+    }
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    Mode GetMode() const {
+        return mode;
+    }
+
+    void SetMode(Mode newMode) {
+        mode = newMode;
+        halfRate = false;
+        missStreak = 0;
+        slackStreak = 0;
+        applySwapInterval();
+    }
+
+    // Начало работы над кадром (для оценки запаса по бюджету)
+    void BeginFrame() {
+        frameStart = Clock::now();
+    }
+
+    // Ожидание момента вывода в режиме целевой частоты
+    void Wait() {
+        workSeconds = std::chrono::duration<double>(Clock::now() - frameStart).count();
+        if (mode != PACING_TARGET || lastPresent == Clock::time_point())
+            return;
+
+        Clock::time_point deadline = lastPresent + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(intervalSeconds()));
+        Clock::time_point sleepUntil = deadline - std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(spinMarginSeconds));
+        Clock::time_point now = Clock::now();
+        if (sleepUntil > now) {
+            std::this_thread::sleep_until(sleepUntil);
+            // Запас на активное ожидание следует за фактическим опозданием пробуждения:
+            // к выбросу сразу, обратно - плавно (верхней границы нет, грубый таймер даёт и 15 мс)
+            double overshoot = std::chrono::duration<double>(Clock::now() - sleepUntil).count() + 0.0002;
+            spinMarginSeconds = overshoot > spinMarginSeconds ? overshoot
+                : std::max(0.0005, spinMarginSeconds * 0.95 + overshoot * 0.05);
+        }
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+    }
+
+    // Сразу после SwapBuffers
+    void FramePresented() {
+        Clock::time_point now = Clock::now();
+        double interval = std::chrono::duration<double>(now - lastPresent).count();
+        // Паузы отрисовки по требованию в статистику не входят
+        if (lastPresent != Clock::time_point() && interval < intervalSeconds() * 4.0 + 0.1) {
+            double target = intervalSeconds();
+            sum += interval;
+            sumSquares += interval * interval;
+            deviation += std::fabs(interval - target);
+            period.frames++;
+
+            bool missed = mode != PACING_OFF && workSeconds > baseIntervalSeconds();
+            if (missed)
+                period.missedFrames++;
+            updateHalfRate(missed);
+        }
+        lastPresent = now;
+    }
+
+    // Статистика с прошлого вызова
+    Stats TakeStats() {
+        Stats stats = period;
+        stats.targetMs = mode == PACING_OFF ? 0.0 : intervalSeconds() * 1000.0;
+        stats.halfRate = halfRate;
+        if (stats.frames > 0) {
+            double mean = sum / stats.frames;
+            stats.meanMs = mean * 1000.0;
+            stats.varianceMs2 = std::max(0.0, sumSquares / stats.frames - mean * mean) * 1e6;
+            stats.deviationMs = deviation / stats.frames * 1000.0;
+        }
+        period = Stats();
+        sum = sumSquares = deviation = 0.0;
+        return stats;
+    }
+
+    static const char* ModeName(Mode mode) {
+        static const char* names[] = { "vsync", "adaptive vsync", "target rate", "off" };
+        return names[mode];
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // Снижение вдвое после MISS_LIMIT опозданий подряд, возврат после SLACK_LIMIT кадров с запасом 30%
+    static const int MISS_LIMIT = 30;
+    static const int SLACK_LIMIT = 120;
+
+    Mode mode = PACING_VSYNC;
+    double targetRate;
+    double displayRate;
+    bool halfRate = false;
+    int missStreak = 0;
+    int slackStreak = 0;
+    double spinMarginSeconds = 0.0015;
+    bool timerPeriodRaised = false;
+    double workSeconds = 0.0;
+    Clock::time_point frameStart;
+    Clock::time_point lastPresent;
+
+    Stats period;
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    double deviation = 0.0;
+
+    double baseIntervalSeconds() const {
+        return 1.0 / (mode == PACING_TARGET ? targetRate : displayRate);
+    }
+
+    double intervalSeconds() const {
+        return baseIntervalSeconds() * (halfRate ? 2.0 : 1.0);
+    }
+
+    void applySwapInterval() {
+        int interval = 0;
+        if (mode == PACING_VSYNC)
+            interval = 1;
+        else if (mode == PACING_ADAPTIVE)
+            interval = (glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                glfwExtensionSupported("GLX_EXT_swap_control_tear")) ? -1 : 1;
+        if (halfRate)
+            interval *= 2;
+        glfwSwapInterval(interval);
+    }
+
+    void updateHalfRate(bool missed) {
+        if (mode == PACING_OFF)
+            return;
+
+        missStreak = missed ? missStreak + 1 : 0;
+        slackStreak = workSeconds < baseIntervalSeconds() * 0.7 ? slackStreak + 1 : 0;
+
+        if (!halfRate && missStreak >= MISS_LIMIT) {
+            halfRate = true;
+            slackStreak = 0;
+            applySwapInterval();
+        }
+        else if (halfRate && slackStreak >= SLACK_LIMIT) {
+            halfRate = false;
+            missStreak = 0;
+            applySwapInterval();
+        }
+    }
+};
+
+#endif // FRAME_PACER_H
@@ -0,0 +1,97 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <GL/glew.h>
+
+// Замер времени GPU запросами GL_TIME_ELAPSED. Запросы идут по кольцу из RING_SIZE штук,
+// результат забирается, когда готов, поэтому процессор GPU не ждёт.
+// Запросы GL_TIME_ELAPSED не вкладываются: между Begin и End других таймеров быть не должно.
+// Таймер с nestable = true ставит метки GL_TIMESTAMP и может охватывать другие таймеры.
+class GpuTimer {
+public:
+    static const int RING_SIZE = 4;
+
+    GpuTimer(bool nestable = false)
+        : nestable(nestable) {
+        glGenQueries(RING_SIZE, queries);
+        if (nestable)
+            glGenQueries(RING_SIZE, endQueries);
+    }
+
+    void Begin() {
+        if (issued[current])
+            collect(true);
+        if (nestable)
+            glQueryCounter(queries[current], GL_TIMESTAMP);
+        else
+            glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    void End() {
+        if (nestable)
+            glQueryCounter(endQueries[current], GL_TIMESTAMP);
+        else
+            glEndQuery(GL_TIME_ELAPSED);
+        issued[current] = true;
+        current = (current + 1) % RING_SIZE;
+        collect(false);
+    }
+
+    // Ожидание всех выпущенных замеров (для бенчмарков)
+    void Finish() {
+        collect(true);
+    }
+
+    // Последний готовый замер, мс
+    double LastMs() const {
+        return lastMs;
+    }
+
+    // Среднее за период с прошлого вызова, мс
+    double TakeAverageMs() {
+        double average = samples > 0 ? totalMs / samples : 0.0;
+        totalMs = 0.0;
+        samples = 0;
+        return average;
+    }
+
+private:
+    bool nestable;
+    unsigned int queries[RING_SIZE];
+    unsigned int endQueries[RING_SIZE] = {};
+    bool issued[RING_SIZE] = {};
+    int current = 0;
+    double lastMs = 0.0;
+    double totalMs = 0.0;
+    int samples = 0;
+
+    // Результаты забираются по порядку выпуска, начиная с самого старого
+    void collect(bool wait) {
+        for (int k = 0; k < RING_SIZE; ++k) {
+            int index = (current + k) % RING_SIZE;
+            if (!issued[index])
+                continue;
+
+            // Метки выполняются по порядку: готова конечная - готова и начальная
+            unsigned int last = nestable ? endQueries[index] : queries[index];
+            GLint available = 0;
+            glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available && !wait)
+                return;
+
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(last, GL_QUERY_RESULT, &nanoseconds);
+            if (nestable) {
+                GLuint64 start = 0;
+                glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &start);
+                nanoseconds = nanoseconds > start ? nanoseconds - start : 0;
+            }
+            issued[index] = false;
+            lastMs = nanoseconds / 1e6;
+            totalMs += lastMs;
+            samples++;
+        }
+    }
+};
+
+#endif // GPU_TIMER_H
@@ -0,0 +1,230 @@
+#ifndef HIZ_CULLING_H
+#define HIZ_CULLING_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <glm.hpp>
+#include "Shader.h"
+#include "Model.h"
+
+// Отсечение перекрытых мешей по иерархическому Z-буферу.
+// Фаза 1 проверяет объекты по пирамиде прошлого кадра (с репроекцией прошлой матрицей камеры),
+// фаза 2 перепроверяет отброшенные объекты по пирамиде, построенной из глубины фазы 1.
+// Команды отрисовки пишет вычислительный шейдер, процессор результат не читает.
+// Статистика копируется в постоянно отображённый буфер не чаще раза в STATS_INTERVAL секунд
+// и забирается после срабатывания забора, без ожидания GPU.
+class HiZCulling {
+public:
+    static constexpr double STATS_INTERVAL = 1.0;
+
+    struct Stats {
+        unsigned int totalDraws = 0;
+        unsigned int totalTriangles = 0;
+        unsigned int frustumDraws = 0;
+        unsigned int frustumTriangles = 0;
+        unsigned int occludedDraws = 0;
+        unsigned int occludedTriangles = 0;
+        unsigned int secondPassDraws = 0;
+        unsigned int secondPassTriangles = 0;
+    };
+
+    HiZCulling(Model& model)
+        : model(model), buildShader("hiz_build.glsl"), cullShader("hiz_cull.glsl") {
+        objectCount = (unsigned int)model.meshes.size();
+
+        std::vector<glm::vec4> bounds;
+        for (const Mesh& mesh : model.meshes) {
+            bounds.push_back(glm::vec4(mesh.aabbMin, 1.0f));
+            bounds.push_back(glm::vec4(mesh.aabbMax, 1.0f));
+        }
+
+        // Обе половины буфера команд: [0, n) - фаза 1, [n, 2n) - фаза 2
+        std::vector<unsigned int> commands;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (const Mesh& mesh : model.meshes) {
+                unsigned int command[5] = { (unsigned int)mesh.indices.size(), 0, 0, 0, 0 };
+                commands.insert(commands.end(), command, command + 5);
+            }
+        }
+
+        glCreateBuffers(1, &boundsBuffer);
+        glNamedBufferStorage(boundsBuffer, bounds.size() * sizeof(glm::vec4), bounds.data(), 0);
+
+        glCreateBuffers(1, &transformBuffer);
+        glNamedBufferStorage(transformBuffer, objectCount * sizeof(glm::mat4), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+        glCreateBuffers(1, &commandBuffer);
+        glNamedBufferStorage(commandBuffer, commands.size() * sizeof(unsigned int), commands.data(), 0);
+
+        glCreateBuffers(1, &statsBuffer);
+        glNamedBufferStorage(statsBuffer, sizeof(Stats), NULL, 0);
+
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &readbackBuffer);
+        glNamedBufferStorage(readbackBuffer, sizeof(Stats), NULL, flags);
+        readbackMapped = glMapNamedBufferRange(readbackBuffer, 0, sizeof(Stats), flags);
+    }
+
+    // Полный кадр: фаза 1, построение пирамиды, фаза 2, пирамида для следующего кадра.
+    // Глубина копируется из текущего GL_READ_FRAMEBUFFER размером width x height.
+    void Draw(Shader& shader, const glm::mat4& viewProj, int width, int height) {
+        resize(width, height);
+        readStats();
+
+        std::vector<glm::mat4> transforms = model.WorldTransforms();
+        glNamedBufferSubData(transformBuffer, 0, objectCount * sizeof(glm::mat4), transforms.data());
+        glClearNamedBufferData(statsBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+        cull(0, viewProj);
+        drawPass(shader, 0);
+
+        buildPyramid();
+        cull(1, viewProj);
+        requestStats();
+        drawPass(shader, objectCount);
+
+        buildPyramid();
+        prevViewProj = viewProj;
+        pyramidValid = true;
+    }
+
+    // Статистика последнего прочитанного кадра (обновляется раз в STATS_INTERVAL)
+    const Stats& stats() const {
+        return lastStats;
+    }
+
+    // Сброс истории, например после телепортации камеры
+    void invalidate() {
+        pyramidValid = false;
+    }
+
+private:
+    Model& model;
+    Shader buildShader;
+    Shader cullShader;
+
+    unsigned int objectCount = 0;
+    unsigned int boundsBuffer = 0, transformBuffer = 0, commandBuffer = 0, statsBuffer = 0;
+    unsigned int readbackBuffer = 0;
+    void* readbackMapped = nullptr;
+    GLsync statsFence = 0;
+    std::chrono::steady_clock::time_point lastStatsRequest;
+    unsigned int depthTexture = 0, pyramidTexture = 0;
+    int pyramidWidth = 0, pyramidHeight = 0, pyramidLevels = 0;
+    bool pyramidValid = false;
+    bool statsPending = false;
+    glm::mat4 prevViewProj = glm::mat4(1.0f);
+    Stats lastStats;
+
+    void resize(int width, int height) {
+        if (width == pyramidWidth && height == pyramidHeight)
+            return;
+
+        if (depthTexture) {
+            glDeleteTextures(1, &depthTexture);
+            glDeleteTextures(1, &pyramidTexture);
+        }
+
+        pyramidWidth = width;
+        pyramidHeight = height;
+        pyramidLevels = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+        pyramidValid = false;
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &pyramidTexture);
+        glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+        glTexStorage2D(GL_TEXTURE_2D, pyramidLevels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Копия счётчиков кадра в буфер чтения, если прошлая уже забрана и интервал истёк
+    void requestStats() {
+        auto now = std::chrono::steady_clock::now();
+        if (statsPending || std::chrono::duration<double>(now - lastStatsRequest).count() < STATS_INTERVAL)
+            return;
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glCopyNamedBufferSubData(statsBuffer, readbackBuffer, 0, 0, sizeof(Stats));
+        statsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        statsPending = true;
+        lastStatsRequest = now;
+    }
+
+    // Забор не ждётся: пока копия не готова, остаётся прошлая статистика
+    void readStats() {
+        if (!statsPending)
+            return;
+        GLenum result = glClientWaitSync(statsFence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+            return;
+        if (result != GL_WAIT_FAILED)
+            std::memcpy(&lastStats, readbackMapped, sizeof(Stats));
+        glDeleteSync(statsFence);
+        statsFence = 0;
+        statsPending = false;
+    }
+
+    void cull(int phase, const glm::mat4& viewProj) {
+        cullShader.use();
+        cullShader.setMat4("viewProj", viewProj);
+        cullShader.setMat4("prevViewProj", prevViewProj);
+        cullShader.setUint("objectCount", objectCount);
+        cullShader.setInt("phase", phase);
+        cullShader.setBool("hiZValid", pyramidValid);
+        cullShader.setVec2("hiZSize", glm::vec2(pyramidWidth, pyramidHeight));
+        cullShader.setInt("hiZLevels", pyramidLevels);
+        cullShader.setInt("hiZ", 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, transformBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, statsBuffer);
+
+        glDispatchCompute((objectCount + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    void drawPass(Shader& shader, unsigned int firstCommand) {
+        shader.use();
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        model.DrawIndirect(shader, firstCommand);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void buildPyramid() {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, pyramidWidth, pyramidHeight);
+
+        buildShader.use();
+        buildShader.setInt("depthTexture", 0);
+
+        for (int level = 0; level < pyramidLevels; ++level) {
+            int w = std::max(pyramidWidth >> level, 1);
+            int h = std::max(pyramidHeight >> level, 1);
+
+            buildShader.setInt("level", level);
+            glBindImageTexture(0, pyramidTexture, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+
+#endif // HIZ_CULLING_H
@@ -0,0 +1,325 @@
+#ifndef IMAGE_BASED_LIGHTING_H
+#define IMAGE_BASED_LIGHTING_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "GpuTimer.h"
+
+// Освещение окружением для варианта IBL основного шейдера: облучённость в сферических гармониках
+// (ibl_sh.glsl), предфильтрованная зеркальная кубическая карта с уровнем mip на шероховатость
+// (ibl_specular.glsl) и таблица BRDF для разделённой суммы (ibl_brdf.glsl) считаются на GPU.
+// Результат сохраняется в файл ibl_<хэш>.cache по хэшу содержимого окружения и параметров расчёта;
+// при повторном запуске он загружается в текстуры без вычислительных проходов.
+// Окружение - Radiance .hdr в равнопромежуточной развёртке или процедурный цех.
+class ImageBasedLighting {
+public:
+    static const int SPECULAR_SIZE = 128;
+    static const int SPECULAR_LEVELS = 6;   // шероховатость уровня: level / (SPECULAR_LEVELS - 1)
+    static const int SPECULAR_SAMPLES = 256;
+    static const int BRDF_SIZE = 128;
+    static const int BRDF_SAMPLES = 512;
+    static const int SPECULAR_UNIT = 6;     // текстурные блоки в основном шейдере
+    static const int BRDF_UNIT = 7;
+    static const int SH_BINDING = 14;       // layout(binding = ...) в ibl_sh.glsl
+
+    struct Stats {
+        std::string source;
+        std::string cachePath;
+        bool cacheHit = false;
+        double computeMs = 0.0;     // расчёт на GPU (0 при загрузке из кэша)
+        double startupMs = 0.0;     // всё время конструктора на процессоре
+    };
+
+    float intensity = 1.0f;
+
+    // path - файл .hdr; пустой или нечитаемый - процедурное окружение
+    ImageBasedLighting(const std::string& path = "") {
+        auto start = std::chrono::high_resolution_clock::now();
+        int width = 0, height = 0;
+        std::vector<float> pixels;
+        if (!path.empty() && loadHdr(path, width, height, pixels))
+            stats.source = path;
+        else {
+            if (!path.empty())
+                std::cerr << "ERROR::IBL::HDR_NOT_LOADED: " << path << std::endl;
+            workshopEnvironment(width, height, pixels);
+            stats.source = "procedural workshop";
+        }
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "ibl_%016llx.cache", (unsigned long long)contentHash(width, height, pixels));
+        stats.cachePath = name;
+
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &specular);
+        glTextureStorage2D(specular, SPECULAR_LEVELS, GL_RGBA16F, SPECULAR_SIZE, SPECULAR_SIZE);
+        glTextureParameteri(specular, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(specular, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glCreateTextures(GL_TEXTURE_2D, 1, &brdf);
+        glTextureStorage2D(brdf, 1, GL_RG16F, BRDF_SIZE, BRDF_SIZE);
+        glTextureParameteri(brdf, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(brdf, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(brdf, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(brdf, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        stats.cacheHit = loadCache();
+        if (!stats.cacheHit) {
+            precompute(width, height, pixels);
+            saveCache();
+        }
+        stats.startupMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // Параметры и текстуры для программы, собранной с #define IBL
+    void Bind(Shader& shader) const {
+        shader.use();
+        glUniform3fv(glGetUniformLocation(shader.ID, "iblSh"), 9, &sh[0].x);
+        shader.setInt("iblSpecular", SPECULAR_UNIT);
+        shader.setInt("iblBrdf", BRDF_UNIT);
+        shader.setFloat("iblSpecularLevels", (float)SPECULAR_LEVELS);
+        shader.setFloat("iblIntensity", intensity);
+        glBindTextureUnit(SPECULAR_UNIT, specular);
+        glBindTextureUnit(BRDF_UNIT, brdf);
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    static const uint32_t CACHE_MAGIC = 0x314C4249;   // "IBL1"
+
+    unsigned int specular = 0, brdf = 0;
+    glm::vec3 sh[9] = {};
+    Stats stats;
+
+    // Хэш окружения вместе с параметрами расчёта: их изменение тоже делает кэш недействительным
+    static uint64_t contentHash(int width, int height, const std::vector<float>& pixels) {
+        const int parameters[] = { width, height, SPECULAR_SIZE, SPECULAR_LEVELS, SPECULAR_SAMPLES, BRDF_SIZE, BRDF_SAMPLES };
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&](const void* data, size_t size) {
+            const unsigned char* bytes = (const unsigned char*)data;
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+        };
+        add(parameters, sizeof(parameters));
+        add(pixels.data(), pixels.size() * sizeof(float));
+        return hash;
+    }
+
+    void precompute(int width, int height, const std::vector<float>& pixels) {
+        unsigned int environment = 0, shBuffer = 0;
+        int levels = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+        glCreateTextures(GL_TEXTURE_2D, 1, &environment);
+        glTextureStorage2D(environment, levels, GL_RGBA16F, width, height);
+        glTextureSubImage2D(environment, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, pixels.data());
+        glTextureParameteri(environment, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(environment, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(environment, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(environment, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glCreateBuffers(1, &shBuffer);
+        glNamedBufferStorage(shBuffer, 9 * sizeof(glm::vec4), NULL, 0);
+
+        Shader shShader("ibl_sh.glsl");
+        Shader specularShader("ibl_specular.glsl");
+        Shader brdfShader("ibl_brdf.glsl");
+
+        GpuTimer timer;
+        timer.Begin();
+        glGenerateTextureMipmap(environment);
+        glBindTextureUnit(0, environment);
+
+        shShader.use();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SH_BINDING, shBuffer);
+        glDispatchCompute(1, 1, 1);
+
+        specularShader.use();
+        specularShader.setInt("sampleCount", SPECULAR_SAMPLES);
+        for (int level = 0; level < SPECULAR_LEVELS; ++level) {
+            int size = SPECULAR_SIZE >> level;
+            specularShader.setInt("faceSize", size);
+            specularShader.setFloat("roughness", (float)level / (SPECULAR_LEVELS - 1));
+            glBindImageTexture(0, specular, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            glDispatchCompute((size + 7) / 8, (size + 7) / 8, 6);
+        }
+
+        brdfShader.use();
+        brdfShader.setInt("lutSize", BRDF_SIZE);
+        brdfShader.setInt("sampleCount", BRDF_SAMPLES);
+        glBindImageTexture(0, brdf, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+        glDispatchCompute((BRDF_SIZE + 7) / 8, (BRDF_SIZE + 7) / 8, 1);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        timer.End();
+
+        glm::vec4 coefficients[9];
+        glGetNamedBufferSubData(shBuffer, 0, sizeof(coefficients), coefficients);
+        for (int i = 0; i < 9; ++i)
+            sh[i] = glm::vec3(coefficients[i]);
+        timer.Finish();
+        stats.computeMs = timer.LastMs();
+
+        glBindTextureUnit(0, 0);
+        glDeleteBuffers(1, &shBuffer);
+        glDeleteTextures(1, &environment);
+    }
+
+    static size_t specularLevelHalves(int level) {
+        size_t size = SPECULAR_SIZE >> level;
+        return size * size * 6 * 4;
+    }
+
+    // Файл: CACHE_MAGIC, 27 float гармоник, уровни зеркальной карты (RGBA half, все грани), таблица BRDF (RG half)
+    bool loadCache() {
+        std::ifstream file(stats.cachePath, std::ios::binary);
+        if (!file)
+            return false;
+        uint32_t magic = 0;
+        file.read((char*)&magic, sizeof(magic));
+        file.read((char*)sh, sizeof(sh));
+        std::vector<std::vector<uint16_t>> levels(SPECULAR_LEVELS);
+        for (int level = 0; level < SPECULAR_LEVELS; ++level) {
+            levels[level].resize(specularLevelHalves(level));
+            file.read((char*)levels[level].data(), levels[level].size() * sizeof(uint16_t));
+        }
+        std::vector<uint16_t> lut((size_t)BRDF_SIZE * BRDF_SIZE * 2);
+        file.read((char*)lut.data(), lut.size() * sizeof(uint16_t));
+        if (!file || magic != CACHE_MAGIC) {
+            std::cerr << "ERROR::IBL::CACHE_INVALID: " << stats.cachePath << std::endl;
+            return false;
+        }
+
+        for (int level = 0; level < SPECULAR_LEVELS; ++level) {
+            int size = SPECULAR_SIZE >> level;
+            glTextureSubImage3D(specular, level, 0, 0, 0, size, size, 6, GL_RGBA, GL_HALF_FLOAT, levels[level].data());
+        }
+        glTextureSubImage2D(brdf, 0, 0, 0, BRDF_SIZE, BRDF_SIZE, GL_RG, GL_HALF_FLOAT, lut.data());
+        return true;
+    }
+
+    void saveCache() {
+        std::ofstream file(stats.cachePath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "ERROR::IBL::CACHE_NOT_WRITTEN: " << stats.cachePath << std::endl;
+            return;
+        }
+        uint32_t magic = CACHE_MAGIC;
+        file.write((const char*)&magic, sizeof(magic));
+        file.write((const char*)sh, sizeof(sh));
+        for (int level = 0; level < SPECULAR_LEVELS; ++level) {
+            std::vector<uint16_t> data(specularLevelHalves(level));
+            glGetTextureImage(specular, level, GL_RGBA, GL_HALF_FLOAT, (GLsizei)(data.size() * sizeof(uint16_t)), data.data());
+            file.write((const char*)data.data(), data.size() * sizeof(uint16_t));
+        }
+        std::vector<uint16_t> lut((size_t)BRDF_SIZE * BRDF_SIZE * 2);
+        glGetTextureImage(brdf, 0, GL_RG, GL_HALF_FLOAT, (GLsizei)(lut.size() * sizeof(uint16_t)), lut.data());
+        file.write((const char*)lut.data(), lut.size() * sizeof(uint16_t));
+    }
+
+    // Radiance RGBE: заголовок, строка "-Y высота +X ширина", строки развёртки с RLE по компонентам
+    // или без сжатия (старое RLE не поддерживается). pixels - RGBA float сверху вниз
+    static bool loadHdr(const std::string& path, int& width, int& height, std::vector<float>& pixels) {
+        std::ifstream file(path, std::ios::binary);
+        std::string line;
+        if (!file || !std::getline(file, line) || line.compare(0, 2, "#?") != 0)
+            return false;
+        while (std::getline(file, line) && !line.empty()) {
+        }
+        char yAxis[3] = {}, xAxis[3] = {};
+        if (!std::getline(file, line) || std::sscanf(line.c_str(), "%2s %d %2s %d", yAxis, &height, xAxis, &width) != 4 ||
+            std::string(yAxis) != "-Y" || std::string(xAxis) != "+X" || width <= 0 || height <= 0)
+            return false;
+
+        pixels.resize((size_t)width * height * 4);
+        std::vector<unsigned char> scanline((size_t)width * 4);
+        for (int y = 0; y < height; ++y) {
+            unsigned char header[4];
+            file.read((char*)header, 4);
+            if (width >= 8 && width < 32768 && header[0] == 2 && header[1] == 2 && ((header[2] << 8) | header[3]) == width) {
+                for (int c = 0; c < 4; ++c) {
+                    for (int x = 0; x < width;) {
+                        int count = file.get();
+                        if (count > 128) {
+                            count -= 128;
+                            int value = file.get();
+                            if (!file || x + count > width)
+                                return false;
+                            for (int i = 0; i < count; ++i)
+                                scanline[(x++) * 4 + c] = (unsigned char)value;
+                        }
+                        else {
+                            if (!file || count == 0 || x + count > width)
+                                return false;
+                            for (int i = 0; i < count; ++i)
+                                scanline[(x++) * 4 + c] = (unsigned char)file.get();
+                        }
+                    }
+                }
+            }
+            else {
+                std::copy(header, header + 4, scanline.begin());
+                file.read((char*)scanline.data() + 4, (std::streamsize)(width - 1) * 4);
+            }
+            if (!file)
+                return false;
+
+            for (int x = 0; x < width; ++x) {
+                const unsigned char* rgbe = &scanline[(size_t)x * 4];
+                float scale = rgbe[3] ? std::ldexp(1.0f, rgbe[3] - 136) : 0.0f;
+                float* pixel = &pixels[((size_t)y * width + x) * 4];
+                pixel[0] = rgbe[0] * scale;
+                pixel[1] = rgbe[1] * scale;
+                pixel[2] = rgbe[2] * scale;
+                pixel[3] = 1.0f;
+            }
+        }
+        return true;
+    }
+
+    // Цех без файла окружения: бетонный пол, стены с полосой окон и потолок с рядами ламп
+    static void workshopEnvironment(int& width, int& height, std::vector<float>& pixels) {
+        const float PI = 3.14159265f;
+        width = 512;
+        height = 256;
+        pixels.resize((size_t)width * height * 4);
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x) {
+                float theta = (y + 0.5f) / height * PI;
+                float phi = ((x + 0.5f) / width - 0.5f) * 2.0f * PI;
+                glm::vec3 d(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+                glm::vec3 color;
+                if (d.y < 0.0f)
+                    color = glm::vec3(0.25f, 0.24f, 0.22f) * (0.6f - 0.4f * d.y);
+                else if (d.y < 0.35f) {
+                    color = glm::mix(glm::vec3(0.35f, 0.33f, 0.3f), glm::vec3(0.45f, 0.45f, 0.5f), d.y / 0.35f);
+                    if (d.y > 0.1f && d.y < 0.3f && std::fmod(phi / PI * 4.0f + 8.0f, 1.0f) < 0.5f)
+                        color = glm::vec3(1.6f, 1.7f, 1.9f);
+                }
+                else {
+                    // Лампы - полосы на плоскости потолка вдоль оси z
+                    glm::vec2 p(d.x / d.y, d.z / d.y);
+                    color = glm::vec3(0.12f);
+                    if (std::fmod(std::abs(p.x) * 0.5f, 1.0f) < 0.06f && std::abs(p.y) < 4.0f)
+                        color = glm::vec3(9.0f, 8.8f, 8.2f);
+                }
+                float* pixel = &pixels[((size_t)y * width + x) * 4];
+                pixel[0] = color.r;
+                pixel[1] = color.g;
+                pixel[2] = color.b;
+                pixel[3] = 1.0f;
+            }
+    }
+};
+
+#endif // IMAGE_BASED_LIGHTING_H
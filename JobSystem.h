@@ -0,0 +1,329 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// Планировщик задач с перехватом работы (work stealing).
+// У каждого потока своя очередь: владелец берёт задачи с конца, остальные крадут с начала.
+// Задача может ждать завершения других (зависимости); ожидание в Wait не простаивает,
+// а выполняет чужие задачи. Задачи с GL-вызовами ставятся в отдельную очередь основного
+// потока и выполняются только в RunMainThreadJobs или в Wait на основном потоке.
+// Простаивающие рабочие потоки спят без тайм-аута: их будит постановка задачи в очередь,
+// а поток, забравший задачу из непустой очереди, будит следующего.
+class JobSystem {
+public:
+    struct Job {
+        std::function<void()> function;
+        std::atomic<int> pending{ 1 };    // незавершённые зависимости + 1 на время постановки
+        std::atomic<bool> done{ false };
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Job>> continuations;
+        bool mainThread = false;
+    };
+    using JobHandle = std::shared_ptr<Job>;
+
+    // workerCount < 0 - по числу ядер минус основной поток
+    explicit JobSystem(int workerCount = -1) {
+        if (workerCount < 0)
+            workerCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+        for (int i = 0; i <= workerCount; ++i)
+            queues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+        mainThreadId.store(std::this_thread::get_id());
+        for (int i = 1; i <= workerCount; ++i)
+            workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    unsigned int WorkerCount() const {
+        return (unsigned int)workers.size();
+    }
+
+    JobHandle Schedule(std::function<void()> function, const std::vector<JobHandle>& dependencies = {}) {
+        return schedule(std::move(function), dependencies, false);
+    }
+
+    // Задача для потока с GL-контекстом
+    JobHandle ScheduleOnMainThread(std::function<void()> function, const std::vector<JobHandle>& dependencies = {}) {
+        return schedule(std::move(function), dependencies, true);
+    }
+
+    // Ожидание с выполнением других задач
+    void Wait(const JobHandle& job) {
+        int index = currentIndex();
+        while (!job->done.load(std::memory_order_acquire)) {
+            if (!tryRunOne(index))
+                std::this_thread::yield();
+        }
+    }
+
+    void WaitAll(const std::vector<JobHandle>& jobs) {
+        for (const JobHandle& job : jobs)
+            Wait(job);
+    }
+
+    // Разбиение [0, count) на отрезки по grain элементов; результат - задача, завершающаяся после всех отрезков
+    JobHandle ParallelForAsync(size_t count, size_t grain, std::function<void(size_t, size_t)> body,
+        const std::vector<JobHandle>& dependencies = {}) {
+        grain = std::max<size_t>(grain, 1);
+        auto shared = std::make_shared<std::function<void(size_t, size_t)>>(std::move(body));
+        std::vector<JobHandle> chunks;
+        for (size_t begin = 0; begin < count; begin += grain) {
+            size_t end = std::min(count, begin + grain);
+            chunks.push_back(Schedule([shared, begin, end]() { (*shared)(begin, end); }, dependencies));
+        }
+        return Schedule([]() {}, chunks);
+    }
+
+    void ParallelFor(size_t count, size_t grain, std::function<void(size_t, size_t)> body) {
+        if (count <= grain) {
+            body(0, count);
+            return;
+        }
+        Wait(ParallelForAsync(count, grain, std::move(body)));
+    }
+
+    // Передача роли основного потока (с GL-контекстом) вызывающему потоку
+    void BindMainThread() {
+        mainThreadId.store(std::this_thread::get_id());
+    }
+
+    // Выполнение накопившихся GL-задач; вызывается основным потоком раз в кадр
+    void RunMainThreadJobs() {
+        JobHandle job;
+        while ((job = popMainThread()))
+            execute(job);
+    }
+
+    // Накладные расходы на задачу и масштабирование ParallelFor по числу потоков
+    static void RunBenchmarks() {
+        typedef std::chrono::high_resolution_clock Clock;
+        {
+            JobSystem jobs;
+            const int count = 100000;
+            auto start = Clock::now();
+            std::vector<JobHandle> handles;
+            handles.reserve(count);
+            for (int i = 0; i < count; ++i)
+                handles.push_back(jobs.Schedule([]() {}));
+            jobs.WaitAll(handles);
+            double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+
+            start = Clock::now();
+            JobHandle root = jobs.Schedule([]() {});
+            for (int i = 0; i < 1000; ++i)
+                root = jobs.Schedule([]() {}, { root });
+            jobs.Wait(root);
+            double chainNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / 1001;
+
+            std::cout << "Jobs: " << jobs.WorkerCount() << " workers, schedule+run " << ns
+                << " ns/job, dependent chain " << chainNs << " ns/job" << std::endl;
+        }
+
+        const size_t elements = 1 << 22;
+        std::vector<float> data(elements);
+        auto work = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                float x = (float)i;
+                for (int k = 0; k < 16; ++k)
+                    x = std::sqrt(x + 1.0f) * 1.0001f;
+                data[i] = x;
+            }
+        };
+
+        double baseline = 0.0;
+        unsigned int maxWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int workers = 0;; workers = workers ? workers * 2 + 1 : 1) {
+            workers = std::min(workers, maxWorkers);
+            JobSystem jobs((int)workers);
+            auto start = Clock::now();
+            jobs.ParallelFor(elements, 16384, work);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            if (workers == 0)
+                baseline = ms;
+            std::cout << "Jobs: ParallelFor on " << workers + 1 << " threads: " << ms << " ms, speedup "
+                << baseline / ms << "x" << std::endl;
+            if (workers >= maxWorkers)
+                break;
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    struct ThreadInfo {
+        const JobSystem* owner;
+        int index;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // 0 - основной поток
+    Queue mainThreadQueue;
+    std::vector<std::thread> workers;
+    std::atomic<std::thread::id> mainThreadId;
+    std::atomic<int> queuedJobs{ 0 };
+    bool running = true;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    static ThreadInfo& currentThread() {
+        thread_local ThreadInfo info = { nullptr, -1 };
+        return info;
+    }
+
+    // Индекс очереди текущего потока: 0 - создавший систему поток, -1 - посторонние потоки
+    int currentIndex() const {
+        if (std::this_thread::get_id() == mainThreadId.load(std::memory_order_relaxed))
+            return 0;
+        const ThreadInfo& info = currentThread();
+        return info.owner == this ? info.index : -1;
+    }
+
+    JobHandle schedule(std::function<void()> function, const std::vector<JobHandle>& dependencies, bool mainThread) {
+        JobHandle job = std::make_shared<Job>();
+        job->function = std::move(function);
+        job->mainThread = mainThread;
+
+        for (const JobHandle& dependency : dependencies) {
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            if (dependency->done.load(std::memory_order_acquire))
+                continue;
+            job->pending.fetch_add(1, std::memory_order_relaxed);
+            dependency->continuations.push_back(job);
+        }
+
+        if (job->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            submit(job);
+        return job;
+    }
+
+    void submit(const JobHandle& job) {
+        if (job->mainThread) {
+            std::lock_guard<std::mutex> lock(mainThreadQueue.mutex);
+            mainThreadQueue.jobs.push_back(job);
+            return;
+        }
+
+        int index = std::max(currentIndex(), 0);
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->jobs.push_back(job);
+        }
+        // Счётчик меняется под sleepMutex, иначе оповещение может прийти между проверкой
+        // условия и засыпанием рабочего потока и потеряться
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queuedJobs.fetch_add(1, std::memory_order_release);
+        }
+        wake.notify_one();
+    }
+
+    void execute(const JobHandle& job) {
+        job->function();
+        job->function = nullptr;
+
+        std::vector<JobHandle> continuations;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->done.store(true, std::memory_order_release);
+            continuations.swap(job->continuations);
+        }
+        for (const JobHandle& continuation : continuations) {
+            if (continuation->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                submit(continuation);
+        }
+    }
+
+    JobHandle popMainThread() {
+        std::lock_guard<std::mutex> lock(mainThreadQueue.mutex);
+        if (mainThreadQueue.jobs.empty())
+            return nullptr;
+        JobHandle job = mainThreadQueue.jobs.front();
+        mainThreadQueue.jobs.pop_front();
+        return job;
+    }
+
+    bool tryRunOne(int index) {
+        if (index == 0) {
+            JobHandle job = popMainThread();
+            if (job) {
+                execute(job);
+                return true;
+            }
+        }
+
+        JobHandle job;
+        if (index >= 0) {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            if (!queues[index]->jobs.empty()) {
+                job = queues[index]->jobs.back();
+                queues[index]->jobs.pop_back();
+            }
+        }
+
+        if (!job) {
+            thread_local std::minstd_rand random((unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id()));
+            size_t start = random() % queues.size();
+            for (size_t k = 0; k < queues.size() && !job; ++k) {
+                size_t victim = (start + k) % queues.size();
+                if ((int)victim == index)
+                    continue;
+                std::lock_guard<std::mutex> lock(queues[victim]->mutex);
+                if (!queues[victim]->jobs.empty()) {
+                    job = queues[victim]->jobs.front();
+                    queues[victim]->jobs.pop_front();
+                }
+            }
+        }
+
+        if (!job)
+            return false;
+        // Оповещение при постановке могло достаться уже занятому потоку: остаток будит спящего
+        if (queuedJobs.fetch_sub(1, std::memory_order_acq_rel) > 1)
+            wake.notify_one();
+        execute(job);
+        return true;
+    }
+
+    void workerLoop(int index) {
+        currentThread() = { this, index };
+        for (;;) {
+            if (tryRunOne(index))
+                continue;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (!running)
+                break;
+            wake.wait(lock, [this]() {
+                return !running || queuedJobs.load(std::memory_order_acquire) > 0;
+            });
+        }
+        currentThread() = { nullptr, -1 };
+    }
+};
+
+#endif // JOB_SYSTEM_H
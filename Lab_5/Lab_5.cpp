@@ -1,10 +1,37 @@
 #include "Shader.h"
 #include "Model.h"
+#include "HiZCulling.h"
+#include "SoftwareOcclusion.h"
+#include "OcclusionQueries.h"
+#include "Bvh.h"
+#include "JobSystem.h"
+#include "TripleBuffer.h"
+#include "StaticLayerCache.h"
+#include "LowLatency.h"
+#include "FramePacer.h"
+#include "ClusteredLights.h"
+#include "DepthPrepass.h"
+#include "ShadowMap.h"
+#include "VisibilityBuffer.h"
+#include "DynamicResolution.h"
+#include "RenderGraph.h"
+#include "VertexPulling.h"
+#include "MultiView.h"
+#include "CubeShadowMap.h"
+#include "AmbientOcclusion.h"
+#include "AmbientOcclusionBaker.h"
+#include "ImageBasedLighting.h"
 #include <GLFW/glfw3.h>
 #include <glm.hpp>
 #include <matrix_transform.hpp>
 #include <type_ptr.hpp>
+#include <quaternion.hpp>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
 
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
@@ -22,6 +49,103 @@ float pitch = 0.0f;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// Отсечение перекрытых мешей (клавиша C переключает режим)
+enum CullingMode { CULLING_OFF, CULLING_HIZ, CULLING_SOFTWARE };
+CullingMode cullingMode = CULLING_HIZ;
+bool occlusionQueriesEnabled = false; // клавиша Q
+bool staticLayerCacheEnabled = true;  // клавиша L
+// Предварительный проход по глубине (--depth-prepass, клавиша P переключает режим)
+DepthPrepass::Mode depthPrepassMode = DepthPrepass::PREPASS_OFF;
+// Тени: кэш статической карты (--no-shadow-cache, клавиша T), фильтрация PCF (--hard-shadows отключает)
+bool shadowCacheEnabled = true;
+bool softShadows = true;
+// Буфер видимости вместо прямого затенения (--visibility-buffer, клавиша B)
+bool visibilityBufferEnabled = false;
+// Динамическое разрешение (--dynamic-resolution [бюджет GPU, мс], клавиша G);
+// без явного бюджета - период кадра по текущему темпу вывода
+bool dynamicResolutionEnabled = false;
+double resolutionBudgetMs = 0.0;
+// Программная выборка вершин одним вызовом на сцену (--vertex-pulling, клавиша X)
+bool vertexPullingEnabled = false;
+// Всенаправленные тени ключевого источника в кубической карте (--cube-shadows, клавиша O)
+bool cubeShadowsEnabled = false;
+// Четыре вида оператора (спереди, сверху, сбоку, перспектива) одной отправкой (--quad-view, клавиша M)
+bool quadViewEnabled = false;
+// Затенение окружения в экранном пространстве (--ao off|low|medium|high, клавиша N переключает уровень)
+AmbientOcclusion::Quality aoQuality = AmbientOcclusion::AO_MEDIUM;
+// Освещение окружением (--ibl [файл.hdr], без файла - процедурный цех): вариант программ с #define IBL
+bool iblEnabled = false;
+std::string iblPath;
+
+// Выбор детали лучом из центра экрана (левая кнопка мыши)
+bool pickRequested = false;
+float lastStatsTime = 0.0f;
+
+// Снимок сцены, который симуляция передаёт потоку отрисовки
+struct SceneSnapshot {
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    glm::vec3 cameraPos = glm::vec3(0.0f);
+    double inputTime = -1.0;   // время последнего события ввода камеры
+    std::vector<glm::mat4> previousTransforms; // состояние на шаг раньше, для интерполяции
+    std::vector<glm::mat4> meshTransforms;
+    double stateTime = 0.0;    // время текущего состояния симуляции
+    double stepSeconds = 0.0;
+    std::vector<char> meshVisible;
+    CullingMode cullingMode = CULLING_HIZ;
+    bool occlusionQueries = false;
+    bool staticLayerCache = true;
+    DepthPrepass::Mode depthPrepass = DepthPrepass::PREPASS_OFF;
+    bool shadowCache = true;
+    bool visibilityBuffer = false;
+    bool dynamicResolution = false;
+    bool vertexPulling = false;
+    bool cubeShadows = false;
+    bool quadView = false;
+    AmbientOcclusion::Quality aoQuality = AmbientOcclusion::AO_MEDIUM;
+    int fbWidth = SCR_WIDTH;
+    int fbHeight = SCR_HEIGHT;
+};
+
+// Симуляция идёт шагами фиксированной длины (--sim-rate <Гц>); при отставании
+// выполняется несколько шагов подряд, но не дальше MAX_SIMULATION_LAG секунд
+double simulationRate = 240.0;
+const double MAX_SIMULATION_LAG = 0.25;
+TripleBuffer<SceneSnapshot> snapshots;
+std::atomic<bool> running{ true };
+std::mutex snapshotMutex;
+std::condition_variable snapshotPublished;
+
+// Отрисовка по требованию (--on-demand [Гц], клавиша R): основной поток спит в glfwWaitEventsTimeout,
+// снимок публикуется только при изменении сцены и ещё SETTLE_FRAMES раз после него
+// (догоняют запросы видимости и Hi-Z), а также раз в 1/refreshRate секунд, если refreshRate > 0.
+// При включённом SSAO публикация продолжается, пока история не сойдётся (aoConverged от потока отрисовки),
+// иначе статический слой так и не будет закэширован
+std::atomic<bool> renderOnDemand{ false };
+std::atomic<bool> sceneDirty{ true };
+std::atomic<bool> aoConverged{ false };
+double refreshRate = 0.0;
+const int SETTLE_FRAMES = 4;
+
+// Режим низкой задержки (--low-latency, клавиша F): один кадр в очереди драйвера,
+// камера перечитывается потоком отрисовки прямо перед отправкой кадра
+struct CameraState {
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 5.0f);
+    glm::vec3 front = glm::vec3(0.0f, 0.0f, -1.0f);
+    double inputTime = -1.0;
+};
+std::atomic<bool> lowLatencyEnabled{ false };
+
+// Темп вывода (--vsync, --adaptive-vsync, --target-fps <Гц>, --no-vsync; клавиша V переключает)
+std::atomic<int> pacingMode{ FramePacer::PACING_VSYNC };
+double targetFps = 60.0;
+std::mutex cameraMutex;
+CameraState latestCamera;
+
+// Время последнего тика симуляции и кадра отрисовки, мс, и счётчики для частоты
+std::atomic<float> simulationTickMs{ 0.0f }, renderFrameMs{ 0.0f };
+std::atomic<unsigned int> simulationTicks{ 0 }, simulationSteps{ 0 }, renderFrames{ 0 };
+
 struct ObjectTransform {
     glm::vec3 position = glm::vec3(0.0f);
 
@@ -43,13 +167,20 @@ struct ObjectTransform {
 };
 
 std::vector<ObjectTransform> objectTransforms;
+glm::vec3 objectInput = glm::vec3(0.0f); // направление движения объектов по клавишам, -1..1 по осям
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void processInput(GLFWwindow* window);
+void publishCamera();
+CameraState readCamera();
+void simulateStep(float dt);
 
-glm::mat4 calculateModelMatrix(int index) {
+glm::mat4 calculateModelMatrix(int index, const std::vector<ObjectTransform>& objectTransforms) {
     glm::mat4 model = glm::mat4(1.0f);
 
     switch (index) {
@@ -73,7 +204,30 @@ glm::mat4 calculateModelMatrix(int index) {
     return model;
 }
 
-int main() {
+// Поворот интерполируется сферически, перенос - линейно (масштаб в сцене не используется)
+glm::mat4 interpolateTransform(const glm::mat4& a, const glm::mat4& b, float t) {
+    glm::quat rotation = glm::slerp(glm::quat_cast(glm::mat3(a)), glm::quat_cast(glm::mat3(b)), t);
+    glm::mat4 result = glm::mat4_cast(rotation);
+    result[3] = glm::mix(a[3], b[3], t);
+    return result;
+}
+
+// Виды оператора в порядке областей вывода: спереди, сверху, сбоку (ортографические по границам сцены)
+// и перспектива камеры; aspect - отношение сторон одной области
+std::vector<glm::mat4> quadViewProjections(const glm::vec3& sceneMin, const glm::vec3& sceneMax, float aspect,
+    const glm::mat4& perspective) {
+    glm::vec3 center = (sceneMin + sceneMax) * 0.5f;
+    float extent = std::max(glm::length(sceneMax - sceneMin) * 0.5f, 0.01f);
+    glm::mat4 ortho = glm::ortho(-extent * aspect, extent * aspect, -extent, extent, extent * 0.01f, extent * 4.0f);
+    return {
+        ortho * glm::lookAt(center + glm::vec3(0.0f, 0.0f, 2.0f * extent), center, glm::vec3(0.0f, 1.0f, 0.0f)),
+        ortho * glm::lookAt(center + glm::vec3(0.0f, 2.0f * extent, 0.0f), center, glm::vec3(0.0f, 0.0f, -1.0f)),
+        ortho * glm::lookAt(center + glm::vec3(2.0f * extent, 0.0f, 0.0f), center, glm::vec3(0.0f, 1.0f, 0.0f)),
+        perspective
+    };
+}
+
+int main(int argc, char** argv) {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
@@ -87,8 +241,11 @@ int main() {
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     glewExperimental = GL_TRUE;
@@ -99,54 +256,1129 @@ int main() {
 
     glEnable(GL_DEPTH_TEST);
 
-    Shader shader("vertex_sheder.glsl", "fragment_shader.glsl");
-    Model ourModel("xlience.obj");
+    // --bench-jobs: накладные расходы планировщика и масштабирование по ядрам
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--bench-jobs")
+            JobSystem::RunBenchmarks();
+    }
+
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--sim-rate")
+            simulationRate = std::max(1.0, std::atof(argv[i + 1]));
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--on-demand")
+            continue;
+        renderOnDemand = true;
+        if (i + 1 < argc && std::atof(argv[i + 1]) > 0.0)
+            refreshRate = std::atof(argv[i + 1]);
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--low-latency")
+            lowLatencyEnabled = true;
+        if (std::string(argv[i]) == "--depth-prepass")
+            depthPrepassMode = DepthPrepass::PREPASS_EQUAL;
+        if (std::string(argv[i]) == "--no-shadow-cache")
+            shadowCacheEnabled = false;
+        if (std::string(argv[i]) == "--hard-shadows")
+            softShadows = false;
+        if (std::string(argv[i]) == "--visibility-buffer")
+            visibilityBufferEnabled = true;
+        if (std::string(argv[i]) == "--vertex-pulling")
+            vertexPullingEnabled = true;
+        if (std::string(argv[i]) == "--cube-shadows")
+            cubeShadowsEnabled = true;
+        if (std::string(argv[i]) == "--quad-view")
+            quadViewEnabled = true;
+        if (std::string(argv[i]) == "--ibl") {
+            iblEnabled = true;
+            std::string next = i + 1 < argc ? argv[i + 1] : "";
+            if (next.size() > 4 && next.substr(next.size() - 4) == ".hdr")
+                iblPath = next;
+        }
+        if (std::string(argv[i]) == "--ao" && i + 1 < argc) {
+            for (int q = 0; q < AmbientOcclusion::QUALITY_COUNT; ++q)
+                if (std::string(argv[i + 1]) == AmbientOcclusion::TierOf((AmbientOcclusion::Quality)q).name)
+                    aoQuality = (AmbientOcclusion::Quality)q;
+        }
+        if (std::string(argv[i]) == "--dynamic-resolution") {
+            dynamicResolutionEnabled = true;
+            if (i + 1 < argc && std::atof(argv[i + 1]) > 0.0)
+                resolutionBudgetMs = std::atof(argv[i + 1]);
+        }
+        if (std::string(argv[i]) == "--vsync")
+            pacingMode = FramePacer::PACING_VSYNC;
+        if (std::string(argv[i]) == "--adaptive-vsync")
+            pacingMode = FramePacer::PACING_ADAPTIVE;
+        if (std::string(argv[i]) == "--no-vsync")
+            pacingMode = FramePacer::PACING_OFF;
+        if (std::string(argv[i]) == "--target-fps" && i + 1 < argc) {
+            pacingMode = FramePacer::PACING_TARGET;
+            targetFps = std::max(1.0, std::atof(argv[i + 1]));
+        }
+    }
+    size_t pointLightCount = 32;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--lights")
+            pointLightCount = (size_t)std::max(0, std::min(std::atoi(argv[i + 1]), 4096));
+    }
+    const GLFWvidmode* videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    double displayRate = videoMode ? videoMode->refreshRate : 60.0;
+
+    JobSystem jobs;
+    std::string shaderDefines = softShadows ? "#define SHADOW_PCF\n" : "";
+    if (iblEnabled)
+        shaderDefines += "#define IBL\n";
+    Shader shader("vertex_sheder.glsl", "fragment_shader.glsl", shaderDefines);
+    Model ourModel("xlience.obj", &jobs);
+    HiZCulling hiZ(ourModel);
+    SoftwareOcclusion softwareOcclusion(ourModel, jobs);
+    OcclusionQueries occlusionQueries(ourModel);
+    SceneBvh sceneBvh(ourModel);
+
+    // Подвижны только меши 1-3 (см. calculateModelMatrix); остальные кэшируются статическим слоем
+    for (size_t i = 0; i < ourModel.meshes.size(); ++i)
+        ourModel.meshStatic[i] = i == 0 || i > 3;
+    StaticLayerCache staticLayer(ourModel);
+    DepthPrepass depthPrepass(ourModel);
+    staticLayer.SetPrepass(&depthPrepass);
+    const glm::vec3 keyLightPosition(1.2f, 1.0f, 2.0f);
+    ShadowMap shadowMap(ourModel);
+    shadowMap.SetLight(keyLightPosition);
+    VisibilityBuffer visibilityBuffer(ourModel, shaderDefines);
+    Shader& resolveShader = visibilityBuffer.ResolveShader();
+    VertexPulling vertexPulling(ourModel, shaderDefines);
+    Shader& pullingShader = vertexPulling.GetShader();
+    CubeShadowMap cubeShadow(ourModel);
+    cubeShadow.SetLight(keyLightPosition);
+    MultiView quadView(ourModel);
+    Shader quadShader("multiview_vertex.glsl", "fragment_shader.glsl", shaderDefines);
+    DynamicResolution dynamicResolution(resolutionBudgetMs > 0.0 ? resolutionBudgetMs : 1000.0 / displayRate);
+
+    // --bench-rays: пропускная способность BVH на модели и на сетке из 16x16 её копий
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-rays")
+            continue;
+        SceneBvh::Benchmark(sceneBvh, "xlience.obj");
+
+        SceneBvh stress = sceneBvh;
+        glm::vec3 size = ourModel.meshes.empty() ? glm::vec3(1.0f) :
+            (stress.instances[0].boundsMax - stress.instances[0].boundsMin) * 1.5f + glm::vec3(1.0f);
+        for (int x = 0; x < 16; ++x)
+            for (int z = 0; z < 16; ++z)
+                if (x || z)
+                    for (size_t m = 0; m < ourModel.meshes.size(); ++m)
+                        stress.AddInstance((int)m, glm::translate(glm::mat4(1.0f), glm::vec3(x * size.x, 0.0f, z * size.z)) *
+                            ourModel.WorldTransform(m));
+        stress.Rebuild();
+        SceneBvh::Benchmark(stress, "stress 16x16");
+    }
 
     objectTransforms.resize(4);
     objectTransforms[1].yLimit = { -0.24f, 0.24f };
     objectTransforms[2].xLimit = { -0.81f, 0.35f };
     objectTransforms[3].zLimit = { 0.0f, 0.97f };
 
-    shader.use();
-    shader.setVec3("light.position", glm::vec3(1.2f, 1.0f, 2.0f));
-    shader.setVec3("light.ambient", glm::vec3(1.0f, 0.8f, 0.6f));
-    shader.setVec3("light.diffuse", glm::vec3(1.0f, 0.8f, 0.6f));
-    shader.setVec3("light.specular", glm::vec3(1.0f));
-    shader.setVec3("material.ambient", glm::vec3(0.5f, 0.5f, 0.5f));
-    shader.setVec3("material.diffuse", glm::vec3(1.0f, 1.0f, 0.0f));
-    shader.setVec3("material.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-    shader.setFloat("material.shininess", 32.0f);
+    // Окружение считается на GPU только при первом запуске с ним, дальше берётся из кэша
+    std::unique_ptr<ImageBasedLighting> ibl;
+    if (iblEnabled) {
+        ibl.reset(new ImageBasedLighting(iblPath));
+        const ImageBasedLighting::Stats& stats = ibl->GetStats();
+        std::cout << "IBL: " << stats.source << ", " << (stats.cacheHit ? "loaded from " : "precomputed into ") << stats.cachePath
+            << "; GPU precompute " << stats.computeMs << " ms, startup " << stats.startupMs << " ms" << std::endl;
+    }
 
-    while (!glfwWindowShouldClose(window)) {
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+    // Освещение и материал одинаковы у прямого прохода, разрешения буфера видимости, программной выборки
+    // и четырёх видов
+    for (Shader* program : { &shader, &resolveShader, &pullingShader, &quadShader }) {
+        program->use();
+        program->setVec3("light.position", keyLightPosition);
+        program->setVec3("light.ambient", glm::vec3(1.0f, 0.8f, 0.6f));
+        program->setVec3("light.diffuse", glm::vec3(1.0f, 0.8f, 0.6f));
+        program->setVec3("light.specular", glm::vec3(1.0f));
+        program->setVec3("material.ambient", glm::vec3(0.5f, 0.5f, 0.5f));
+        program->setVec3("material.diffuse", glm::vec3(1.0f, 1.0f, 0.0f));
+        program->setVec3("material.specular", glm::vec3(1.0f, 1.0f, 1.0f));
+        program->setFloat("material.shininess", 32.0f);
+        program->setInt("pointShadowMap", CubeShadowMap::UNIT);
+        program->setInt("ambientOcclusionMap", AmbientOcclusion::UNIT);
+        if (ibl)
+            ibl->Bind(*program);
+    }
 
-        processInput(window);
+    // Точечные источники разбрасываются вокруг модели (--lights N, по умолчанию 32)
+    glm::vec3 sceneMin(-1.0f), sceneMax(1.0f);
+    if (!sceneBvh.instances.empty()) {
+        sceneMin = glm::vec3(FLT_MAX);
+        sceneMax = glm::vec3(-FLT_MAX);
+        for (const SceneBvh::Instance& instance : sceneBvh.instances) {
+            sceneMin = glm::min(sceneMin, instance.boundsMin);
+            sceneMax = glm::max(sceneMax, instance.boundsMax);
+        }
+        glm::vec3 margin = (sceneMax - sceneMin) * 0.25f;
+        sceneMin -= margin;
+        sceneMax += margin;
+    }
+    ClusteredLights clusteredLights;
+    // Радиус выборок - несколько процентов размера модели (без запаса sceneMin/sceneMax)
+    AmbientOcclusion ambientOcclusion(ourModel, glm::length(sceneMax - sceneMin) / 1.5f * 0.03f);
 
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Затенение окружения статических мешей запекается один раз; кэш лежит рядом с моделью
+    float bakeRadius = glm::length(sceneMax - sceneMin) / 1.5f * 0.1f;
+    AmbientOcclusionBaker aoBaker("xlience.obj.ao", bakeRadius);
+    {
+        AmbientOcclusionBaker::Stats stats = aoBaker.Update(ourModel, sceneBvh, jobs);
+        std::cout << "Baked AO: " << stats.baked << " meshes baked (" << stats.vertices << " vertices, " << stats.rays
+            << " rays) in " << stats.bakeMs << " ms on " << stats.threads << " threads, " << stats.cached << "/"
+            << stats.staticMeshes << " static meshes from cache, " << stats.shared << " skipped (shared geometry)" << std::endl;
+    }
 
-        shader.use();
-        shader.setVec3("viewPos", cameraPos);
+    // --bench-lights: время кадра на GPU от 1 до 4096 источников, по кластерам и перебором всех
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-lights")
+            continue;
+        const int BENCH_FRAMES = 30;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        glViewport(0, 0, width, height);
+        GpuTimer frameTimer;
 
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f),
-            (float)SCR_WIDTH / (float)SCR_HEIGHT,
-            0.1f, 100.0f);
+        for (size_t count = 1; count <= 4096; count *= 4) {
+            clusteredLights.SetLights(ClusteredLights::Scatter(count, sceneMin, sceneMax));
+            // Буфер индексов кластеров дорастает до нужного размера до замеров, чтобы оба режима
+            // обрабатывали одни и те же источники
+            clusteredLights.clustered = true;
+            clusteredLights.Update(view, projection, 0.1f, 100.0f);
+            clusteredLights.SettleCapacity();
+            clusteredLights.TakeDroppedIndices();
+            double frameMs[2] = {};
+            for (int mode = 0; mode < 2; ++mode) {
+                clusteredLights.clustered = mode == 0;
+                for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+                    // Замеры GPU не вкладываются, поэтому раскладка меряется отдельно от отрисовки
+                    clusteredLights.Update(view, projection, 0.1f, 100.0f);
+                    clusteredLights.Bind(shader, width, height);
+                    frameTimer.Begin();
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    shader.setVec3("viewPos", cameraPos);
+                    shader.setMat4("projection", projection);
+                    shader.setMat4("view", view);
+                    ourModel.Draw(shader);
+                    frameTimer.End();
+                }
+                glFinish();
+                frameTimer.Finish();
+                frameMs[mode] = frameTimer.TakeAverageMs();
+            }
+            clusteredLights.FinishTimers();
+            clusteredLights.SettleCapacity();
+            std::cout << "Lights " << count << ": clustered " << frameMs[0] << " ms + binning "
+                << clusteredLights.TakeBinningMs() << " ms, brute force " << frameMs[1] << " ms per frame; "
+                << clusteredLights.RequiredIndices() << " cluster indices, " << clusteredLights.TakeDroppedIndices()
+                << " dropped" << std::endl;
+        }
+        clusteredLights.clustered = true;
+    }
+    clusteredLights.SetLights(ClusteredLights::Scatter(pointLightCount, sceneMin, sceneMax));
+
+    // --bench-visibility: прямое затенение против буфера видимости при удалении камеры;
+    // с расстоянием растёт число треугольников на пиксель
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-visibility")
+            continue;
+        const int BENCH_FRAMES = 30;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        glViewport(0, 0, width, height);
+        GpuTimer forwardTimer;
+
+        glm::vec3 center = (sceneMin + sceneMax) * 0.5f;
+        float radius = glm::length(sceneMax - sceneMin) * 0.5f;
+        size_t triangles = 0;
+        for (const Mesh& mesh : ourModel.meshes)
+            triangles += mesh.indices.size() / 3;
+
+        for (float distance = radius * 2.0f; distance <= radius * 64.0f; distance *= 2.0f) {
+            glm::vec3 eye = center + glm::vec3(0.0f, 0.0f, distance);
+            glm::mat4 view = glm::lookAt(eye, center, cameraUp);
+            clusteredLights.Update(view, projection, 0.1f, 100.0f);
+            for (Shader* program : { &shader, &resolveShader }) {
+                clusteredLights.Bind(*program, width, height);
+                program->setVec3("viewPos", eye);
+            }
+
+            for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+                forwardTimer.Begin();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                shader.use();
+                shader.setMat4("projection", projection);
+                shader.setMat4("view", view);
+                ourModel.Draw(shader);
+                forwardTimer.End();
+            }
+            for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                visibilityBuffer.Draw(view, projection, false, width, height);
+            }
+            glFinish();
+            forwardTimer.Finish();
+            visibilityBuffer.FinishTimers();
+            VisibilityBuffer::Stats stats = visibilityBuffer.TakeStats();
+
+            // Площадь ограничивающей сферы на экране
+            float projected = radius / distance / std::tan(glm::radians(22.5f)) * height * 0.5f;
+            double pixels = std::min(3.14159 * projected * projected, (double)width * height);
+            std::cout << "Density " << triangles / std::max(pixels, 1.0) << " triangles/pixel: forward "
+                << forwardTimer.TakeAverageMs() << " ms, visibility buffer " << stats.geometryMs << " + "
+                << stats.resolveMs << " ms" << std::endl;
+        }
+    }
+
+    // --bench-pulling: фиксированная выборка атрибутов (VAO на меш) против программной выборки
+    // одним вызовом, со сжатыми и с полными нормалями
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-pulling")
+            continue;
+        const int BENCH_FRAMES = 200;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        glViewport(0, 0, width, height);
+        VertexPulling fullPulling(ourModel, shaderDefines, false);
+
+        GpuTimer fixedTimer;
+        double fixedCpuMs = 0.0, compactCpuMs = 0.0, fullCpuMs = 0.0;
+        for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            double start = glfwGetTime();
+            fixedTimer.Begin();
+            shader.use();
+            shader.setMat4("projection", projection);
+            shader.setMat4("view", view);
+            ourModel.Draw(shader);
+            fixedTimer.End();
+            fixedCpuMs += (glfwGetTime() - start) * 1000.0;
+        }
+        for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            double start = glfwGetTime();
+            vertexPulling.Draw(view, projection, false);
+            compactCpuMs += (glfwGetTime() - start) * 1000.0;
+        }
+        for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            double start = glfwGetTime();
+            fullPulling.Draw(view, projection, false);
+            fullCpuMs += (glfwGetTime() - start) * 1000.0;
+        }
+        glFinish();
+        fixedTimer.Finish();
+        vertexPulling.FinishTimers();
+        fullPulling.FinishTimers();
+        VertexPulling::Stats compact = vertexPulling.TakeStats();
+        VertexPulling::Stats full = fullPulling.TakeStats();
+        std::cout << "Fixed fetch: GPU " << fixedTimer.TakeAverageMs() << " ms, submit " << fixedCpuMs / BENCH_FRAMES
+            << " ms; " << compact.fixedBytes / 1024 << " KB of vertices" << std::endl;
+        std::cout << "Pulling, compact normals: GPU " << compact.gpuMs << " ms, submit " << compactCpuMs / BENCH_FRAMES
+            << " ms; " << compact.draws << " draws in one call, " << compact.vertexBytes / 1024 << " KB of vertices" << std::endl;
+        std::cout << "Pulling, full normals: GPU " << full.gpuMs << " ms, submit " << fullCpuMs / BENCH_FRAMES
+            << " ms; " << full.vertexBytes / 1024 << " KB of vertices" << std::endl;
+    }
+
+    // --bench-dsa: сцена, повторённая 1000 раз отдельными вызовами; VAO на меш (старая схема
+    // с привязкой для правки) против общего VAO формата, где между вызовами меняются только буферы
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-dsa")
+            continue;
+        const int BENCH_FRAMES = 10;
+        const int COPIES = 1000;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+        glm::mat4 view = glm::lookAt(cameraPos + glm::vec3(0.0f, 20.0f, 40.0f), cameraPos, cameraUp);
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        glViewport(0, 0, width, height);
+
+        std::vector<unsigned int> meshVAOs(ourModel.meshes.size(), 0);
+        for (size_t m = 0; m < ourModel.meshes.size(); ++m) {
+            const Mesh& mesh = ourModel.meshes[m];
+            glGenVertexArrays(1, &meshVAOs[m]);
+            glBindVertexArray(meshVAOs[m]);
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.VertexBuffer());
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.IndexBuffer());
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.OcclusionBuffer());
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 1, GL_UNSIGNED_BYTE, GL_TRUE, 1, (void*)0);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glm::vec3 size = (sceneMax - sceneMin) * 0.5f;
+        std::vector<glm::mat4> copies(COPIES);
+        for (int c = 0; c < COPIES; ++c)
+            copies[c] = glm::translate(glm::mat4(1.0f), glm::vec3((c % 32 - 16) * size.x, 0.0f, -(c / 32) * size.z));
+
+        shader.use();
         shader.setMat4("projection", projection);
         shader.setMat4("view", view);
+        shader.setBool("instanced", false);
+        int modelLocation = glGetUniformLocation(shader.ID, "model");
+        unsigned int sharedVAO = Mesh::FormatVAO(Mesh::FORMAT_VERTEX);
+
+        const char* names[] = { "VAO per mesh", "shared format VAO" };
+        for (int variant = 0; variant < 2; ++variant) {
+            GpuTimer timer;
+            double submitMs = 0.0;
+            for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                double start = glfwGetTime();
+                timer.Begin();
+                if (variant == 1)
+                    glBindVertexArray(sharedVAO);
+                for (const glm::mat4& copy : copies)
+                    for (size_t m = 0; m < ourModel.meshes.size(); ++m) {
+                        const Mesh& mesh = ourModel.meshes[m];
+                        if (variant == 0)
+                            glBindVertexArray(meshVAOs[m]);
+                        else {
+                            glVertexArrayVertexBuffer(sharedVAO, 0, mesh.VertexBuffer(), 0, sizeof(Vertex));
+                            glVertexArrayVertexBuffer(sharedVAO, 1, mesh.OcclusionBuffer(), 0, 1);
+                            glVertexArrayElementBuffer(sharedVAO, mesh.IndexBuffer());
+                        }
+                        glm::mat4 world = copy * ourModel.WorldTransform(m);
+                        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &world[0][0]);
+                        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, 0);
+                    }
+                glBindVertexArray(0);
+                timer.End();
+                submitMs += (glfwGetTime() - start) * 1000.0;
+            }
+            glFinish();
+            timer.Finish();
+            std::cout << "DSA bench, " << names[variant] << ": " << COPIES * ourModel.meshes.size() << " draws, submit "
+                << submitMs / BENCH_FRAMES << " ms, GPU " << timer.TakeAverageMs() << " ms per frame" << std::endl;
+        }
+        glDeleteVertexArrays((GLsizei)meshVAOs.size(), meshVAOs.data());
+    }
+
+    // --bench-layered: шесть граней кубических теней и четыре вида оператора - по отправке на грань (вид)
+    // против одной отправки со слоями (областями вывода)
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-layered")
+            continue;
+        const int BENCH_FRAMES = 100;
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+
+        for (int layered = 0; layered < 2; ++layered) {
+            cubeShadow.layered = layered != 0;
+            double submitMs = 0.0;
+            for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+                cubeShadow.Invalidate();
+                double start = glfwGetTime();
+                cubeShadow.Update(width, height);
+                submitMs += (glfwGetTime() - start) * 1000.0;
+            }
+            glFinish();
+            cubeShadow.FinishTimers();
+            CubeShadowMap::Stats stats = cubeShadow.TakeStats();
+            std::cout << "Cube shadows, " << (layered ? "one layered submission" : "submission per face") << ": "
+                << stats.submission.draws / BENCH_FRAMES << " draws, submit " << submitMs / BENCH_FRAMES << " ms, GPU "
+                << stats.passMs << " ms per frame" << std::endl;
+        }
+        cubeShadow.layered = true;
 
-        for (size_t i = 0; i < ourModel.meshTransforms.size(); ++i) {
-            ourModel.meshTransforms[i] = calculateModelMatrix(i);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        float halfWidth = width * 0.5f, halfHeight = height * 0.5f;
+        std::vector<glm::mat4> views = quadViewProjections(sceneMin, sceneMax, halfWidth / std::max(halfHeight, 1.0f), projection * view);
+        glViewportIndexedf(0, 0.0f, halfHeight, halfWidth, halfHeight);
+        glViewportIndexedf(1, halfWidth, halfHeight, halfWidth, halfHeight);
+        glViewportIndexedf(2, 0.0f, 0.0f, halfWidth, halfHeight);
+        glViewportIndexedf(3, halfWidth, 0.0f, halfWidth, halfHeight);
+        for (int layered = 0; layered < 2; ++layered) {
+            GpuTimer timer;
+            double submitMs = 0.0;
+            for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                double start = glfwGetTime();
+                timer.Begin();
+                if (layered) {
+                    quadView.SetViews(views);
+                    quadView.Draw(quadShader, MultiView::TARGET_VIEWPORTS);
+                }
+                else {
+                    for (int v = 0; v < 4; ++v) {
+                        quadView.SetViews({ views[v] }, { v });
+                        quadView.Draw(quadShader, MultiView::TARGET_VIEWPORTS);
+                    }
+                }
+                timer.End();
+                submitMs += (glfwGetTime() - start) * 1000.0;
+            }
+            glFinish();
+            timer.Finish();
+            MultiView::Stats stats = quadView.TakeStats();
+            std::cout << "Quad view, " << (layered ? "one submission to four viewports" : "submission per viewport") << ": "
+                << stats.draws / BENCH_FRAMES << " draws, submit " << submitMs / BENCH_FRAMES << " ms, GPU "
+                << timer.TakeAverageMs() << " ms per frame" << std::endl;
         }
+        glViewport(0, 0, width, height);
+    }
+
+    // --bench-ao: время затенения окружения на GPU (все стадии) по уровням качества в разрешении окна
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-ao")
+            continue;
+        const int BENCH_FRAMES = 100;
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+
+        unsigned int depth = 0, output = 0, framebuffer = 0;
+        glCreateTextures(GL_TEXTURE_2D, 1, &depth);
+        glTextureStorage2D(depth, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glCreateTextures(GL_TEXTURE_2D, 1, &output);
+        glTextureStorage2D(output, 1, GL_R8, width, height);
+        glCreateFramebuffers(1, &framebuffer);
+        glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, depth, 0);
+        glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        for (int q = 1; q < AmbientOcclusion::QUALITY_COUNT; ++q) {
+            ambientOcclusion.SetQuality((AmbientOcclusion::Quality)q);
+            unsigned int raw = 0;
+            glCreateTextures(GL_TEXTURE_2D, 1, &raw);
+            glTextureStorage2D(raw, 1, GL_RG16F, ambientOcclusion.LowWidth(width), ambientOcclusion.LowHeight(height));
+            for (int frame = 0; frame < BENCH_FRAMES; ++frame) {
+                ambientOcclusion.BeginFrame(view, projection, false, width, height);
+                ambientOcclusion.DrawDepth();
+                ambientOcclusion.Compute(depth, width, height, raw);
+                ambientOcclusion.Accumulate(raw);
+                ambientOcclusion.Upsample(depth, width, height, output);
+            }
+            glFinish();
+            ambientOcclusion.FinishTimers();
+            AmbientOcclusion::Stats stats = ambientOcclusion.TakeStats();
+            const AmbientOcclusion::Tier& tier = AmbientOcclusion::TierOf((AmbientOcclusion::Quality)q);
+            std::cout << "Ambient occlusion, " << tier.name << ": " << stats.width << "x" << stats.height << ", "
+                << tier.samples << " samples, GPU " << stats.tierMs[q] << " ms per frame" << std::endl;
+            glDeleteTextures(1, &raw);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &output);
+        glDeleteTextures(1, &depth);
+        ambientOcclusion.SetQuality(aoQuality);
+        glViewport(0, 0, width, height);
+    }
 
-        ourModel.Draw(shader);
+    // --bench-bake: запекание затенения всех статических мешей на 1..N потоках (без файла кэша)
+    // и повторное запекание после сдвига одного меша (вместе с ним - соседей в пределах bakeRadius)
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) != "--bench-bake")
+            continue;
+        double baseline = 0.0;
+        unsigned int maxWorkers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int workers = 0;; workers = workers ? workers * 2 + 1 : 1) {
+            workers = std::min(workers, maxWorkers);
+            JobSystem benchJobs((int)workers);
+            AmbientOcclusionBaker baker("", bakeRadius);
+            AmbientOcclusionBaker::Stats stats = baker.Update(ourModel, sceneBvh, benchJobs);
+            if (workers == 0)
+                baseline = stats.bakeMs;
+            std::cout << "AO bake on " << stats.threads << " threads: " << stats.baked << " meshes, " << stats.vertices
+                << " vertices in " << stats.bakeMs << " ms (" << stats.rays / std::max(stats.bakeMs, 1e-3) / 1000.0
+                << " Mrays/s), speedup " << baseline / stats.bakeMs << "x" << std::endl;
+            if (workers >= maxWorkers)
+                break;
+        }
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        AmbientOcclusionBaker baker("", bakeRadius);
+        baker.Update(ourModel, sceneBvh, jobs);
+        std::vector<char> bakedMeshes = AmbientOcclusionBaker::BakedMeshes(ourModel);
+        size_t moved = ourModel.meshes.size();
+        for (size_t m = 0; m < ourModel.meshes.size() && moved == ourModel.meshes.size(); ++m)
+            if (bakedMeshes[m])
+                moved = m;
+        if (moved < ourModel.meshes.size()) {
+            glm::mat4 original = ourModel.meshTransforms[moved];
+            ourModel.meshTransforms[moved] = glm::translate(original, glm::vec3(0.0f, bakeRadius * 0.1f, 0.0f));
+            sceneBvh.Refit(ourModel.WorldTransforms());
+            AmbientOcclusionBaker::Stats stats = baker.Update(ourModel, sceneBvh, jobs);
+            std::cout << "AO incremental re-bake: " << stats.baked << "/" << stats.staticMeshes << " meshes ("
+                << stats.vertices << " vertices) in " << stats.bakeMs << " ms" << std::endl;
+            // Исходные значения возвращаются из кэша в памяти, без запекания
+            ourModel.meshTransforms[moved] = original;
+            sceneBvh.Refit(ourModel.WorldTransforms());
+            baker.Update(ourModel, sceneBvh, jobs);
+        }
     }
 
+    // Поток отрисовки владеет GL-контекстом; основной поток обрабатывает события окна,
+    // ввод и симуляцию и передаёт отрисовке снимки сцены через тройной буфер
+    glfwMakeContextCurrent(NULL);
+    std::thread renderThread([&]() {
+        glfwMakeContextCurrent(window);
+        jobs.BindMainThread();
+
+        SceneSnapshot snapshot;
+        bool hasSnapshot = false;
+        bool cubeShadowsShown = false;
+        unsigned int aoTexture = 0;
+        // Тени в программу: карты ShadowMap и, в режиме кубических теней, кубическая карта вместо них;
+        // вместе с ними - затенение окружения кадра (0 - выключено)
+        auto bindShadows = [&](Shader& program) {
+            shadowMap.Bind(program);
+            if (snapshot.cubeShadows)
+                cubeShadow.Bind(program);
+            else
+                program.setBool("cubeShadows", false);
+            AmbientOcclusion::Bind(program, aoTexture);
+        };
+        float lastRenderStatsTime = 0.0f, lastLayerStatsTime = 0.0f, lastLatencyStatsTime = 0.0f;
+        double lastInputTime = -1.0;
+        LowLatency lowLatency;
+        FramePacer pacer((FramePacer::Mode)pacingMode.load(), targetFps, displayRate);
+        float lastPacingStatsTime = 0.0f, lastLightStatsTime = 0.0f, lastPrepassStatsTime = 0.0f, lastShadowStatsTime = 0.0f;
+        float lastResolutionStatsTime = 0.0f, lastGraphStatsTime = 0.0f, lastAoStatsTime = 0.0f;
+        RenderGraph graph;
+        int viewportWidth = SCR_WIDTH, viewportHeight = SCR_HEIGHT;
+
+        while (running.load(std::memory_order_acquire)) {
+            float currentFrame = glfwGetTime();
+
+            bool fresh = snapshots.Acquire();
+            if (fresh) {
+                snapshot = snapshots.Front();
+                hasSnapshot = true;
+            }
+            // В режиме по требованию кадр рисуется только по новому снимку
+            if (!hasSnapshot || (!fresh && renderOnDemand.load())) {
+                std::unique_lock<std::mutex> lock(snapshotMutex);
+                snapshotPublished.wait_for(lock, std::chrono::milliseconds(100), []() {
+                    return snapshots.Fresh() || !running.load();
+                });
+                continue;
+            }
+            if (pacingMode.load() != pacer.GetMode())
+                pacer.SetMode((FramePacer::Mode)pacingMode.load());
+
+            bool lowLatencyFrame = lowLatencyEnabled.load();
+            lowLatency.SetMaxFramesInFlight(lowLatencyFrame ? 1 : LowLatency::RING_SIZE);
+            lowLatency.BeginFrame();
+            pacer.BeginFrame();
+            jobs.RunMainThreadJobs();
+
+            if (snapshot.fbWidth != viewportWidth || snapshot.fbHeight != viewportHeight) {
+                viewportWidth = snapshot.fbWidth;
+                viewportHeight = snapshot.fbHeight;
+                glViewport(0, 0, viewportWidth, viewportHeight);
+            }
+
+            // Динамическое разрешение: сцена рисуется в текстуру графа размером renderWidth x renderHeight
+            int renderWidth = viewportWidth, renderHeight = viewportHeight;
+            bool scaledFrame = snapshot.dynamicResolution && viewportWidth > 0 && viewportHeight > 0;
+            if (scaledFrame) {
+                dynamicResolution.SetBudget(resolutionBudgetMs > 0.0 ? resolutionBudgetMs :
+                    1000.0 / (pacer.GetMode() == FramePacer::PACING_TARGET ? targetFps : displayRate));
+                dynamicResolution.BeginFrame(viewportWidth, viewportHeight);
+                renderWidth = dynamicResolution.RenderWidth();
+                renderHeight = dynamicResolution.RenderHeight();
+            }
+
+            // Положение между двумя последними шагами симуляции: кадр отстаёт от неё на один шаг
+            float alpha = (float)glm::clamp((glfwGetTime() - snapshot.stateTime) / snapshot.stepSeconds, 0.0, 1.0);
+            for (size_t i = 0; i < ourModel.meshTransforms.size(); ++i)
+                ourModel.meshTransforms[i] = interpolateTransform(snapshot.previousTransforms[i], snapshot.meshTransforms[i], alpha);
+            ourModel.meshVisible = snapshot.meshVisible;
+            glm::mat4 projection = snapshot.projection;
+            glm::mat4 view = snapshot.view;
+            glm::vec3 viewPos = snapshot.cameraPos;
+            double inputTime = snapshot.inputTime;
+
+            // Камера берётся свежей, а не из снимка; по этой матрице идут и отсечение, и все проходы кадра:
+            // она защёлкивается один раз до графа и больше в этом кадре не переписывается
+            if (lowLatencyFrame) {
+                CameraState camera = readCamera();
+                view = glm::lookAt(camera.position, camera.position + camera.front, cameraUp);
+                viewPos = camera.position;
+                inputTime = camera.inputTime;
+            }
+            lowLatency.LatchView(view);
+
+            bool visibilityPath = snapshot.visibilityBuffer && renderWidth > 0 && renderHeight > 0;
+            bool quadViewPath = !visibilityPath && snapshot.quadView && renderWidth > 1 && renderHeight > 1;
+            bool pullingPath = !visibilityPath && !quadViewPath && snapshot.vertexPulling && snapshot.cullingMode != CULLING_HIZ;
+            bool forwardPath = !visibilityPath && !quadViewPath && !pullingPath && snapshot.cullingMode != CULLING_HIZ;
+
+            // Кадр как граф проходов: порядок, отсечение ненужных проходов и память
+            // временных текстур определяются по объявленным чтениям и записям
+            graph.Reset();
+            RenderGraph::Handle shadowMaps = graph.Import("Shadow maps");
+            RenderGraph::Handle lightClusters = graph.Import("Light clusters");
+            RenderGraph::Handle sceneColor = RenderGraph::BACKBUFFER, sceneDepth = RenderGraph::BACKBUFFER;
+            if (scaledFrame) {
+                sceneColor = graph.CreateTexture("Scene color", GL_RGBA8, viewportWidth, viewportHeight);
+                sceneDepth = graph.CreateTexture("Scene depth", GL_DEPTH24_STENCIL8, viewportWidth, viewportHeight);
+            }
+
+            // Тени подвижных деталей падают и на статические меши, поэтому кэш статического слоя
+            // сбрасывается при любом изменении теней
+            graph.AddPass("Shadows", [&]() {
+                shadowMap.caching = snapshot.shadowCache;
+                bool changed = snapshot.cubeShadows ? cubeShadow.Update(renderWidth, renderHeight) :
+                    shadowMap.Update(renderWidth, renderHeight);
+                if (changed || snapshot.cubeShadows != cubeShadowsShown)
+                    staticLayer.Invalidate();
+                cubeShadowsShown = snapshot.cubeShadows;
+            }).Write(shadowMaps);
+
+            // Раскладка по кластерам по той же матрице вида, по которой идёт отсечение
+            graph.AddPass("Light binning", [&]() {
+                clusteredLights.Update(view, projection, 0.1f, 100.0f);
+            }).Write(lightClusters);
+
+            // Затенение окружения: глубина кадра, расчёт в пониженном разрешении, накопление по кадрам
+            // и повышение разрешения с учётом глубины. Глубина берётся из геометрического прохода буфера
+            // видимости или из предварительного прохода, вынесенных перед сценой; свой проход глубины -
+            // только для путей, которые не рисуют её заранее. В четырёх видах не считается: кадр не
+            // соответствует одной камере
+            bool aoFrame = snapshot.aoQuality != AmbientOcclusion::AO_OFF && !quadViewPath && renderWidth > 0 && renderHeight > 0;
+            bool prepassDepth = aoFrame && forwardPath && !snapshot.staticLayerCache &&
+                snapshot.depthPrepass != DepthPrepass::PREPASS_OFF;
+            RenderGraph::Handle aoDepth = -1, aoRaw = -1, aoHistory = -1, aoMap = -1;
+            int aoDepthWidth = viewportWidth, aoDepthHeight = viewportHeight;
+            auto aoDepthTexture = [&]() {
+                return visibilityPath ? visibilityBuffer.DepthTexture() : graph.Texture(aoDepth);
+            };
+            if (aoFrame) {
+                ambientOcclusion.SetQuality(snapshot.aoQuality);
+                ambientOcclusion.BeginFrame(view, projection, lowLatencyFrame, renderWidth, renderHeight);
+                if (visibilityPath) {
+                    aoDepth = graph.Import("Visibility buffer");
+                    aoDepthWidth = renderWidth;
+                    aoDepthHeight = renderHeight;
+                    graph.AddPass("Visibility geometry", [&]() {
+                        glViewport(0, 0, renderWidth, renderHeight);
+                        visibilityBuffer.DrawGeometry(view, projection, lowLatencyFrame, renderWidth, renderHeight);
+                    }).Write(aoDepth);
+                }
+                else if (prepassDepth) {
+                    aoDepth = graph.CreateTexture("Depth prepass", GL_DEPTH24_STENCIL8, viewportWidth, viewportHeight);
+                    graph.AddPass("Depth prepass", [&]() {
+                        glViewport(0, 0, renderWidth, renderHeight);
+                        depthPrepass.SetMode(snapshot.depthPrepass);
+                        depthPrepass.SetCamera(view, projection, lowLatencyFrame);
+                        depthPrepass.DrawDepth();
+                    }).Depth(aoDepth);
+                }
+                else {
+                    aoDepth = graph.CreateTexture("AO depth", GL_DEPTH_COMPONENT32F, viewportWidth, viewportHeight);
+                    graph.AddPass("AO depth", [&]() {
+                        ambientOcclusion.DrawDepth();
+                    }).Depth(aoDepth);
+                }
+                aoRaw = graph.CreateTexture("AO raw", GL_RG16F, ambientOcclusion.LowWidth(renderWidth), ambientOcclusion.LowHeight(renderHeight));
+                aoHistory = graph.Import("AO history");
+                aoMap = graph.CreateTexture("AO", GL_R8, viewportWidth, viewportHeight);
+
+                graph.AddPass("AO", [&]() {
+                    ambientOcclusion.Compute(aoDepthTexture(), aoDepthWidth, aoDepthHeight, graph.Texture(aoRaw));
+                }).Read(aoDepth).Write(aoRaw);
+                graph.AddPass("AO temporal", [&]() {
+                    ambientOcclusion.Accumulate(graph.Texture(aoRaw));
+                }).Read(aoRaw).Write(aoHistory);
+                graph.AddPass("AO upsample", [&]() {
+                    ambientOcclusion.Upsample(aoDepthTexture(), aoDepthWidth, aoDepthHeight, graph.Texture(aoMap));
+                }).Read(aoDepth).Read(aoHistory).Write(aoMap);
+            }
+
+            RenderGraph::PassBuilder scenePass = graph.AddPass("Scene", [&]() {
+                glViewport(0, 0, renderWidth, renderHeight);
+                glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+                aoTexture = aoFrame ? graph.Texture(aoMap) : 0;
+                bindShadows(shader);
+                shader.use();
+                shader.setVec3("viewPos", viewPos);
+                shader.setMat4("projection", projection);
+                shader.setMat4("view", view);
+                shader.setBool("lateLatched", lowLatencyFrame);
+                clusteredLights.Bind(shader, renderWidth, renderHeight);
+                depthPrepass.SetMode(snapshot.depthPrepass);
+                depthPrepass.SetCamera(view, projection, lowLatencyFrame);
+
+                if (visibilityPath) {
+                    resolveShader.use();
+                    resolveShader.setVec3("viewPos", viewPos);
+                    clusteredLights.Bind(resolveShader, renderWidth, renderHeight);
+                    bindShadows(resolveShader);
+                    if (aoFrame)
+                        visibilityBuffer.Resolve(view, projection, lowLatencyFrame);
+                    else
+                        visibilityBuffer.Draw(view, projection, lowLatencyFrame, renderWidth, renderHeight);
+                }
+                else if (quadViewPath) {
+                    // Кластеры источников строятся для одного вида, в четырёх видах - полный перебор
+                    quadShader.use();
+                    quadShader.setVec3("viewPos", viewPos);
+                    clusteredLights.Bind(quadShader, renderWidth, renderHeight);
+                    quadShader.setBool("clusteredLights", false);
+                    bindShadows(quadShader);
+                    float halfWidth = renderWidth * 0.5f, halfHeight = renderHeight * 0.5f;
+                    glViewportIndexedf(0, 0.0f, halfHeight, halfWidth, halfHeight);
+                    glViewportIndexedf(1, halfWidth, halfHeight, halfWidth, halfHeight);
+                    glViewportIndexedf(2, 0.0f, 0.0f, halfWidth, halfHeight);
+                    glViewportIndexedf(3, halfWidth, 0.0f, halfWidth, halfHeight);
+                    quadView.SetViews(quadViewProjections(sceneMin, sceneMax, halfWidth / halfHeight, projection * view));
+                    quadView.Draw(quadShader, MultiView::TARGET_VIEWPORTS);
+                    glViewport(0, 0, renderWidth, renderHeight);
+                }
+                else if (snapshot.cullingMode == CULLING_HIZ && renderWidth > 0 && renderHeight > 0)
+                    hiZ.Draw(shader, projection * view, renderWidth, renderHeight);
+                else if (pullingPath) {
+                    pullingShader.use();
+                    pullingShader.setVec3("viewPos", viewPos);
+                    clusteredLights.Bind(pullingShader, renderWidth, renderHeight);
+                    bindShadows(pullingShader);
+                    vertexPulling.Draw(view, projection, lowLatencyFrame);
+                }
+                else if (snapshot.staticLayerCache && renderWidth > 0 && renderHeight > 0) {
+                    // Затенение окружения статических мешей зависит от подвижных и накапливается по кадрам:
+                    // слой запоминается вместе с ним, только когда история сошлась
+                    if (aoFrame && !ambientOcclusion.Converged())
+                        staticLayer.Invalidate();
+                    staticLayer.Draw(shader, projection * view, renderWidth, renderHeight);
+                }
+                else if (prepassDepth)
+                    depthPrepass.DrawWithDepth(shader, graph.Texture(aoDepth), renderWidth, renderHeight);
+                else
+                    depthPrepass.Draw(shader);
+                if (forwardPath)
+                    depthPrepass.EndFrame();
+            }).Read(shadowMaps).Color(sceneColor).Depth(sceneDepth);
+            if (clusteredLights.clustered && !clusteredLights.Lights().empty())
+                scenePass.Read(lightClusters);
+            if (aoFrame)
+                scenePass.Read(aoMap);
+            if ((visibilityPath && aoFrame) || prepassDepth)
+                scenePass.Read(aoDepth);
+
+            // Запросы для следующих кадров выпускаются по глубине уже нарисованной сцены
+            if (snapshot.occlusionQueries && snapshot.cullingMode != CULLING_HIZ && !quadViewPath)
+                graph.AddPass("Occlusion queries", [&]() {
+                    occlusionQueries.Issue(view, projection);
+                }).Depth(sceneDepth).SideEffect();
+            else
+                occlusionQueries.Detach();
+
+            if (scaledFrame)
+                graph.AddPass("Upscale", [&]() {
+                    dynamicResolution.EndFrame(graph.Texture(sceneColor));
+                }).Read(sceneColor).Color(RenderGraph::BACKBUFFER);
+
+            graph.Compile();
+            graph.Execute();
+            aoConverged.store(!aoFrame || ambientOcclusion.Converged());
+
+            if (scaledFrame && currentFrame - lastResolutionStatsTime >= 1.0f) {
+                DynamicResolution::Stats stats = dynamicResolution.TakeStats();
+                std::cout << "Dynamic resolution: scale " << stats.scale << " (" << dynamicResolution.RenderWidth() << "x"
+                    << dynamicResolution.RenderHeight() << "), " << stats.minScale << ".." << stats.maxScale << " avg "
+                    << stats.averageScale << ", " << stats.changes << " changes; GPU " << stats.gpuMs << " ms of "
+                    << stats.budgetMs << " ms budget" << std::endl;
+                lastResolutionStatsTime = currentFrame;
+            }
+
+            if (visibilityPath && currentFrame - lastRenderStatsTime >= 1.0f) {
+                VisibilityBuffer::Stats stats = visibilityBuffer.TakeStats();
+                std::cout << "Visibility buffer: " << stats.meshes << " meshes, " << stats.triangles << " triangles; geometry "
+                    << stats.geometryMs << " ms, resolve " << stats.resolveMs << " ms" << std::endl;
+                lastRenderStatsTime = currentFrame;
+            }
+            if (pullingPath && currentFrame - lastRenderStatsTime >= 1.0f) {
+                VertexPulling::Stats stats = vertexPulling.TakeStats();
+                std::cout << "Vertex pulling: " << stats.draws << " draws in one call, " << stats.compactGeometries << " compact / "
+                    << stats.fullGeometries << " full geometries, vertices " << stats.vertexBytes / 1024 << " KB (fixed layout "
+                    << stats.fixedBytes / 1024 << " KB); " << stats.gpuMs << " ms" << std::endl;
+                lastRenderStatsTime = currentFrame;
+            }
+            if (!visibilityPath && snapshot.cullingMode == CULLING_HIZ && currentFrame - lastRenderStatsTime >= 1.0f) {
+                const HiZCulling::Stats& stats = hiZ.stats();
+                std::cout << "Hi-Z: " << stats.occludedDraws << "/" << stats.totalDraws << " draws occluded ("
+                    << stats.occludedTriangles << "/" << stats.totalTriangles << " triangles), "
+                    << stats.frustumDraws << " outside frustum, "
+                    << stats.secondPassDraws << " newly visible" << std::endl;
+                lastRenderStatsTime = currentFrame;
+            }
+            if (snapshot.occlusionQueries && snapshot.cullingMode == CULLING_OFF && currentFrame - lastRenderStatsTime >= 1.0f) {
+                const OcclusionQueries::Stats& stats = occlusionQueries.stats();
+                std::cout << "Occlusion queries: " << stats.hiddenMeshes << "/" << stats.queriedMeshes << " meshes hidden ("
+                    << stats.hiddenTriangles << " triangles), " << stats.issuedQueries << " queries issued" << std::endl;
+                lastRenderStatsTime = currentFrame;
+            }
+            if (snapshot.staticLayerCache && forwardPath && currentFrame - lastLayerStatsTime >= 1.0f) {
+                StaticLayerCache::Stats stats = staticLayer.TakeStats();
+                std::cout << "Static layer: " << stats.reusedFrames << " frames reused, " << stats.rebuilds << " rebuilds; "
+                    << stats.staticMeshes << " static meshes (" << stats.staticTriangles << " triangles) skipped per reused frame" << std::endl;
+                lastLayerStatsTime = currentFrame;
+            }
+
+            if (lowLatencyEnabled && currentFrame - lastLatencyStatsTime >= 1.0f) {
+                LowLatency::Stats stats = lowLatency.TakeStats();
+                std::cout << "Latency: input-to-present " << stats.averageMs << " ms avg, " << stats.maxMs << " ms max over "
+                    << stats.frames << " frames, " << stats.framesInFlight << " frames in flight" << std::endl;
+                lastLatencyStatsTime = currentFrame;
+            }
+
+            if (forwardPath && currentFrame - lastPrepassStatsTime >= 1.0f) {
+                DepthPrepass::Stats stats = depthPrepass.TakeStats();
+                double saved = stats.depthFragments > 0.0 ? (1.0 - stats.shadedFragments / stats.depthFragments) * 100.0 : 0.0;
+                std::cout << "Depth prepass " << DepthPrepass::ModeName(depthPrepass.GetMode()) << ": "
+                    << (size_t)stats.shadedFragments << " fragments shaded per frame, "
+                    << (size_t)stats.depthFragments << " without prepass (" << saved << "% overdraw removed)" << std::endl;
+                lastPrepassStatsTime = currentFrame;
+            }
+
+            if (snapshot.cubeShadows && currentFrame - lastShadowStatsTime >= 1.0f) {
+                CubeShadowMap::Stats stats = cubeShadow.TakeStats();
+                std::cout << "Cube shadows: " << stats.rebuilds << " rebuilds over " << stats.frames << " frames, "
+                    << stats.passMs << " ms per rebuild; " << stats.submission.submissions << " submissions, "
+                    << stats.submission.draws << " draws for " << stats.submission.instances << " mesh-faces ("
+                    << stats.submission.culled << " culled), submit " << stats.submission.submitMs << " ms" << std::endl;
+                lastShadowStatsTime = currentFrame;
+            }
+            if (aoFrame && currentFrame - lastAoStatsTime >= 1.0f) {
+                AmbientOcclusion::Stats stats = ambientOcclusion.TakeStats();
+                const AmbientOcclusion::Tier& tier = AmbientOcclusion::TierOf(stats.quality);
+                std::cout << "Ambient occlusion " << tier.name << ": " << stats.width << "x" << stats.height << " (1/"
+                    << tier.divisor << " resolution), " << tier.samples << " samples, " << stats.tierMs[stats.quality]
+                    << " ms over " << stats.frames << " frames; tiers";
+                for (int q = 1; q < AmbientOcclusion::QUALITY_COUNT; ++q)
+                    std::cout << " " << AmbientOcclusion::TierOf((AmbientOcclusion::Quality)q).name << " " << stats.tierMs[q] << " ms";
+                std::cout << std::endl;
+                lastAoStatsTime = currentFrame;
+            }
+            if (quadViewPath && currentFrame - lastRenderStatsTime >= 1.0f) {
+                MultiView::Stats stats = quadView.TakeStats();
+                std::cout << "Quad view: " << stats.draws << " draws for " << stats.instances << " mesh-views ("
+                    << stats.culled << " culled) over " << stats.submissions << " frames, submit " << stats.submitMs
+                    << " ms per frame" << std::endl;
+                lastRenderStatsTime = currentFrame;
+            }
+            if (currentFrame - lastShadowStatsTime >= 1.0f) {
+                ShadowMap::Stats stats = shadowMap.TakeStats();
+                std::cout << "Shadows (" << (stats.caching ? "cached" : "uncached") << "): static pass " << stats.staticPassMs << " ms x "
+                    << stats.staticRebuilds << ", dynamic pass " << stats.dynamicPassMs << " ms x " << stats.dynamicPasses
+                    << " over " << stats.frames << " frames; per frame " << (stats.frames > 0 ?
+                    (stats.staticPassMs * stats.staticRebuilds + stats.dynamicPassMs * stats.dynamicPasses) / stats.frames : 0.0)
+                    << " ms, uncached " << stats.staticPassMs + stats.dynamicPassMs << " ms" << std::endl;
+                lastShadowStatsTime = currentFrame;
+            }
+
+            if (!clusteredLights.Lights().empty() && currentFrame - lastLightStatsTime >= 1.0f) {
+                std::cout << "Lights: " << clusteredLights.Lights().size() << " point lights, cluster binning "
+                    << clusteredLights.TakeBinningMs() << " ms, " << clusteredLights.RequiredIndices() << "/"
+                    << clusteredLights.IndexCapacity() << " cluster indices, " << clusteredLights.TakeDroppedIndices()
+                    << " dropped" << std::endl;
+                lastLightStatsTime = currentFrame;
+            }
+
+            if (currentFrame - lastGraphStatsTime >= 1.0f) {
+                RenderGraph::Stats stats = graph.TakeStats();
+                std::cout << "Render graph: " << stats.passes - stats.culled.size() << "/" << stats.passes << " passes";
+                for (size_t i = 0; i < stats.culled.size(); ++i)
+                    std::cout << (i == 0 ? " (culled: " : ", ") << stats.culled[i] << (i + 1 == stats.culled.size() ? ")" : "");
+                std::cout << ";";
+                for (const RenderGraph::PassTime& time : stats.times)
+                    std::cout << " " << time.name << " " << time.gpuMs << " ms;";
+                std::cout << " transient " << stats.transientTextures << " textures " << stats.transientBytes / 1024 << " KB in "
+                    << stats.physicalTextures << " allocations " << stats.physicalBytes / 1024 << " KB ("
+                    << (stats.transientBytes - stats.physicalBytes) / 1024 << " KB saved by aliasing)" << std::endl;
+                lastGraphStatsTime = currentFrame;
+            }
+
+            if (currentFrame - lastPacingStatsTime >= 1.0f) {
+                FramePacer::Stats stats = pacer.TakeStats();
+                std::cout << "Pacing: " << FramePacer::ModeName(pacer.GetMode()) << (stats.halfRate ? " (half rate)" : "")
+                    << ", target " << stats.targetMs << " ms, mean " << stats.meanMs << " ms, variance "
+                    << stats.varianceMs2 << " ms^2, deviation " << stats.deviationMs << " ms, "
+                    << stats.missedFrames << "/" << stats.frames << " over budget" << std::endl;
+                lastPacingStatsTime = currentFrame;
+            }
+
+            pacer.Wait();
+            glfwSwapBuffers(window);
+            pacer.FramePresented();
+            lowLatency.EndFrame(inputTime > lastInputTime ? inputTime : -1.0);
+            lastInputTime = std::max(lastInputTime, inputTime);
+            renderFrameMs.store((glfwGetTime() - currentFrame) * 1000.0f);
+            renderFrames.fetch_add(1);
+        }
+        glfwMakeContextCurrent(NULL);
+    });
+
+    float lastTimingTime = 0.0f;
+    unsigned int lastTicks = 0, lastFrames = 0, lastSteps = 0;
+    std::vector<glm::mat4> worldTransforms(ourModel.meshes.size());
+    std::vector<ObjectTransform> previousObjects = objectTransforms;
+    double simulationTime = glfwGetTime();
+
+    // Сборка и публикация снимка по текущему состоянию симуляции
+    double step = 1.0 / simulationRate;
+    auto publishSnapshot = [&]() {
+        SceneSnapshot& snapshot = snapshots.Back();
+        glfwGetFramebufferSize(window, &snapshot.fbWidth, &snapshot.fbHeight);
+        snapshot.projection = glm::perspective(glm::radians(45.0f),
+            (float)SCR_WIDTH / (float)SCR_HEIGHT,
+            0.1f, 100.0f);
+        snapshot.view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+        snapshot.cameraPos = cameraPos;
+        snapshot.inputTime = readCamera().inputTime;
+        snapshot.cullingMode = cullingMode;
+        snapshot.occlusionQueries = occlusionQueriesEnabled;
+        snapshot.staticLayerCache = staticLayerCacheEnabled;
+        snapshot.depthPrepass = depthPrepassMode;
+        snapshot.shadowCache = shadowCacheEnabled;
+        snapshot.visibilityBuffer = visibilityBufferEnabled;
+        snapshot.vertexPulling = vertexPullingEnabled;
+        snapshot.cubeShadows = cubeShadowsEnabled;
+        snapshot.quadView = quadViewEnabled;
+        snapshot.aoQuality = aoQuality;
+        snapshot.dynamicResolution = dynamicResolutionEnabled;
+
+        snapshot.stateTime = simulationTime;
+        snapshot.stepSeconds = step;
+
+        snapshot.previousTransforms.resize(ourModel.meshes.size());
+        snapshot.meshTransforms.resize(ourModel.meshes.size());
+        jobs.ParallelFor(snapshot.meshTransforms.size(), 256, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                snapshot.previousTransforms[i] = calculateModelMatrix(i, previousObjects);
+                snapshot.meshTransforms[i] = calculateModelMatrix(i, objectTransforms);
+                worldTransforms[i] = snapshot.meshTransforms[i] * ourModel.meshBaseTransforms[i];
+            }
+        });
+
+        // Программное отсечение считается в фоне, пока обновляется BVH и обрабатывается выбор
+        if (cullingMode == CULLING_SOFTWARE)
+            softwareOcclusion.Begin(snapshot.projection * snapshot.view, worldTransforms);
+
+        sceneBvh.Refit(worldTransforms);
+
+        if (pickRequested) {
+            Ray ray;
+            ray.origin = cameraPos;
+            ray.direction = cameraFront;
+            RayHit hit;
+            if (sceneBvh.Intersect(ray, hit))
+                std::cout << "Pick: mesh " << hit.meshIndex << ", triangle " << hit.triangle
+                    << ", distance " << hit.t << std::endl;
+            else
+                std::cout << "Pick: nothing" << std::endl;
+            pickRequested = false;
+        }
+
+        if (cullingMode == CULLING_SOFTWARE)
+            softwareOcclusion.End(snapshot.meshVisible);
+        else
+            snapshot.meshVisible.assign(ourModel.meshes.size(), 1);
+
+        snapshots.Publish();
+        {
+            std::lock_guard<std::mutex> lock(snapshotMutex);
+        }
+        snapshotPublished.notify_one();
+    };
+
+    int settleFrames = 0;
+    double lastPublishTime = 0.0;
+
+    while (!glfwWindowShouldClose(window)) {
+        // Сцена неподвижна: ожидание событий окна без опроса
+        bool idle = renderOnDemand && settleFrames == 0 && !sceneDirty;
+        if (idle) {
+            double timeout = refreshRate > 0.0 ? std::max(0.0, lastPublishTime + 1.0 / refreshRate - glfwGetTime()) : 1.0;
+            glfwWaitEventsTimeout(timeout);
+            // Простой не накапливается ни в шаге камеры, ни в отставании симуляции
+            lastFrame = glfwGetTime();
+            simulationTime = lastFrame;
+        }
+        else {
+            glfwPollEvents();
+        }
+
+        float currentFrame = glfwGetTime();
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+
+        processInput(window);
+
+        if (currentFrame - simulationTime > MAX_SIMULATION_LAG)
+            simulationTime = currentFrame - MAX_SIMULATION_LAG;
+        int steps = 0;
+        while (simulationTime + step <= currentFrame) {
+            previousObjects = objectTransforms;
+            simulateStep((float)step);
+            simulationTime += step;
+            steps++;
+        }
+        simulationSteps.fetch_add(steps);
+
+        bool changed = sceneDirty.exchange(false);
+        bool aoOn = aoQuality != AmbientOcclusion::AO_OFF;
+        if (changed)
+            settleFrames = aoOn ? std::max(SETTLE_FRAMES, AmbientOcclusion::CONVERGED_FRAMES) : SETTLE_FRAMES;
+        bool refreshDue = refreshRate > 0.0 && currentFrame - lastPublishTime >= 1.0 / refreshRate;
+        if (!renderOnDemand || changed || settleFrames > 0 || refreshDue) {
+            publishSnapshot();
+            lastPublishTime = currentFrame;
+            if (!changed && settleFrames > 0)
+                settleFrames--;
+            // Поток отрисовки мог пропустить снимки: ждём, пока он сам не сообщит о сходимости
+            if (settleFrames == 0 && aoOn && !aoConverged.load())
+                settleFrames = 1;
+        }
+        simulationTickMs.store((glfwGetTime() - currentFrame) * 1000.0f);
+        simulationTicks.fetch_add(1);
+
+        if (cullingMode == CULLING_SOFTWARE && currentFrame - lastStatsTime >= 1.0f) {
+            const SoftwareOcclusion::Stats& stats = softwareOcclusion.stats();
+            std::cout << "Software occlusion: " << stats.culledMeshes << "/" << stats.testedMeshes << " draws culled ("
+                << stats.culledTriangles << " triangles), " << stats.occluders << " occluders, "
+                << stats.occluderTriangles << " occluder triangles" << std::endl;
+            lastStatsTime = currentFrame;
+        }
+        if (currentFrame - lastTimingTime >= 1.0f) {
+            unsigned int ticks = simulationTicks.load(), frames = renderFrames.load(), steps = simulationSteps.load();
+            float elapsed = currentFrame - lastTimingTime;
+            std::cout << "Threads: simulation " << (int)((steps - lastSteps) / elapsed) << " steps/s in "
+                << (int)((ticks - lastTicks) / elapsed) << " ticks/s (" << simulationTickMs.load() << " ms/tick), render " << (int)((frames - lastFrames) / elapsed)
+                << " fps (" << renderFrameMs.load() << " ms/frame)" << std::endl;
+            lastTicks = ticks;
+            lastSteps = steps;
+            lastFrames = frames;
+            lastTimingTime = currentFrame;
+        }
+
+        // Ожидание до следующего шага симуляции
+        if (!renderOnDemand || settleFrames > 0 || sceneDirty)
+            std::this_thread::sleep_until(std::chrono::steady_clock::now() +
+                std::chrono::duration<double>(simulationTime + step - glfwGetTime()));
+    }
+
+    running.store(false, std::memory_order_release);
+    renderThread.join();
+
     glfwTerminate();
     return 0;
 }
@@ -165,67 +1397,63 @@ void processInput(GLFWwindow* window) {
         cameraPos -= glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         cameraPos += glm::normalize(glm::cross(cameraFront, cameraUp)) * cameraSpeed;
+    if (cameraSpeed > 0.0f && (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS ||
+        glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)) {
+        sceneDirty = true;
+        publishCamera();
+    }
+
+    // Управление объектами: направление считывается здесь, движение - в simulateStep
+    objectInput = glm::vec3(0.0f);
+    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) // Объект 1: Y-axis (Y/H)
+        objectInput.y += 1.0f;
+    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+        objectInput.y -= 1.0f;
+    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) // Объект 2: X-axis (I/K)
+        objectInput.x -= 1.0f;
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+        objectInput.x += 1.0f;
+    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) // Объект 3: Z-axis (U/J)
+        objectInput.z -= 1.0f;
+    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
+        objectInput.z += 1.0f;
+}
+
+// Один шаг симуляции фиксированной длины dt
+void simulateStep(float dt) {
+    float moveSpeed = 1.5f * dt;
+    std::vector<ObjectTransform> before = objectTransforms;
+
+    objectTransforms[1].position.y = glm::clamp(
+        objectTransforms[1].position.y + objectInput.y * moveSpeed,
+        objectTransforms[1].yLimit.min,
+        objectTransforms[1].yLimit.max
+    );
+    objectTransforms[2].position.x = glm::clamp(
+        objectTransforms[2].position.x + objectInput.x * moveSpeed,
+        objectTransforms[2].xLimit.min,
+        objectTransforms[2].xLimit.max
+    );
+    objectTransforms[3].position.z = glm::clamp(
+        objectTransforms[3].position.z + objectInput.z * moveSpeed,
+        objectTransforms[3].zLimit.min,
+        objectTransforms[3].zLimit.max
+    );
 
-    // Управление объектами
-    float moveSpeed = 1.5f * deltaTime;
-
-    // Объект 1: Y-axis (Y/H)
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) {
-        objectTransforms[1].position.y += moveSpeed;
-        objectTransforms[1].position.y = glm::clamp(
-            objectTransforms[1].position.y,
-            objectTransforms[1].yLimit.min,
-            objectTransforms[1].yLimit.max
-        );
-    }
-    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
-        objectTransforms[1].position.y -= moveSpeed;
-        objectTransforms[1].position.y = glm::clamp(
-            objectTransforms[1].position.y,
-            objectTransforms[1].yLimit.min,
-            objectTransforms[1].yLimit.max
-        );
-    }
-
-    // Объект 2: X-axis (I/K)
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) {
-        objectTransforms[2].position.x -= moveSpeed;
-        objectTransforms[2].position.x = glm::clamp(
-            objectTransforms[2].position.x,
-            objectTransforms[2].xLimit.min,
-            objectTransforms[2].xLimit.max
-        );
-    }
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) {
-        objectTransforms[2].position.x += moveSpeed;
-        objectTransforms[2].position.x = glm::clamp(
-            objectTransforms[2].position.x,
-            objectTransforms[2].xLimit.min,
-            objectTransforms[2].xLimit.max
-        );
-    }
-
-    // Объект 3: Z-axis (U/J)
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
-        objectTransforms[3].position.z -= moveSpeed;
-        objectTransforms[3].position.z = glm::clamp(
-            objectTransforms[3].position.z,
-            objectTransforms[3].zLimit.min,
-            objectTransforms[3].zLimit.max
-        );
-    }
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
-        objectTransforms[3].position.z += moveSpeed;
-        objectTransforms[3].position.z = glm::clamp(
-            objectTransforms[3].position.z,
-            objectTransforms[3].zLimit.min,
-            objectTransforms[3].zLimit.max
-        );
+    for (size_t i = 0; i < objectTransforms.size(); ++i) {
+        if (objectTransforms[i].position != before[i].position)
+            sceneDirty = true;
     }
 }
 
+// Область вывода меняет поток отрисовки по размеру кадра из снимка
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-    glViewport(0, 0, width, height);
+    sceneDirty = true;
+}
+
+// Окно перекрыто или восстановлено: содержимое нужно перерисовать
+void window_refresh_callback(GLFWwindow* window) {
+    sceneDirty = true;
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -257,7 +1485,93 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
     front.y = sin(glm::radians(pitch));
     front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
     cameraFront = glm::normalize(front);
+    sceneDirty = true;
+    publishCamera();
+}
+
+// Текущая камера для потока отрисовки, со временем события ввода
+void publishCamera() {
+    std::lock_guard<std::mutex> lock(cameraMutex);
+    latestCamera.position = cameraPos;
+    latestCamera.front = cameraFront;
+    latestCamera.inputTime = glfwGetTime();
+}
+
+CameraState readCamera() {
+    std::lock_guard<std::mutex> lock(cameraMutex);
+    return latestCamera;
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
 }
+
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS)
+        return;
+    sceneDirty = true;
+
+    if (key == GLFW_KEY_C) {
+        static const char* names[] = { "off", "Hi-Z", "software" };
+        cullingMode = (CullingMode)((cullingMode + 1) % 3);
+        std::cout << "Occlusion culling: " << names[cullingMode] << std::endl;
+    }
+    if (key == GLFW_KEY_Q) {
+        occlusionQueriesEnabled = !occlusionQueriesEnabled;
+        std::cout << "Occlusion queries: " << (occlusionQueriesEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_L) {
+        staticLayerCacheEnabled = !staticLayerCacheEnabled;
+        std::cout << "Static layer cache: " << (staticLayerCacheEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_P) {
+        depthPrepassMode = (DepthPrepass::Mode)((depthPrepassMode + 1) % 3);
+        std::cout << "Depth prepass: " << DepthPrepass::ModeName(depthPrepassMode) << std::endl;
+    }
+    if (key == GLFW_KEY_T) {
+        shadowCacheEnabled = !shadowCacheEnabled;
+        std::cout << "Shadow cache: " << (shadowCacheEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_B) {
+        visibilityBufferEnabled = !visibilityBufferEnabled;
+        std::cout << "Visibility buffer: " << (visibilityBufferEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_X) {
+        vertexPullingEnabled = !vertexPullingEnabled;
+        std::cout << "Vertex pulling: " << (vertexPullingEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_O) {
+        cubeShadowsEnabled = !cubeShadowsEnabled;
+        std::cout << "Cube shadows: " << (cubeShadowsEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_M) {
+        quadViewEnabled = !quadViewEnabled;
+        std::cout << "Quad view: " << (quadViewEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_N) {
+        aoQuality = (AmbientOcclusion::Quality)((aoQuality + 1) % AmbientOcclusion::QUALITY_COUNT);
+        std::cout << "Ambient occlusion: " << AmbientOcclusion::TierOf(aoQuality).name << std::endl;
+    }
+    if (key == GLFW_KEY_G) {
+        dynamicResolutionEnabled = !dynamicResolutionEnabled;
+        std::cout << "Dynamic resolution: " << (dynamicResolutionEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_F) {
+        lowLatencyEnabled = !lowLatencyEnabled;
+        std::cout << "Low latency: " << (lowLatencyEnabled ? "on" : "off") << std::endl;
+    }
+    if (key == GLFW_KEY_V) {
+        pacingMode = (pacingMode + 1) % 4;
+        std::cout << "Frame pacing: " << FramePacer::ModeName((FramePacer::Mode)pacingMode.load()) << std::endl;
+    }
+    if (key == GLFW_KEY_R) {
+        renderOnDemand = !renderOnDemand;
+        std::cout << "Render on demand: " << (renderOnDemand ? "on" : "off") << std::endl;
+    }
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        pickRequested = true;
+        sceneDirty = true;
+    }
+}
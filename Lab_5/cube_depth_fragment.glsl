@@ -0,0 +1,10 @@
+#version 460 core
+in vec3 FragPos;
+
+// Кубическая карта теней (CubeShadowMap.h): глубина - расстояние до источника, нормированное на farPlane
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+void main() {
+    gl_FragDepth = length(FragPos - lightPosition) / farPlane;
+}
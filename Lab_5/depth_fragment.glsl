@@ -0,0 +1,5 @@
+#version 460 core
+
+// Цвет не пишется, нужна только глубина
+void main() {
+}
@@ -0,0 +1,28 @@
+#version 460 core
+layout(location = 0) in vec3 aPos;
+
+// Проход только по глубине (поток позиций). Положение считается теми же выражениями,
+// что и в vertex_sheder.glsl, и объявлено invariant: глубина совпадает бит в бит,
+// поэтому основной проход может сравнивать её с GL_EQUAL
+invariant gl_Position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+layout(std430, binding = 0) readonly buffer InstanceTransforms {
+    mat4 instanceModels[];
+};
+uniform bool instanced;
+uniform int instanceBase;
+
+layout(std140, binding = 0) uniform LateLatch {
+    mat4 latchedView;
+};
+uniform bool lateLatched;
+
+void main() {
+    mat4 world = instanced ? instanceModels[instanceBase + gl_InstanceID] : model;
+    vec3 worldPos = vec3(world * vec4(aPos, 1.0));
+    gl_Position = projection * (lateLatched ? latchedView : view) * vec4(worldPos, 1.0);
+}
@@ -1,8 +1,98 @@
 #version 460 core
 out vec4 FragColor;
 
+#ifdef VISIBILITY_RESOLVE
+// Вариант для буфера видимости (VisibilityBuffer.h): полноэкранный проход, атрибуты
+// восстанавливаются по номеру треугольника из буферов вершин и индексов мешей
+vec3 Normal;
+vec3 FragPos;
+float FragDepth;
+float Occlusion;   // запечённое затенение, байт на вершину в конце буфера вершин
+
+struct VisibilityInstance {
+    mat4 world;
+    mat4 normalMatrix;
+    uint triangleBase;  // номер первого треугольника экземпляра (с 1; 0 - пусто)
+    uint firstIndex;
+    uint baseVertex;
+    uint occlusionByte;
+};
+
+layout(std430, binding = 7) readonly buffer VisibilityVertices { float vertexData[]; }; // Vertex: позиция и нормаль
+layout(std430, binding = 7) readonly buffer VisibilityOcclusion { uint occlusionWords[]; }; // тот же буфер: затенение за вершинами
+layout(std430, binding = 8) readonly buffer VisibilityIndices { uint indexData[]; };
+layout(std430, binding = 9) readonly buffer VisibilityInstances { VisibilityInstance visibilityInstances[]; };
+
+layout(std140, binding = 0) uniform LateLatch {
+    mat4 latchedView;
+};
+uniform bool lateLatched;
+uniform mat4 view;
+uniform mat4 projection;
+uniform usampler2D visibilityBuffer;
+uniform uint visibilityInstanceCount;
+
+float cross2(vec2 a, vec2 b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+// Заполняет FragPos, Normal, FragDepth для пикселя; false - пиксель пуст
+bool resolveVisibility() {
+    uint id = texelFetch(visibilityBuffer, ivec2(gl_FragCoord.xy), 0).r;
+    if (id == 0u)
+        return false;
+
+    // Экземпляр с наибольшим triangleBase <= id
+    uint lo = 0u, hi = visibilityInstanceCount - 1u;
+    while (lo < hi) {
+        uint mid = (lo + hi + 1u) / 2u;
+        if (visibilityInstances[mid].triangleBase <= id)
+            lo = mid;
+        else
+            hi = mid - 1u;
+    }
+    VisibilityInstance instance = visibilityInstances[lo];
+    uint triangle = id - instance.triangleBase;
+
+    mat4 viewProj = projection * (lateLatched ? latchedView : view);
+    vec3 world[3], normal[3], occlusion;
+    vec4 clip[3];
+    for (int k = 0; k < 3; ++k) {
+        uint index = indexData[instance.firstIndex + triangle * 3u + uint(k)];
+        uint v = (index + instance.baseVertex) * 6u;
+        vec3 position = vec3(vertexData[v], vertexData[v + 1u], vertexData[v + 2u]);
+        world[k] = vec3(instance.world * vec4(position, 1.0));
+        normal[k] = mat3(instance.normalMatrix) * vec3(vertexData[v + 3u], vertexData[v + 4u], vertexData[v + 5u]);
+        clip[k] = viewProj * vec4(world[k], 1.0);
+        uint occlusionAt = instance.occlusionByte + index;
+        occlusion[k] = float((occlusionWords[occlusionAt >> 2] >> ((occlusionAt & 3u) * 8u)) & 0xFFu) / 255.0;
+    }
+
+    // Барицентрические координаты пикселя на экране и их перспективная коррекция
+    vec2 p = gl_FragCoord.xy / vec2(textureSize(visibilityBuffer, 0)) * 2.0 - 1.0;
+    vec2 n0 = clip[0].xy / clip[0].w, n1 = clip[1].xy / clip[1].w, n2 = clip[2].xy / clip[2].w;
+    float area = cross2(n1 - n0, n2 - n0);
+    if (abs(area) < 1e-12)
+        area = 1e-12;
+    vec3 screen;
+    screen.y = cross2(p - n0, n2 - n0) / area;
+    screen.z = cross2(n1 - n0, p - n0) / area;
+    screen.x = 1.0 - screen.y - screen.z;
+    vec3 perspective = screen / vec3(clip[0].w, clip[1].w, clip[2].w);
+    perspective /= perspective.x + perspective.y + perspective.z;
+
+    FragPos = world[0] * perspective.x + world[1] * perspective.y + world[2] * perspective.z;
+    Normal = normal[0] * perspective.x + normal[1] * perspective.y + normal[2] * perspective.z;
+    Occlusion = dot(occlusion, perspective);
+    float ndcZ = dot(screen, vec3(clip[0].z / clip[0].w, clip[1].z / clip[1].w, clip[2].z / clip[2].w));
+    FragDepth = ndcZ * 0.5 + 0.5;
+    return true;
+}
+#else
 in vec3 Normal;
 in vec3 FragPos;
+in float Occlusion;   // запечённое затенение окружения статических мешей
+#endif
 
 uniform vec3 viewPos;
 
@@ -23,9 +113,173 @@ struct Light {
 uniform Material material;
 uniform Light light;
 
+// Тени ключевого источника (ShadowMap.h): кэшированная карта статических мешей и карта подвижных.
+// SHADOW_PCF - вариант программы с фильтрацией 5x5, иначе одна выборка
+uniform bool shadowsEnabled;
+uniform mat4 lightViewProj;
+uniform sampler2DShadow staticShadowMap;
+uniform sampler2DShadow dynamicShadowMap;
+
+// Всенаправленный вариант (CubeShadowMap.h): кубическая карта расстояний до источника
+uniform bool cubeShadows;
+uniform samplerCubeShadow pointShadowMap;
+uniform float pointShadowFar;
+
+// Затенение окружения (AmbientOcclusion.h) в полном разрешении, по пикселю кадра
+uniform bool ambientOcclusion;
+uniform sampler2D ambientOcclusionMap;
+
+#ifdef IBL
+// Вариант с освещением окружением (ImageBasedLighting.h) вместо постоянного фонового члена:
+// рассеянное - облучённость в сферических гармониках, зеркальное - предфильтрованная кубическая
+// карта и таблица BRDF (разделённая сумма). Шероховатость выводится из material.shininess
+uniform vec3 iblSh[9];
+uniform samplerCube iblSpecular;
+uniform sampler2D iblBrdf;
+uniform float iblSpecularLevels;
+uniform float iblIntensity;
+
+vec3 shIrradiance(vec3 n) {
+    vec3 e = iblSh[0] * 0.282095
+        + iblSh[1] * 0.488603 * n.y + iblSh[2] * 0.488603 * n.z + iblSh[3] * 0.488603 * n.x
+        + iblSh[4] * 1.092548 * n.x * n.y + iblSh[5] * 1.092548 * n.y * n.z
+        + iblSh[6] * 0.315392 * (3.0 * n.z * n.z - 1.0)
+        + iblSh[7] * 1.092548 * n.x * n.z + iblSh[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(e, vec3(0.0));
+}
+
+vec3 environmentLighting(vec3 norm, vec3 viewDir) {
+    float roughness = clamp(sqrt(2.0 / (material.shininess + 2.0)), 0.0, 1.0);
+    float NdotV = max(dot(norm, viewDir), 1e-4);
+    vec2 brdf = texture(iblBrdf, vec2(NdotV, roughness)).rg;
+    vec3 prefiltered = textureLod(iblSpecular, reflect(-viewDir, norm), roughness * (iblSpecularLevels - 1.0)).rgb;
+    vec3 diffuse = shIrradiance(norm) / 3.14159265 * material.diffuse;
+    vec3 specular = prefiltered * (vec3(0.04) * brdf.x + brdf.y) * material.specular;
+    return (diffuse + specular) * iblIntensity;
+}
+#endif
+
+float cubeShadowVisibility(vec3 norm, vec3 lightDir) {
+    vec3 toFragment = FragPos - light.position;
+    float depth = length(toFragment) / pointShadowFar - 0.002 * (1.0 - max(dot(norm, lightDir), 0.0)) - 0.0005;
+#ifdef SHADOW_PCF
+    // Смещения по осям, перпендикулярным направлению выборки, - около двух текселей грани
+    vec3 axis = abs(toFragment.x) > abs(toFragment.z) ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(toFragment, axis));
+    vec3 bitangent = cross(normalize(toFragment), tangent);
+    float radius = length(toFragment) * 2.0 / float(textureSize(pointShadowMap, 0).x);
+    float sum = 0.0;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+            sum += texture(pointShadowMap, vec4(toFragment + (tangent * float(x) + bitangent * float(y)) * radius, depth));
+    return sum / 9.0;
+#else
+    return texture(pointShadowMap, vec4(toFragment, depth));
+#endif
+}
+
+float shadowSample(vec3 coords, vec2 offset) {
+    vec3 p = vec3(coords.xy + offset, coords.z);
+    return min(texture(staticShadowMap, p), texture(dynamicShadowMap, p));
+}
+
+// Доля света ключевого источника, 0..1
+float keyLightVisibility(vec3 norm, vec3 lightDir) {
+    if (!shadowsEnabled)
+        return 1.0;
+    if (cubeShadows)
+        return cubeShadowVisibility(norm, lightDir);
+    vec4 lightSpace = lightViewProj * vec4(FragPos, 1.0);
+    vec3 coords = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    if (lightSpace.w <= 0.0 || coords.z > 1.0)
+        return 1.0;
+    coords.z -= 0.0005 * (1.0 - max(dot(norm, lightDir), 0.0));
+
+#ifdef SHADOW_PCF
+    vec2 texel = 1.0 / vec2(textureSize(staticShadowMap, 0));
+    float sum = 0.0;
+    for (int y = -2; y <= 2; ++y)
+        for (int x = -2; x <= 2; ++x)
+            sum += shadowSample(coords, vec2(x, y) * texel);
+    return sum / 25.0;
+#else
+    return shadowSample(coords, vec2(0.0));
+#endif
+}
+
+// Точечные источники (рабочие лампы, индикаторы) с кластерным отбором, см. cluster_lights.glsl
+const uvec3 CLUSTER_GRID = uvec3(16, 9, 24);
+
+struct PointLight {
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout(std430, binding = 4) readonly buffer Lights { PointLight pointLights[]; };
+layout(std430, binding = 5) readonly buffer ClusterRanges { uvec2 clusterRanges[]; }; // начало и число индексов
+layout(std430, binding = 6) readonly buffer ClusterIndices { uint clusterIndices[]; };
+
+uniform uint pointLightCount;
+uniform bool clusteredLights;   // false - перебор всех источников (для сравнения)
+uniform vec2 clusterDepthRange; // ближняя и дальняя плоскости
+uniform vec2 screenSize;
+
+vec3 pointLight(PointLight pl, vec3 norm, vec3 viewDir) {
+    vec3 toLight = pl.positionRadius.xyz - FragPos;
+    float dist = length(toLight);
+    float falloff = clamp(1.0 - (dist * dist) / (pl.positionRadius.w * pl.positionRadius.w), 0.0, 1.0);
+    if (falloff <= 0.0)
+        return vec3(0.0);
+
+    vec3 lightDir = toLight / dist;
+    float diff = max(dot(norm, lightDir), 0.0);
+    float spec = pow(max(dot(viewDir, reflect(-lightDir, norm)), 0.0), material.shininess);
+    return pl.color.rgb * (diff * material.diffuse + spec * material.specular) * falloff * falloff;
+}
+
+vec3 pointLighting(vec3 norm, vec3 viewDir) {
+    vec3 result = vec3(0.0);
+    if (!clusteredLights) {
+        for (uint i = 0u; i < pointLightCount; ++i)
+            result += pointLight(pointLights[i], norm, viewDir);
+        return result;
+    }
+
+    // Глубина фрагмента в координатах камеры по перспективной проекции
+    float zNear = clusterDepthRange.x, zFar = clusterDepthRange.y;
+#ifdef VISIBILITY_RESOLVE
+    float ndcZ = FragDepth * 2.0 - 1.0;
+#else
+    float ndcZ = gl_FragCoord.z * 2.0 - 1.0;
+#endif
+    float depth = 2.0 * zNear * zFar / (zFar + zNear - ndcZ * (zFar - zNear));
+
+    uvec2 tile = uvec2(clamp(gl_FragCoord.xy / screenSize * vec2(CLUSTER_GRID.xy), vec2(0.0), vec2(CLUSTER_GRID.xy) - 1.0));
+    uint slice = uint(clamp(log(depth / zNear) / log(zFar / zNear) * float(CLUSTER_GRID.z), 0.0, float(CLUSTER_GRID.z) - 1.0));
+    uint cluster = tile.x + CLUSTER_GRID.x * (tile.y + CLUSTER_GRID.y * slice);
+
+    uvec2 range = clusterRanges[cluster];
+    for (uint i = 0u; i < range.y; ++i)
+        result += pointLight(pointLights[clusterIndices[range.x + i]], norm, viewDir);
+    return result;
+}
+
 void main() {
+#ifdef VISIBILITY_RESOLVE
+    if (!resolveVisibility())
+        discard;
+#endif
+
     // Ambient
-    vec3 ambient = light.ambient * material.ambient;
+    // Запечённое и экранное затенение описывают одно явление, берётся более сильное
+    float occlusion = Occlusion;
+    if (ambientOcclusion)
+        occlusion = min(occlusion, texelFetch(ambientOcclusionMap, ivec2(gl_FragCoord.xy), 0).r);
+#ifdef IBL
+    vec3 ambient = environmentLighting(normalize(Normal), normalize(viewPos - FragPos)) * occlusion;
+#else
+    vec3 ambient = light.ambient * material.ambient * occlusion;
+#endif
     
     // Diffuse 
     vec3 norm = normalize(Normal);
@@ -39,6 +293,8 @@ void main() {
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     vec3 specular = light.specular * (spec * material.specular);  
         
-    vec3 result = ambient + diffuse + specular;
+    vec3 result = ambient + (diffuse + specular) * keyLightVisibility(norm, lightDir);
+    if (pointLightCount > 0u)
+        result += pointLighting(norm, viewDir);
     FragColor = vec4(result, 1.0);
 }
@@ -0,0 +1,34 @@
+#version 460 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// level == 0: копирование буфера глубины в нулевой уровень пирамиды
+// level > 0: максимум по блоку 2x2 (3x3 на нечётных краях) предыдущего уровня
+layout(r32f, binding = 0) uniform readonly image2D srcLevel;
+layout(r32f, binding = 1) uniform writeonly image2D dstLevel;
+
+uniform sampler2D depthTexture;
+uniform int level;
+
+void main() {
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(dstLevel);
+    if (dst.x >= dstSize.x || dst.y >= dstSize.y)
+        return;
+
+    if (level == 0) {
+        imageStore(dstLevel, dst, vec4(texelFetch(depthTexture, dst, 0).r));
+        return;
+    }
+
+    ivec2 srcSize = imageSize(srcLevel);
+    ivec2 src = dst * 2;
+    int extraX = (srcSize.x & 1) != 0 && dst.x == dstSize.x - 1 ? 1 : 0;
+    int extraY = (srcSize.y & 1) != 0 && dst.y == dstSize.y - 1 ? 1 : 0;
+
+    float depth = 0.0;
+    for (int y = 0; y <= 1 + extraY; ++y)
+        for (int x = 0; x <= 1 + extraX; ++x)
+            depth = max(depth, imageLoad(srcLevel, min(src + ivec2(x, y), srcSize - 1)).r);
+
+    imageStore(dstLevel, dst, vec4(depth));
+}
@@ -0,0 +1,124 @@
+#version 460 core
+layout(local_size_x = 64) in;
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Bounds { vec4 bounds[]; };        // min, max на объект
+layout(std430, binding = 1) readonly buffer Transforms { mat4 transforms[]; };
+layout(std430, binding = 2) buffer Commands { DrawCommand commands[]; };      // [0, n) - фаза 1, [n, 2n) - фаза 2
+layout(std430, binding = 3) buffer Stats {
+    uint totalDraws;
+    uint totalTriangles;
+    uint frustumDraws;
+    uint frustumTriangles;
+    uint occludedDraws;
+    uint occludedTriangles;
+    uint secondPassDraws;
+    uint secondPassTriangles;
+};
+
+uniform sampler2D hiZ;
+uniform vec2 hiZSize;
+uniform int hiZLevels;
+uniform bool hiZValid;
+
+uniform mat4 viewProj;
+uniform mat4 prevViewProj;
+uniform uint objectCount;
+uniform int phase;
+
+// Экранный прямоугольник и ближайшая глубина объекта; false, если объект пересекает ближнюю плоскость
+bool projectBounds(mat4 mvp, vec3 bmin, vec3 bmax, out vec2 uvMin, out vec2 uvMax, out float depthMin) {
+    uvMin = vec2(1.0);
+    uvMax = vec2(0.0);
+    depthMin = 1.0;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = vec3((i & 1) != 0 ? bmax.x : bmin.x,
+                           (i & 2) != 0 ? bmax.y : bmin.y,
+                           (i & 4) != 0 ? bmax.z : bmin.z);
+        vec4 clip = mvp * vec4(corner, 1.0);
+        if (clip.w <= 1e-4)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        depthMin = min(depthMin, ndc.z * 0.5 + 0.5);
+    }
+    return true;
+}
+
+bool outsideFrustum(mat4 mvp, vec3 bmin, vec3 bmax) {
+    vec2 uvMin, uvMax;
+    float depthMin;
+    if (!projectBounds(mvp, bmin, bmax, uvMin, uvMax, depthMin))
+        return false;
+    return any(greaterThan(uvMin, vec2(1.0))) || any(lessThan(uvMax, vec2(0.0))) || depthMin > 1.0;
+}
+
+bool occluded(mat4 mvp, vec3 bmin, vec3 bmax) {
+    vec2 uvMin, uvMax;
+    float depthMin;
+    if (!projectBounds(mvp, bmin, bmax, uvMin, uvMax, depthMin))
+        return false;
+
+    uvMin = clamp(uvMin, 0.0, 1.0);
+    uvMax = clamp(uvMax, 0.0, 1.0);
+    vec2 extent = (uvMax - uvMin) * hiZSize;
+    int level = clamp(int(ceil(log2(max(max(extent.x, extent.y) * 0.5, 1.0)))), 0, hiZLevels - 1);
+
+    ivec2 levelSize = max(ivec2(hiZSize) >> level, ivec2(1));
+    ivec2 p0 = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 p1 = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float depthMax = 0.0;
+    for (int y = p0.y; y <= p1.y; ++y)
+        for (int x = p0.x; x <= p1.x; ++x)
+            depthMax = max(depthMax, texelFetch(hiZ, ivec2(x, y), level).r);
+
+    return depthMin > depthMax;
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= objectCount)
+        return;
+
+    vec3 bmin = bounds[2 * i].xyz;
+    vec3 bmax = bounds[2 * i + 1].xyz;
+    mat4 model = transforms[i];
+    uint triangles = commands[i].count / 3;
+    bool inFrustum = !outsideFrustum(viewProj * model, bmin, bmax);
+
+    if (phase == 0) {
+        // Фаза 1: глубина прошлого кадра, объект репроецируется прошлой матрицей камеры
+        bool visible = inFrustum && (!hiZValid || !occluded(prevViewProj * model, bmin, bmax));
+        commands[i].instanceCount = visible ? 1u : 0u;
+        return;
+    }
+
+    // Фаза 2: объекты, отброшенные в фазе 1, проверяются по пирамиде текущего кадра
+    bool drawnFirst = commands[i].instanceCount != 0u;
+    bool visible = !drawnFirst && inFrustum && !occluded(viewProj * model, bmin, bmax);
+    commands[objectCount + i].instanceCount = visible ? 1u : 0u;
+
+    atomicAdd(totalDraws, 1u);
+    atomicAdd(totalTriangles, triangles);
+    if (!inFrustum) {
+        atomicAdd(frustumDraws, 1u);
+        atomicAdd(frustumTriangles, triangles);
+    }
+    else if (!drawnFirst && !visible) {
+        atomicAdd(occludedDraws, 1u);
+        atomicAdd(occludedTriangles, triangles);
+    }
+    if (visible) {
+        atomicAdd(secondPassDraws, 1u);
+        atomicAdd(secondPassTriangles, triangles);
+    }
+}
@@ -0,0 +1,45 @@
+#version 460 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Таблица BRDF для разделённой суммы (ImageBasedLighting.h): по (N·V, шероховатость) -
+// масштаб и смещение к F0 для GGX со Смитом (k = a / 2)
+layout(rg16f, binding = 0) uniform writeonly image2D brdfOutput;
+
+uniform int lutSize;
+uniform int sampleCount;
+
+const float PI = 3.14159265;
+
+float geometrySmith(float NdotV, float NdotL, float a) {
+    float k = a / 2.0;
+    return NdotV / (NdotV * (1.0 - k) + k) * (NdotL / (NdotL * (1.0 - k) + k));
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= lutSize || texel.y >= lutSize)
+        return;
+    float NdotV = (float(texel.x) + 0.5) / float(lutSize);
+    float roughness = (float(texel.y) + 0.5) / float(lutSize);
+    float a = roughness * roughness;
+    vec3 v = vec3(sqrt(1.0 - NdotV * NdotV), 0.0, NdotV);
+
+    vec2 result = vec2(0.0);
+    for (uint i = 0u; i < uint(sampleCount); ++i) {
+        vec2 xi = vec2((float(i) + 0.5) / float(sampleCount), float(bitfieldReverse(i)) * 2.3283064e-10);
+        float phi = 2.0 * PI * xi.y;
+        float cosTheta = sqrt((1.0 - xi.x) / (1.0 + (a * a - 1.0) * xi.x));
+        float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+        vec3 h = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+        vec3 l = 2.0 * dot(v, h) * h - v;
+        float NdotL = max(l.z, 0.0);
+        float NdotH = max(h.z, 0.0);
+        float VdotH = max(dot(v, h), 0.0);
+        if (NdotL <= 0.0)
+            continue;
+        float visibility = geometrySmith(NdotV, NdotL, a) * VdotH / (NdotH * NdotV);
+        float fresnel = pow(1.0 - VdotH, 5.0);
+        result += vec2((1.0 - fresnel) * visibility, fresnel * visibility);
+    }
+    imageStore(brdfOutput, texel, vec4(result / float(sampleCount), 0.0, 0.0));
+}
@@ -0,0 +1,58 @@
+#version 460 core
+layout(local_size_x = 256) in;
+
+// Облучённость окружения в сферических гармониках второго порядка (ImageBasedLighting.h).
+// Одна рабочая группа: потоки проходят развёртку с шагом 256 и суммируют проекции с весом
+// телесного угла тексела, затем суммы сводятся в разделяемой памяти. Результат уже свёрнут
+// с косинусом: E(n) = сумма shOutput[i] * Y_i(n)
+layout(binding = 0) uniform sampler2D environmentMap;   // равнопромежуточная развёртка
+layout(std430, binding = 14) writeonly buffer IblSh {
+    vec4 shOutput[9];
+};
+
+const float PI = 3.14159265;
+
+shared vec3 partial[256];
+
+void main() {
+    ivec2 size = textureSize(environmentMap, 0);
+    uint thread = gl_LocalInvocationIndex;
+    vec3 sh[9];
+    for (int i = 0; i < 9; ++i)
+        sh[i] = vec3(0.0);
+
+    for (uint texel = thread; texel < uint(size.x * size.y); texel += 256u) {
+        ivec2 pixel = ivec2(texel % uint(size.x), texel / uint(size.x));
+        float theta = (float(pixel.y) + 0.5) / float(size.y) * PI;
+        float phi = ((float(pixel.x) + 0.5) / float(size.x) - 0.5) * 2.0 * PI;
+        vec3 n = vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+        float weight = sin(theta) * (PI / float(size.y)) * (2.0 * PI / float(size.x));
+        vec3 radiance = texelFetch(environmentMap, pixel, 0).rgb * weight;
+
+        sh[0] += radiance * 0.282095;
+        sh[1] += radiance * 0.488603 * n.y;
+        sh[2] += radiance * 0.488603 * n.z;
+        sh[3] += radiance * 0.488603 * n.x;
+        sh[4] += radiance * 1.092548 * n.x * n.y;
+        sh[5] += radiance * 1.092548 * n.y * n.z;
+        sh[6] += radiance * 0.315392 * (3.0 * n.z * n.z - 1.0);
+        sh[7] += radiance * 1.092548 * n.x * n.z;
+        sh[8] += radiance * 0.546274 * (n.x * n.x - n.y * n.y);
+    }
+
+    // Свёртка с косинусом по полосам: pi, 2pi/3, pi/4
+    const float band[9] = float[9](PI, 2.0 * PI / 3.0, 2.0 * PI / 3.0, 2.0 * PI / 3.0,
+        PI / 4.0, PI / 4.0, PI / 4.0, PI / 4.0, PI / 4.0);
+    for (int i = 0; i < 9; ++i) {
+        partial[thread] = sh[i];
+        barrier();
+        for (uint stride = 128u; stride > 0u; stride >>= 1) {
+            if (thread < stride)
+                partial[thread] += partial[thread + stride];
+            barrier();
+        }
+        if (thread == 0u)
+            shOutput[i] = vec4(partial[0] * band[i], 0.0);
+        barrier();
+    }
+}
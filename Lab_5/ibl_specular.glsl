@@ -0,0 +1,74 @@
+#version 460 core
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+// Предфильтрованная зеркальная карта (ImageBasedLighting.h): уровень mip кубической карты
+// для шероховатости roughness. Выборки по значимости распределения GGX при N = V = R;
+// каждая берётся из уровня развёртки, соответствующего её телесному углу, что убирает шум
+// при небольшом числе выборок
+layout(binding = 0) uniform sampler2D environmentMap;   // равнопромежуточная развёртка с mip-уровнями
+layout(rgba16f, binding = 0) uniform writeonly imageCube specularOutput;
+
+uniform int faceSize;      // размер грани на этом уровне
+uniform float roughness;
+uniform int sampleCount;
+
+const float PI = 3.14159265;
+
+vec3 faceDirection(int face, vec2 uv) {
+    uv = uv * 2.0 - 1.0;
+    if (face == 0) return vec3(1.0, -uv.y, -uv.x);
+    if (face == 1) return vec3(-1.0, -uv.y, uv.x);
+    if (face == 2) return vec3(uv.x, 1.0, uv.y);
+    if (face == 3) return vec3(uv.x, -1.0, -uv.y);
+    if (face == 4) return vec3(uv.x, -uv.y, 1.0);
+    return vec3(-uv.x, -uv.y, -1.0);
+}
+
+vec3 sampleEnvironment(vec3 d, float lod) {
+    vec2 uv = vec2(atan(d.z, d.x) / (2.0 * PI) + 0.5, acos(clamp(d.y, -1.0, 1.0)) / PI);
+    return textureLod(environmentMap, uv, lod).rgb;
+}
+
+vec2 hammersley(uint i, uint count) {
+    return vec2((float(i) + 0.5) / float(count), float(bitfieldReverse(i)) * 2.3283064e-10);
+}
+
+void main() {
+    ivec3 texel = ivec3(gl_GlobalInvocationID);
+    if (texel.x >= faceSize || texel.y >= faceSize)
+        return;
+    vec3 n = normalize(faceDirection(texel.z, (vec2(texel.xy) + 0.5) / float(faceSize)));
+    if (roughness <= 0.0) {
+        imageStore(specularOutput, texel, vec4(sampleEnvironment(n, 0.0), 1.0));
+        return;
+    }
+
+    vec3 helper = abs(n.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(helper, n));
+    vec3 bitangent = cross(n, tangent);
+    ivec2 environmentSize = textureSize(environmentMap, 0);
+    float texelSolidAngle = 4.0 * PI / float(environmentSize.x * environmentSize.y);
+    float a = roughness * roughness;
+
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (uint i = 0u; i < uint(sampleCount); ++i) {
+        vec2 xi = hammersley(i, uint(sampleCount));
+        float phi = 2.0 * PI * xi.y;
+        float cosTheta = sqrt((1.0 - xi.x) / (1.0 + (a * a - 1.0) * xi.x));
+        float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+        vec3 h = tangent * (cos(phi) * sinTheta) + bitangent * (sin(phi) * sinTheta) + n * cosTheta;
+        vec3 l = 2.0 * dot(n, h) * h - n;
+        float NdotL = dot(n, l);
+        if (NdotL <= 0.0)
+            continue;
+
+        // pdf(l) = D(h) / 4 при N = V
+        float d = a * a / (PI * pow(cosTheta * cosTheta * (a * a - 1.0) + 1.0, 2.0));
+        float sampleSolidAngle = 4.0 / (float(sampleCount) * d + 1e-4);
+        float lod = max(0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0, 0.0);
+        sum += sampleEnvironment(l, lod) * NdotL;
+        weightSum += NdotL;
+    }
+    imageStore(specularOutput, texel, vec4(sum / max(weightSum, 1e-4), 1.0));
+}
@@ -0,0 +1,40 @@
+#version 460 core
+#extension GL_ARB_shader_viewport_layer_array : require
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+layout(location = 2) in float aOcclusion;
+
+// Один вызов на несколько видов (MultiView.h): экземпляр выбирает вид из списка меша,
+// вид задаёт матрицу и слой или область вывода
+out vec3 FragPos;
+out vec3 Normal;
+out float Occlusion;
+
+struct MultiViewView {
+    mat4 viewProjection;
+    int target;
+    int pad0;
+    int pad1;
+    int pad2;
+};
+layout(std430, binding = 12) readonly buffer MultiViewViews {
+    MultiViewView views[];
+};
+layout(std430, binding = 13) readonly buffer MultiViewLists {
+    uint viewIndices[];
+};
+
+uniform mat4 model;
+uniform bool toViewports;
+
+void main() {
+    MultiViewView view = views[viewIndices[gl_BaseInstance + gl_InstanceID]];
+    FragPos = vec3(model * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Occlusion = aOcclusion;
+    gl_Position = view.viewProjection * vec4(FragPos, 1.0);
+    if (toViewports)
+        gl_ViewportIndex = view.target;
+    else
+        gl_Layer = view.target;
+}
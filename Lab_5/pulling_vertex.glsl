@@ -0,0 +1,65 @@
+#version 460 core
+
+// Программная выборка вершин (VertexPulling.h): атрибуты читаются из SSBO, VAO пустой
+out vec3 FragPos;
+out vec3 Normal;
+out float Occlusion;   // запечённое затенение, байт на вершину за словами вершин
+
+invariant gl_Position;
+
+const uint FORMAT_FULL = 0u;    // позиция и нормаль, 6 слов
+const uint FORMAT_COMPACT = 1u; // позиция и нормаль snorm16x2 в октаэдрической развёртке, 4 слова
+
+layout(std430, binding = 10) readonly buffer PulledVertices {
+    uint vertexWords[];
+};
+
+struct PulledDraw {
+    mat4 world;
+    mat4 normalMatrix;
+    uint firstWord;
+    uint format;
+    uint occlusionByte;
+    uint pad;
+};
+layout(std430, binding = 11) readonly buffer PulledDraws {
+    PulledDraw draws[];
+};
+
+uniform mat4 view;
+uniform mat4 projection;
+
+layout(std140, binding = 0) uniform LateLatch {
+    mat4 latchedView;
+};
+uniform bool lateLatched;
+
+vec3 octDecode(vec2 p) {
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+void main() {
+    PulledDraw draw = draws[gl_DrawID];
+    uint vertex = uint(gl_VertexID - gl_BaseVertex);
+    vec3 position;
+    vec3 normal;
+    if (draw.format == FORMAT_COMPACT) {
+        uint word = draw.firstWord + vertex * 4u;
+        position = uintBitsToFloat(uvec3(vertexWords[word], vertexWords[word + 1u], vertexWords[word + 2u]));
+        normal = octDecode(unpackSnorm2x16(vertexWords[word + 3u]));
+    }
+    else {
+        uint word = draw.firstWord + vertex * 6u;
+        position = uintBitsToFloat(uvec3(vertexWords[word], vertexWords[word + 1u], vertexWords[word + 2u]));
+        normal = uintBitsToFloat(uvec3(vertexWords[word + 3u], vertexWords[word + 4u], vertexWords[word + 5u]));
+    }
+
+    FragPos = vec3(draw.world * vec4(position, 1.0));
+    Normal = mat3(draw.normalMatrix) * normal;
+    uint occlusionAt = draw.occlusionByte + vertex;
+    Occlusion = float((vertexWords[occlusionAt >> 2] >> ((occlusionAt & 3u) * 8u)) & 0xFFu) / 255.0;
+    gl_Position = projection * (lateLatched ? latchedView : view) * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,38 @@
+#version 460 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Накопление затенения окружения по кадрам: история берётся по положению точки в прошлом кадре
+// и отбрасывается при выходе за кадр или расхождении глубины (открывшиеся области)
+layout(binding = 0) uniform sampler2D currentAo;   // (ao, линейная глубина)
+layout(binding = 1) uniform sampler2D historyAo;
+layout(rg16f, binding = 0) uniform writeonly image2D aoOutput;
+
+uniform vec2 outputSize;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+uniform mat4 previousViewProjection;
+uniform bool historyValid;
+uniform float blend;       // вес нового кадра
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, ivec2(outputSize))))
+        return;
+
+    vec2 current = texelFetch(currentAo, pixel, 0).rg;
+    float result = current.r;
+    if (historyValid && current.g < 1e4) {
+        vec2 uv = (vec2(pixel) + 0.5) / outputSize;
+        vec4 ray = inverseProjection * vec4(uv * 2.0 - 1.0, 1.0, 1.0);
+        vec3 viewPos = ray.xyz / ray.w;
+        viewPos *= current.g / -viewPos.z;
+        vec4 previous = previousViewProjection * (inverseView * vec4(viewPos, 1.0));
+        vec2 previousUv = previous.xy / previous.w * 0.5 + 0.5;
+        if (previous.w > 0.0 && all(greaterThanEqual(previousUv, vec2(0.0))) && all(lessThanEqual(previousUv, vec2(1.0)))) {
+            vec2 history = textureLod(historyAo, previousUv, 0.0).rg;
+            if (abs(history.g - previous.w) < 0.05 * previous.w)
+                result = mix(history.r, current.r, blend);
+        }
+    }
+    imageStore(aoOutput, pixel, vec4(result, current.g, 0.0, 0.0));
+}
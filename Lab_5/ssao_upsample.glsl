@@ -0,0 +1,41 @@
+#version 460 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Повышение разрешения затенения окружения с учётом глубины: четыре ближайших отсчёта
+// пониженного разрешения взвешиваются билинейно и по близости их глубины к глубине пикселя,
+// поэтому затенение не перетекает через края деталей
+layout(binding = 0) uniform sampler2D depthMap;   // полное разрешение
+layout(binding = 1) uniform sampler2D lowAo;      // (ao, линейная глубина)
+layout(r8, binding = 0) uniform writeonly image2D aoOutput;
+
+uniform vec2 outputSize;   // размер кадра
+uniform vec2 lowSize;
+uniform vec2 uvScale;      // доля текстуры глубины, занятая кадром
+uniform mat4 inverseProjection;
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, ivec2(outputSize))))
+        return;
+
+    vec2 uv = (vec2(pixel) + 0.5) / outputSize;
+    float depth = textureLod(depthMap, uv * uvScale, 0.0).r;
+    vec4 position = inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    float linearDepth = -position.z / position.w;
+
+    vec2 lowPosition = uv * lowSize - 0.5;
+    ivec2 base = ivec2(floor(lowPosition));
+    vec2 f = lowPosition - vec2(base);
+    float sum = 0.0, weightSum = 0.0;
+    for (int y = 0; y <= 1; ++y)
+        for (int x = 0; x <= 1; ++x) {
+            ivec2 tap = clamp(base + ivec2(x, y), ivec2(0), ivec2(lowSize) - 1);
+            vec2 value = texelFetch(lowAo, tap, 0).rg;
+            float bilinear = (x == 1 ? f.x : 1.0 - f.x) * (y == 1 ? f.y : 1.0 - f.y);
+            float similarity = 1.0 / (1e-3 + abs(value.g - linearDepth) / max(linearDepth, 1e-4));
+            float weight = max(bilinear, 1e-3) * similarity;
+            sum += value.r * weight;
+            weightSum += weight;
+        }
+    imageStore(aoOutput, pixel, vec4(weightSum > 0.0 ? sum / weightSum : 1.0));
+}
@@ -0,0 +1,33 @@
+#version 460 core
+out vec4 FragColor;
+
+// Масштабирование кадра пониженного разрешения до размера окна (DynamicResolution.h):
+// билинейная выборка и повышение резкости по соседям крестом, ограниченное их минимумом и максимумом,
+// чтобы не появлялись ореолы
+uniform sampler2D sceneColor;
+uniform vec2 renderSize;  // занятая часть текстуры, пиксели
+uniform vec2 outputSize;
+uniform float sharpness;  // 0 - только билинейная фильтрация
+
+void main() {
+    vec2 textureSizeInv = 1.0 / vec2(textureSize(sceneColor, 0));
+    vec2 position = gl_FragCoord.xy / outputSize * renderSize;
+    position = clamp(position, vec2(0.5), renderSize - 0.5);
+    vec2 uv = position * textureSizeInv;
+
+    vec3 center = texture(sceneColor, uv).rgb;
+    if (sharpness <= 0.0) {
+        FragColor = vec4(center, 1.0);
+        return;
+    }
+
+    vec3 left = texture(sceneColor, (max(position - vec2(1.0, 0.0), vec2(0.5))) * textureSizeInv).rgb;
+    vec3 right = texture(sceneColor, (min(position + vec2(1.0, 0.0), renderSize - 0.5)) * textureSizeInv).rgb;
+    vec3 down = texture(sceneColor, (max(position - vec2(0.0, 1.0), vec2(0.5))) * textureSizeInv).rgb;
+    vec3 up = texture(sceneColor, (min(position + vec2(0.0, 1.0), renderSize - 0.5)) * textureSizeInv).rgb;
+
+    vec3 low = min(center, min(min(left, right), min(down, up)));
+    vec3 high = max(center, max(max(left, right), max(down, up)));
+    vec3 sharpened = center + (4.0 * center - left - right - down - up) * 0.25 * sharpness;
+    FragColor = vec4(clamp(sharpened, low, high), 1.0);
+}
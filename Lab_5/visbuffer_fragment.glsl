@@ -0,0 +1,9 @@
+#version 460 core
+layout(location = 0) out uint visibility;
+
+// Номер треугольника в общей нумерации экземпляров; 0 остаётся у пустых пикселей
+uniform uint triangleBase;
+
+void main() {
+    visibility = triangleBase + uint(gl_PrimitiveID);
+}
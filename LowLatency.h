@@ -0,0 +1,125 @@
+#ifndef LOW_LATENCY_H
+#define LOW_LATENCY_H
+
+#include <deque>
+#include <algorithm>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// Ограничение очереди кадров и позднее защёлкивание матрицы вида.
+// Число кадров в очереди драйвера ограничивается заборами (glFenceSync): новый кадр не начинается,
+// пока не выполнены все, кроме maxFramesInFlight - 1 предыдущих. Шейдер читает матрицу вида
+// из постоянно отображённого uniform-буфера (кольцо из RING_SIZE слотов, чтобы не перезаписать
+// данные ещё не выполненного кадра). Матрица по вводу, прочитанному как можно позже, пишется
+// в слот кадра один раз - перед первым проходом, который её читает, - и до конца кадра не меняется:
+// иначе уже отправленные проходы и следующие за ними могли бы увидеть разные матрицы.
+// Задержка ввод-вывод измеряется от времени события ввода до выполнения кадра на GPU.
+class LowLatency {
+public:
+    static const int RING_SIZE = 3;
+    static const unsigned int BINDING = 0; // layout(binding = 0) uniform LateLatch
+
+    struct Stats {
+        unsigned int frames = 0;        // кадров с новым вводом
+        double averageMs = 0.0;
+        double maxMs = 0.0;
+        unsigned int framesInFlight = 0;
+    };
+
+    LowLatency(int maxFramesInFlight = 1)
+        : maxFramesInFlight(std::max(1, std::min(maxFramesInFlight, RING_SIZE))) {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        slotSize = ((GLsizeiptr)sizeof(glm::mat4) + alignment - 1) / alignment * alignment;
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferStorage(GL_UNIFORM_BUFFER, slotSize * RING_SIZE, NULL, flags);
+        mapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, slotSize * RING_SIZE, flags);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void SetMaxFramesInFlight(int count) {
+        maxFramesInFlight = std::max(1, std::min(count, RING_SIZE));
+    }
+
+    // Начало кадра: сбор выполненных кадров и ожидание, если в очереди их слишком много
+    void BeginFrame() {
+        collect(false);
+        while ((int)inFlight.size() >= maxFramesInFlight)
+            collect(true);
+    }
+
+    // Запись матрицы вида в слот кадра; один раз за кадр, до первого читающего её прохода
+    void LatchView(const glm::mat4& view) {
+        if (latched)
+            return;
+        latched = true;
+        char* slot = mapped + slotSize * current;
+        std::copy((const char*)&view[0][0], (const char*)&view[0][0] + sizeof(glm::mat4), slot);
+        if (boundSlot != current) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, buffer, slotSize * current, sizeof(glm::mat4));
+            boundSlot = current;
+        }
+    }
+
+    // Конец кадра (после SwapBuffers); inputTime - время события ввода, учтённого в кадре
+    // (glfwGetTime), или отрицательное значение, если нового ввода не было
+    void EndFrame(double inputTime) {
+        inFlight.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), inputTime });
+        current = (current + 1) % RING_SIZE;
+        latched = false;
+    }
+
+    // Статистика с прошлого вызова
+    Stats TakeStats() {
+        Stats stats = period;
+        if (stats.frames > 0)
+            stats.averageMs /= stats.frames;
+        stats.framesInFlight = (unsigned int)inFlight.size();
+        period = Stats();
+        return stats;
+    }
+
+private:
+    struct Frame {
+        GLsync fence;
+        double inputTime;
+    };
+
+    int maxFramesInFlight;
+    unsigned int buffer = 0;
+    char* mapped = nullptr;
+    GLsizeiptr slotSize = 0;
+    int current = 0;
+    int boundSlot = -1;
+    bool latched = false;   // слот текущего кадра уже записан
+    std::deque<Frame> inFlight;
+    Stats period;
+
+    // Снятие выполненных заборов; wait - ждать самый старый
+    void collect(bool wait) {
+        while (!inFlight.empty()) {
+            Frame& frame = inFlight.front();
+            GLuint64 timeout = wait ? 1000000000ull : 0;
+            GLenum result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if (result == GL_TIMEOUT_EXPIRED)
+                return;
+
+            if (frame.inputTime >= 0.0) {
+                double latencyMs = (glfwGetTime() - frame.inputTime) * 1000.0;
+                period.frames++;
+                period.averageMs += latencyMs;
+                period.maxMs = std::max(period.maxMs, latencyMs);
+            }
+
+            glDeleteSync(frame.fence);
+            inFlight.pop_front();
+            wait = false;
+        }
+    }
+};
+
+#endif // LOW_LATENCY_H
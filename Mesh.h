@@ -2,6 +2,8 @@
 #define MESH_H
 
 #include <vector>
+#include <cstddef>
+#include <algorithm>
 #include <glm.hpp>
 #include "Shader.h"
 
@@ -10,51 +12,175 @@ struct Vertex {
     glm::vec3 Normal;
 };
 
+// Буферы создаются через DSA с неизменяемым хранилищем. Формат вершин отделён от буферов:
+// на каждый формат один общий VAO (FormatVAO), между отрисовками меняются только привязки
+// буферов вершин и индексов (BindBuffers).
+// Запечённое затенение окружения (AmbientOcclusionBaker.h) - отдельный поток по байту на вершину
+// в точке привязки 1 формата FORMAT_VERTEX; до запекания все значения 1.0.
 class Mesh {
 public:
+    enum VertexFormat {
+        FORMAT_VERTEX,   // полный Vertex: позиция (0), нормаль (1) и затенение (2, поток OcclusionBuffer)
+        FORMAT_POSITION  // только позиция (0), плотно упакованная (см. CreatePositionStream)
+    };
+
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
-    unsigned int VAO;
+
+    // Ограничивающий объём в локальных координатах
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
 
     Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices)
         : vertices(vertices), indices(indices) {
+        computeBounds();
         setupMesh();
     }
 
     void Draw(Shader& shader) {
-        glBindVertexArray(VAO);
+        BindBuffers(FORMAT_VERTEX);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
     }
 
-private:
-    unsigned int VBO, EBO;
+    void DrawInstanced(int instanceCount) {
+        BindBuffers(FORMAT_VERTEX);
+        glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
+        glBindVertexArray(0);
+    }
 
-    void setupMesh() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+    // Отрисовка по команде из привязанного GL_DRAW_INDIRECT_BUFFER
+    void DrawIndirect(size_t commandOffset) {
+        BindBuffers(FORMAT_VERTEX);
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commandOffset);
+        glBindVertexArray(0);
+    }
+
+    // Общий VAO формата; создаётся при первом обращении на потоке с GL-контекстом
+    static unsigned int FormatVAO(VertexFormat format) {
+        static unsigned int vaos[2] = {};
+        unsigned int& vao = vaos[format];
+        if (vao)
+            return vao;
+
+        glCreateVertexArrays(1, &vao);
+        glEnableVertexArrayAttrib(vao, 0);
+        glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position));
+        glVertexArrayAttribBinding(vao, 0, 0);
+        if (format == FORMAT_VERTEX) {
+            glEnableVertexArrayAttrib(vao, 1);
+            glVertexArrayAttribFormat(vao, 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal));
+            glVertexArrayAttribBinding(vao, 1, 0);
+            glEnableVertexArrayAttrib(vao, 2);
+            glVertexArrayAttribFormat(vao, 2, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0);
+            glVertexArrayAttribBinding(vao, 2, 1);
+        }
+        return vao;
+    }
 
-        glBindVertexArray(VAO);
+    static GLsizei FormatStride(VertexFormat format) {
+        return format == FORMAT_VERTEX ? sizeof(Vertex) : sizeof(glm::vec3);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-            &vertices[0], GL_STATIC_DRAW);
+    // Буфер вершин в формате format (FORMAT_POSITION - поток позиций, если создан)
+    unsigned int FormatBuffer(VertexFormat format) const {
+        return format == FORMAT_POSITION && positionVBO ? positionVBO : VBO;
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-            &indices[0], GL_STATIC_DRAW);
+    // Привязка общего VAO формата и буферов меша к нему
+    void BindBuffers(VertexFormat format) const {
+        if (format == FORMAT_POSITION && !positionVBO)
+            format = FORMAT_VERTEX;
+        unsigned int vao = FormatVAO(format);
+        glBindVertexArray(vao);
+        glVertexArrayVertexBuffer(vao, 0, FormatBuffer(format), 0, FormatStride(format));
+        if (format == FORMAT_VERTEX)
+            glVertexArrayVertexBuffer(vao, 1, occlusionVBO, 0, 1);
+        glVertexArrayElementBuffer(vao, EBO);
+    }
 
-        // Позиции вершин
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // Отдельный поток позиций для проходов только по глубине (предварительный проход, тени):
+    // 12 байт на вершину вместо полного Vertex, индексный буфер общий с основным
+    void CreatePositionStream() {
+        if (positionVBO)
+            return;
 
-        // Нормали
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-            (void*)offsetof(Vertex, Normal));
+        std::vector<glm::vec3> positions(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+            positions[i] = vertices[i].Position;
 
-        glBindVertexArray(0);
+        glCreateBuffers(1, &positionVBO);
+        glNamedBufferStorage(positionVBO, std::max<size_t>(positions.size(), 1) * sizeof(glm::vec3),
+            positions.empty() ? NULL : positions.data(), 0);
+    }
+
+    bool HasPositionStream() const {
+        return positionVBO != 0;
+    }
+
+    // Буферы вершин (Vertex) и индексов, например для чтения из шейдера как SSBO
+    unsigned int VertexBuffer() const {
+        return VBO;
+    }
+
+    unsigned int IndexBuffer() const {
+        return EBO;
+    }
+
+    // Поток затенения: байт на вершину, 255 - открыто
+    unsigned int OcclusionBuffer() const {
+        return occlusionVBO;
+    }
+
+    // Запечённые значения по вершине; копии меша с общей геометрией видят их же
+    void SetOcclusion(const std::vector<unsigned char>& occlusion) {
+        if (occlusion.size() == vertices.size() && !occlusion.empty()) {
+            glNamedBufferSubData(occlusionVBO, 0, occlusion.size(), occlusion.data());
+            occlusionVersion++;
+        }
+    }
+
+    // Счётчик изменений потока затенения: по нему обновляют свои копии общие SSBO путей отрисовки
+    unsigned int OcclusionVersion() const {
+        return occlusionVersion;
+    }
+
+    // Копия меша с общей геометрией получает тот же поток позиций
+    void SharePositionStream(const Mesh& source) {
+        positionVBO = source.positionVBO;
+    }
+
+private:
+    unsigned int VBO = 0, EBO = 0;
+    unsigned int positionVBO = 0;
+    unsigned int occlusionVBO = 0;
+    unsigned int occlusionVersion = 0;
+
+    void computeBounds() {
+        aabbMin = glm::vec3(0.0f);
+        aabbMax = glm::vec3(0.0f);
+        if (vertices.empty())
+            return;
+
+        aabbMin = aabbMax = vertices[0].Position;
+        for (const Vertex& v : vertices) {
+            aabbMin = glm::min(aabbMin, v.Position);
+            aabbMax = glm::max(aabbMax, v.Position);
+        }
+    }
+
+    void setupMesh() {
+        glCreateBuffers(1, &VBO);
+        glNamedBufferStorage(VBO, std::max<size_t>(vertices.size(), 1) * sizeof(Vertex),
+            vertices.empty() ? NULL : vertices.data(), 0);
+
+        glCreateBuffers(1, &EBO);
+        glNamedBufferStorage(EBO, std::max<size_t>(indices.size(), 1) * sizeof(unsigned int),
+            indices.empty() ? NULL : indices.data(), 0);
+
+        std::vector<unsigned char> open(std::max<size_t>(vertices.size(), 1), 255);
+        glCreateBuffers(1, &occlusionVBO);
+        glNamedBufferStorage(occlusionVBO, open.size(), open.data(), GL_DYNAMIC_STORAGE_BIT);
     }
 };
 
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <glm.hpp>
 #include <matrix_transform.hpp>
 #include <assimp/Importer.hpp>
@@ -10,22 +11,150 @@
 #include <assimp/postprocess.h>
 #include "Mesh.h"
 #include "Shader.h"
+#include "DuplicateGeometry.h"
+#include "JobSystem.h"
+#include "CommandBuffer.h"
 
 class Model {
 public:
     std::vector<Mesh> meshes;
     std::vector<glm::mat4> meshTransforms;
+    std::vector<int> meshGeometry;            // меш, чьи буферы используются (повторы ссылаются на первый)
+    std::vector<glm::mat4> meshBaseTransforms; // переход из координат общей геометрии в исходное положение
+    std::vector<char> meshVisible; // результат отсечения на процессоре
+    std::vector<unsigned int> meshQueries; // запрос видимости для условной отрисовки, 0 - нет
+    std::vector<char> meshStatic; // меш никогда не двигается (задаёт приложение)
+    unsigned int occlusionQueryMinTriangles = 1000;
     std::string directory;
 
-    Model(std::string const& path) {
+    // С планировщиком разбор мешей Assimp и поиск повторов идут параллельно;
+    // буферы создаются на вызывающем потоке, владеющем GL-контекстом
+    Model(std::string const& path, JobSystem* jobs = nullptr) : jobs(jobs) {
         loadModel(path);
         meshTransforms.resize(meshes.size(), glm::mat4(1.0f));
+        meshVisible.resize(meshes.size(), 1);
+        meshQueries.resize(meshes.size(), 0);
+        meshStatic.resize(meshes.size(), 0);
+
+        glCreateBuffers(1, &instanceBuffer);
+        glNamedBufferStorage(instanceBuffer, std::max<size_t>(meshes.size(), 1) * sizeof(glm::mat4), NULL, GL_DYNAMIC_STORAGE_BIT);
+    }
+
+    // Итоговая матрица меша с учётом общей геометрии
+    glm::mat4 WorldTransform(size_t meshIndex) const {
+        return meshTransforms[meshIndex] * meshBaseTransforms[meshIndex];
+    }
+
+    std::vector<glm::mat4> WorldTransforms() const {
+        std::vector<glm::mat4> transforms(meshes.size());
+        for (size_t i = 0; i < meshes.size(); ++i)
+            transforms[i] = WorldTransform(i);
+        return transforms;
+    }
+
+    // Потоки позиций для проходов только по глубине; без них такие проходы читают полный Vertex
+    void EnablePositionStreams() {
+        if (positionStreams)
+            return;
+        size_t bytes = 0;
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            if (meshGeometry[i] != (int)i)
+                continue;
+            meshes[i].CreatePositionStream();
+            bytes += meshes[i].vertices.size() * sizeof(glm::vec3);
+        }
+        for (size_t i = 0; i < meshes.size(); ++i)
+            if (meshGeometry[i] != (int)i)
+                meshes[i].SharePositionStream(meshes[meshGeometry[i]]);
+        positionStreams = true;
+        std::cout << "Model: position streams " << bytes / 1024 << " KB" << std::endl;
+    }
+
+    bool HasPositionStreams() const {
+        return positionStreams;
+    }
+
+    // Видимые меши с общей геометрией рисуются одним инстансным вызовом,
+    // меши под условной отрисовкой - по отдельности.
+    // Команды записываются в буферы параллельно по отрезкам списка отрисовки,
+    // GL-вызовы выполняются на вызывающем потоке в порядке ключей сортировки.
+    // positionOnly - геометрия из потоков позиций (для шейдеров, читающих только aPos)
+    enum DrawLayer { DRAW_ALL, DRAW_STATIC, DRAW_DYNAMIC };
+
+    void Draw(Shader& shader, DrawLayer layer = DRAW_ALL, bool positionOnly = false) {
+        std::vector<DrawItem> items;
+        std::vector<size_t> instanceMeshes;
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (meshGeometry[i] != (int)i)
+                continue;
+
+            size_t first = instanceMeshes.size();
+            for (size_t j : geometryUsers[i]) {
+                if (!meshVisible[j] || (layer != DRAW_ALL && (meshStatic[j] != 0) != (layer == DRAW_STATIC)))
+                    continue;
+                if (meshQueries[j] != 0 && UsesOcclusionQuery(j))
+                    items.push_back({ j, 0, 0 });
+                else
+                    instanceMeshes.push_back(j);
+            }
+
+            size_t count = instanceMeshes.size() - first;
+            if (count == 1) {
+                items.push_back({ instanceMeshes.back(), 0, 0 });
+                instanceMeshes.pop_back();
+            }
+            else if (count > 1) {
+                items.push_back({ i, (int)first, (int)count });
+            }
+        }
+
+        // Общие VAO форматов создаются здесь: запись команд идёт на рабочих потоках без GL-вызовов
+        formatVAOs[Mesh::FORMAT_VERTEX] = Mesh::FormatVAO(Mesh::FORMAT_VERTEX);
+        formatVAOs[Mesh::FORMAT_POSITION] = Mesh::FormatVAO(Mesh::FORMAT_POSITION);
+
+        DrawLocations locations;
+        locations.model = glGetUniformLocation(shader.ID, "model");
+        locations.instanced = glGetUniformLocation(shader.ID, "instanced");
+        locations.instanceBase = glGetUniformLocation(shader.ID, "instanceBase");
+
+        const size_t grain = 256;
+        size_t chunks = (items.size() + grain - 1) / grain;
+        commandBuffers.resize(chunks);
+        instanceModels.resize(instanceMeshes.size());
+
+        auto record = [&](size_t begin, size_t end) {
+            CommandBuffer& buffer = commandBuffers[begin / grain];
+            buffer.Clear();
+            for (size_t k = begin; k < end; ++k)
+                recordItem(buffer, shader.ID, locations, items[k], (uint32_t)k, instanceMeshes, positionOnly && positionStreams);
+        };
+        if (jobs && chunks > 1)
+            jobs->ParallelFor(items.size(), grain, record);
+        else
+            for (size_t begin = 0; begin < items.size(); begin += grain)
+                record(begin, std::min(items.size(), begin + grain));
+
+        if (!instanceModels.empty()) {
+            glNamedBufferSubData(instanceBuffer, 0, instanceModels.size() * sizeof(glm::mat4), instanceModels.data());
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+        }
+
+        CommandBuffer::Execute(commandBuffers);
+        shader.setBool("instanced", false);
+    }
+
+    // Запрос видимости окупается только для тяжёлых мешей
+    bool UsesOcclusionQuery(size_t meshIndex) const {
+        return meshes[meshIndex].indices.size() / 3 >= occlusionQueryMinTriangles;
     }
 
-    void Draw(Shader& shader) {
+    // Отрисовка командами из буфера косвенной отрисовки (одна команда на меш)
+    void DrawIndirect(Shader& shader, size_t firstCommand) {
+        shader.setBool("instanced", false);
         for (size_t i = 0; i < meshes.size(); i++) {
-            shader.setMat4("model", meshTransforms[i]);
-            meshes[i].Draw(shader);
+            shader.setMat4("model", WorldTransform(i));
+            meshes[i].DrawIndirect((firstCommand + i) * 5 * sizeof(unsigned int));
         }
     }
 
@@ -36,6 +165,64 @@ public:
     }
 
 private:
+    struct MeshData {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+    };
+
+    // Элемент списка отрисовки: одиночный меш (instanceCount == 0)
+    // или геометрия mesh с экземплярами instanceMeshes[firstInstance, firstInstance + instanceCount)
+    struct DrawItem {
+        size_t mesh;
+        int firstInstance;
+        int instanceCount;
+    };
+
+    struct DrawLocations {
+        int model;
+        int instanced;
+        int instanceBase;
+    };
+
+    JobSystem* jobs;
+    std::vector<CommandBuffer> commandBuffers;
+    std::vector<glm::mat4> instanceModels;
+    unsigned int instanceBuffer = 0;
+    unsigned int formatVAOs[2] = {};
+    bool positionStreams = false;
+    std::vector<std::vector<size_t>> geometryUsers; // для каждого меша-источника: все меши с его геометрией
+
+    // Запись одного элемента; не делает GL-вызовов и выполняется на рабочих потоках
+    void recordItem(CommandBuffer& buffer, unsigned int program, const DrawLocations& locations,
+        const DrawItem& item, uint32_t order, const std::vector<size_t>& instanceMeshes, bool positionOnly) {
+        const Mesh& mesh = meshes[item.mesh];
+        buffer.BeginPacket(CommandBuffer::MakeKey(program, meshGeometry[item.mesh], order));
+        buffer.BindProgram(program);
+        Mesh::VertexFormat format = positionOnly ? Mesh::FORMAT_POSITION : Mesh::FORMAT_VERTEX;
+        buffer.BindFormat(formatVAOs[format]);
+        buffer.BindGeometry(mesh.FormatBuffer(format), mesh.IndexBuffer(), Mesh::FormatStride(format));
+        if (format == Mesh::FORMAT_VERTEX)
+            buffer.BindStream(mesh.OcclusionBuffer(), 1);
+
+        if (item.instanceCount > 0) {
+            for (int k = 0; k < item.instanceCount; ++k)
+                instanceModels[item.firstInstance + k] = WorldTransform(instanceMeshes[item.firstInstance + k]);
+            buffer.SetInt(locations.instanced, 1);
+            buffer.SetInt(locations.instanceBase, item.firstInstance);
+            buffer.DrawInstanced((uint32_t)mesh.indices.size(), (uint32_t)item.instanceCount);
+            return;
+        }
+
+        bool conditional = meshQueries[item.mesh] != 0 && UsesOcclusionQuery(item.mesh);
+        buffer.SetInt(locations.instanced, 0);
+        buffer.SetMat4(locations.model, WorldTransform(item.mesh));
+        if (conditional)
+            buffer.BeginConditional(meshQueries[item.mesh]);
+        buffer.Draw((uint32_t)mesh.indices.size());
+        if (conditional)
+            buffer.EndConditional();
+    }
+
     void loadModel(std::string const& path) {
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path,
@@ -48,26 +235,97 @@ private:
             return;
         }
         directory = path.substr(0, path.find_last_of('/'));
-        processNode(scene->mRootNode, scene);
+
+        std::vector<aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+
+        std::vector<MeshData> meshData(sceneMeshes.size());
+        parallelFor(sceneMeshes.size(), [&](size_t i) {
+            meshData[i] = processMesh(sceneMeshes[i], scene);
+        });
+        buildMeshes(meshData);
     }
 
-    void processNode(aiNode* node, const aiScene* scene) {
+    void processNode(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& sceneMeshes) {
         for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
 
         for (unsigned int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
+        }
+    }
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+        if (!jobs) {
+            for (size_t i = 0; i < count; ++i)
+                body(i);
+            return;
         }
+        jobs->ParallelFor(count, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                body(i);
+        });
+    }
+
+    // Повторяющаяся геометрия загружается в видеопамять один раз,
+    // повторы ссылаются на её буферы со своим базовым преобразованием
+    void buildMeshes(const std::vector<MeshData>& meshData) {
+        std::unordered_map<uint64_t, std::vector<size_t>> candidates;
+        size_t uniqueBytes = 0, totalBytes = 0, drawCalls = 0;
+
+        std::vector<uint64_t> signatures(meshData.size());
+        parallelFor(meshData.size(), [&](size_t i) {
+            signatures[i] = duplicate_geometry::rigidSignature(meshData[i].vertices, meshData[i].indices);
+        });
+
+        geometryUsers.resize(meshData.size());
+        for (size_t i = 0; i < meshData.size(); ++i) {
+            const MeshData& data = meshData[i];
+            size_t bytes = data.vertices.size() * sizeof(Vertex) + data.indices.size() * sizeof(unsigned int);
+            totalBytes += bytes;
+
+            std::vector<size_t>& bucket = candidates[signatures[i]];
+
+            int source = -1;
+            glm::mat4 base(1.0f);
+            for (size_t j : bucket) {
+                if (duplicate_geometry::findRigidTransform(meshData[j].vertices, meshData[j].indices,
+                    data.vertices, data.indices, base)) {
+                    source = (int)j;
+                    break;
+                }
+            }
+
+            if (source < 0) {
+                bucket.push_back(i);
+                meshes.push_back(Mesh(data.vertices, data.indices));
+                meshGeometry.push_back((int)i);
+                meshBaseTransforms.push_back(glm::mat4(1.0f));
+                geometryUsers[i].push_back(i);
+                uniqueBytes += bytes;
+                drawCalls++;
+            }
+            else {
+                meshes.push_back(meshes[source]);
+                meshGeometry.push_back(source);
+                meshBaseTransforms.push_back(base);
+                geometryUsers[source].push_back(i);
+            }
+        }
+
+        std::cout << "Model: " << meshes.size() << " meshes, " << drawCalls << " unique geometries; "
+            << "instancing saves " << (totalBytes - uniqueBytes) / 1024 << " KB of GPU memory, "
+            << "draw calls " << meshes.size() << " -> " << drawCalls << std::endl;
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene) {
+    MeshData processMesh(aiMesh* mesh, const aiScene* scene) {
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
 
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
             Vertex vertex;
+            vertex.Normal = glm::vec3(0.0f);
             vertex.Position = glm::vec3(
                 mesh->mVertices[i].x,
                 mesh->mVertices[i].y,
@@ -88,7 +346,7 @@ private:
                 indices.push_back(face.mIndices[j]);
         }
 
-        return Mesh(vertices, indices);
+        return { vertices, indices };
     }
 };
 
@@ -0,0 +1,148 @@
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "Model.h"
+
+// Отрисовка сцены сразу в несколько видов одной отправкой: грани кубической карты (gl_Layer)
+// или области вывода (gl_ViewportIndex) выбираются в вершинном шейдере multiview_vertex.glsl.
+// Меш рисуется одним инстансным вызовом, экземпляр - вид; отсечение по пирамиде каждого вида
+// идёт один раз на кадр, и в вызов попадают только виды, где меш виден
+// (список видов меша - в SSBO, начало списка передаётся как baseInstance).
+class MultiView {
+public:
+    static const int MAX_VIEWS = 6;
+    static const unsigned int VIEWS_BINDING = 12;      // layout(binding = ...) в multiview_vertex.glsl
+    static const unsigned int VIEW_LISTS_BINDING = 13;
+    enum Target { TARGET_LAYERS, TARGET_VIEWPORTS };
+
+    struct Stats {
+        unsigned int submissions = 0;
+        unsigned int views = 0;       // в последней отправке
+        unsigned int draws = 0;       // вызовов за период
+        unsigned int instances = 0;   // пар меш-вид, отправленных на GPU
+        unsigned int culled = 0;      // пар меш-вид, отброшенных отсечением
+        double submitMs = 0.0;        // время процессора на отправку, в среднем
+    };
+
+    MultiView(Model& model) : model(model) {
+        glCreateBuffers(1, &viewBuffer);
+        glNamedBufferStorage(viewBuffer, MAX_VIEWS * sizeof(View), NULL, GL_DYNAMIC_STORAGE_BIT);
+        listCapacity = std::max<size_t>(model.meshes.size() * MAX_VIEWS, 1);
+        glCreateBuffers(1, &listBuffer);
+        glNamedBufferStorage(listBuffer, listCapacity * sizeof(unsigned int), NULL, GL_DYNAMIC_STORAGE_BIT);
+    }
+
+    // Матрицы видов; targets - номер слоя или области вывода каждого вида (по умолчанию 0..n-1)
+    void SetViews(const std::vector<glm::mat4>& viewProjections, const std::vector<int>& targets = std::vector<int>()) {
+        views.clear();
+        for (size_t i = 0; i < viewProjections.size() && i < MAX_VIEWS; ++i)
+            views.push_back({ viewProjections[i], i < targets.size() ? targets[i] : (int)i, { 0, 0, 0 } });
+    }
+
+    // Все меши во все виды, где они видны; positionOnly - поток позиций (проходы по глубине)
+    void Draw(Shader& shader, Target target, bool positionOnly = false) {
+        auto start = std::chrono::steady_clock::now();
+        cull();
+
+        glNamedBufferSubData(viewBuffer, 0, views.size() * sizeof(View), views.data());
+        if (!viewLists.empty())
+            glNamedBufferSubData(listBuffer, 0, viewLists.size() * sizeof(unsigned int), viewLists.data());
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VIEWS_BINDING, viewBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VIEW_LISTS_BINDING, listBuffer);
+
+        shader.use();
+        shader.setBool("toViewports", target == TARGET_VIEWPORTS);
+        int modelLocation = glGetUniformLocation(shader.ID, "model");
+        Mesh::VertexFormat format = positionOnly && model.HasPositionStreams() ? Mesh::FORMAT_POSITION : Mesh::FORMAT_VERTEX;
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (listCounts[i] == 0)
+                continue;
+            const Mesh& mesh = model.meshes[i];
+            mesh.BindBuffers(format);
+            glm::mat4 world = model.WorldTransform(i);
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &world[0][0]);
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, 0,
+                listCounts[i], listStarts[i]);
+            period.draws++;
+            period.instances += listCounts[i];
+        }
+        glBindVertexArray(0);
+
+        period.submissions++;
+        period.views = (unsigned int)views.size();
+        submitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    Stats TakeStats() {
+        Stats stats = period;
+        if (stats.submissions > 0)
+            stats.submitMs = submitSeconds * 1000.0 / stats.submissions;
+        period = Stats();
+        submitSeconds = 0.0;
+        return stats;
+    }
+
+private:
+    // Вид в формате std430, см. MultiViewView в multiview_vertex.glsl
+    struct View {
+        glm::mat4 viewProjection;
+        int target;
+        int pad[3];
+    };
+
+    Model& model;
+    std::vector<View> views;
+    std::vector<unsigned int> viewLists;  // номера видов подряд по мешам
+    std::vector<unsigned int> listStarts;
+    std::vector<unsigned int> listCounts;
+    size_t listCapacity = 0;
+    unsigned int viewBuffer = 0, listBuffer = 0;
+    Stats period;
+    double submitSeconds = 0.0;
+
+    // Отсечение меша по каждому виду: ограничивающий объём целиком за одной из плоскостей отсечения
+    void cull() {
+        viewLists.clear();
+        listStarts.assign(model.meshes.size(), 0);
+        listCounts.assign(model.meshes.size(), 0);
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            const Mesh& mesh = model.meshes[i];
+            glm::mat4 world = model.WorldTransform(i);
+            listStarts[i] = (unsigned int)viewLists.size();
+            for (size_t v = 0; v < views.size(); ++v) {
+                if (outside(views[v].viewProjection * world, mesh.aabbMin, mesh.aabbMax)) {
+                    period.culled++;
+                    continue;
+                }
+                viewLists.push_back((unsigned int)v);
+            }
+            listCounts[i] = (unsigned int)viewLists.size() - listStarts[i];
+        }
+    }
+
+    static bool outside(const glm::mat4& mvp, const glm::vec3& bmin, const glm::vec3& bmax) {
+        int outMask = 0x3F;
+        for (int c = 0; c < 8; ++c) {
+            glm::vec4 p = mvp * glm::vec4((c & 1) ? bmax.x : bmin.x, (c & 2) ? bmax.y : bmin.y, (c & 4) ? bmax.z : bmin.z, 1.0f);
+            int mask = 0;
+            if (p.x < -p.w) mask |= 1;
+            if (p.x > p.w) mask |= 2;
+            if (p.y < -p.w) mask |= 4;
+            if (p.y > p.w) mask |= 8;
+            if (p.z < -p.w) mask |= 16;
+            if (p.z > p.w) mask |= 32;
+            outMask &= mask;
+            if (!outMask)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif // MULTI_VIEW_H
@@ -0,0 +1,115 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <vector>
+#include <glm.hpp>
+#include "Shader.h"
+#include "Model.h"
+
+// Аппаратные запросы видимости по ограничивающим объёмам.
+// Model::Draw рисует меш внутри glBeginConditionalRender по последнему результату запроса,
+// так что процессор результат не ждёт. Запросы перевыпускаются не каждый кадр:
+// меш i проверяется в кадрах, где frame % refreshInterval == i % refreshInterval.
+class OcclusionQueries {
+public:
+    struct Stats {
+        unsigned int queriedMeshes = 0;
+        unsigned int issuedQueries = 0;
+        unsigned int hiddenMeshes = 0;  // по уже готовым результатам
+        unsigned int hiddenTriangles = 0;
+    };
+
+    OcclusionQueries(Model& model, int refreshInterval = 4)
+        : model(model), proxyShader("bbox_vertex.glsl", "bbox_fragment.glsl"), refreshInterval(refreshInterval) {
+        queries.resize(model.meshes.size());
+        glGenQueries((GLsizei)queries.size(), queries.data());
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    // Отключение условной отрисовки: все меши рисуются безусловно
+    void Detach() {
+        std::fill(model.meshQueries.begin(), model.meshQueries.end(), 0u);
+    }
+
+    // Выпуск запросов по прокси-объёмам после отрисовки сцены, по буферу глубины текущего кадра
+    void Issue(const glm::mat4& view, const glm::mat4& projection) {
+        Stats stats;
+        glm::vec3 cameraPos = glm::vec3(glm::inverse(view)[3]);
+
+        proxyShader.use();
+        proxyShader.setMat4("view", view);
+        proxyShader.setMat4("projection", projection);
+
+        glBindVertexArray(emptyVAO);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (!model.UsesOcclusionQuery(i))
+                continue;
+            stats.queriedMeshes++;
+
+            if (model.meshQueries[i] != 0) {
+                GLuint result = 1;
+                glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_NO_WAIT, &result);
+                if (!result) {
+                    stats.hiddenMeshes++;
+                    stats.hiddenTriangles += (unsigned int)model.meshes[i].indices.size() / 3;
+                }
+            }
+
+            if (model.meshQueries[i] != 0 && (frame + i) % refreshInterval != 0)
+                continue;
+
+            const Mesh& mesh = model.meshes[i];
+            glm::vec3 margin = (mesh.aabbMax - mesh.aabbMin) * 0.01f + glm::vec3(1e-3f);
+            glm::vec3 boundsMin = mesh.aabbMin - margin;
+            glm::vec3 boundsMax = mesh.aabbMax + margin;
+
+            // Камера внутри объёма: грани отсекаются ближней плоскостью, поэтому без теста глубины
+            glm::vec3 local = glm::vec3(glm::inverse(model.WorldTransform(i)) * glm::vec4(cameraPos, 1.0f));
+            bool inside = glm::all(glm::greaterThanEqual(local, boundsMin - glm::vec3(0.1f))) &&
+                glm::all(glm::lessThanEqual(local, boundsMax + glm::vec3(0.1f)));
+            if (inside)
+                glDisable(GL_DEPTH_TEST);
+
+            proxyShader.setMat4("model", model.WorldTransform(i));
+            proxyShader.setVec3("boundsMin", boundsMin);
+            proxyShader.setVec3("boundsMax", boundsMax);
+
+            glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, queries[i]);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+            if (inside)
+                glEnable(GL_DEPTH_TEST);
+
+            model.meshQueries[i] = queries[i];
+            stats.issuedQueries++;
+        }
+
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glBindVertexArray(0);
+
+        frame++;
+        lastStats = stats;
+    }
+
+    const Stats& stats() const {
+        return lastStats;
+    }
+
+private:
+    Model& model;
+    Shader proxyShader;
+    int refreshInterval;
+    std::vector<GLuint> queries;
+    GLuint emptyVAO = 0;
+    size_t frame = 0;
+    Stats lastStats;
+};
+
+#endif // OCCLUSION_QUERIES_H
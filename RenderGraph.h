@@ -0,0 +1,468 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <GL/glew.h>
+#include "GpuTimer.h"
+
+// Граф кадра. Каждый кадр проходы объявляются заново: что читают и пишут (текстуры графа,
+// внешние ресурсы, основной буфер). Compile отбрасывает проходы, результат которых никому не нужен
+// (корни - запись в основной буфер и SideEffect), упорядочивает остальные по зависимостям
+// и раздаёт временным текстурам память: текстуры, времена жизни которых не пересекаются,
+// делят одну физическую текстуру (при разных форматах одного класса - через glTextureView).
+// Физические текстуры и кадровые буферы переживают кадр; не использованные MAX_IDLE_FRAMES кадров удаляются.
+class RenderGraph {
+public:
+    typedef int Handle;
+    static const Handle BACKBUFFER = 0;   // основной буфер окна (цвет и глубина)
+    static const int MAX_IDLE_FRAMES = 120;
+
+    struct PassTime {
+        std::string name;
+        double gpuMs;
+    };
+
+    struct Stats {
+        unsigned int frames = 0;
+        unsigned int passes = 0;
+        std::vector<std::string> culled;
+        std::vector<PassTime> times;     // средние за период, в порядке выполнения
+        unsigned int transientTextures = 0;
+        unsigned int physicalTextures = 0;
+        size_t transientBytes = 0;       // сумма размеров временных текстур
+        size_t physicalBytes = 0;        // фактически выделено под них
+    };
+
+    // Объявление прохода: RenderGraph::AddPass(...).Read(a).Color(b)...
+    class PassBuilder {
+    public:
+        PassBuilder(RenderGraph& graph, int pass) : graph(graph), pass(pass) {}
+
+        PassBuilder& Read(Handle resource) {
+            graph.passes[pass].reads.push_back(resource);
+            return *this;
+        }
+
+        PassBuilder& Write(Handle resource) {
+            graph.passes[pass].writes.push_back(resource);
+            return *this;
+        }
+
+        // Цветовое вложение кадрового буфера прохода (BACKBUFFER - основной буфер)
+        PassBuilder& Color(Handle texture) {
+            graph.passes[pass].colors.push_back(texture);
+            return Write(texture);
+        }
+
+        PassBuilder& Depth(Handle texture) {
+            graph.passes[pass].depth = texture;
+            return Write(texture);
+        }
+
+        // Проход выполняется, даже если его результат не читают (запросы, чтение на процессор)
+        PassBuilder& SideEffect() {
+            graph.passes[pass].sideEffect = true;
+            return *this;
+        }
+
+    private:
+        RenderGraph& graph;
+        int pass;
+    };
+
+    RenderGraph() {
+        resources.push_back({ "Backbuffer", false, 0, 0, 0 });
+    }
+
+    // Начало объявления кадра
+    void Reset() {
+        passes.clear();
+        resources.resize(1);
+        order.clear();
+    }
+
+    // Временная текстура кадра
+    Handle CreateTexture(const std::string& name, GLenum format, int width, int height) {
+        resources.push_back({ name, true, format, width, height });
+        return (Handle)resources.size() - 1;
+    }
+
+    // Внешний ресурс (живёт вне графа): только для зависимостей между проходами
+    Handle Import(const std::string& name) {
+        resources.push_back({ name, false, 0, 0, 0 });
+        return (Handle)resources.size() - 1;
+    }
+
+    PassBuilder AddPass(const std::string& name, std::function<void()> execute) {
+        Pass pass;
+        pass.name = name;
+        pass.execute = execute;
+        passes.push_back(pass);
+        return PassBuilder(*this, (int)passes.size() - 1);
+    }
+
+    // GL-текстура временного ресурса (действительна во время Execute)
+    unsigned int Texture(Handle handle) const {
+        return resources[handle].texture;
+    }
+
+    // Отсечение, порядок и раздача памяти
+    void Compile() {
+        cull();
+        sortPasses();
+        allocate();
+    }
+
+    // Выполнение проходов с привязкой их кадровых буферов и замером времени на GPU
+    void Execute() {
+        for (int index : order) {
+            Pass& pass = passes[index];
+            bindTargets(pass);
+            std::unique_ptr<GpuTimer>& timer = timers[pass.name];
+            if (!timer)
+                timer.reset(new GpuTimer(true));
+            timer->Begin();
+            pass.execute();
+            timer->End();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        period.frames++;
+        period.passes = (unsigned int)passes.size();
+        period.culled.clear();
+        for (const Pass& pass : passes)
+            if (!pass.alive)
+                period.culled.push_back(pass.name);
+        period.times.clear();
+        for (int index : order)
+            period.times.push_back({ passes[index].name, 0.0 });
+        releaseIdle();
+    }
+
+    // Сводка с прошлого вызова
+    Stats TakeStats() {
+        Stats stats = period;
+        for (PassTime& time : stats.times)
+            time.gpuMs = timers[time.name]->TakeAverageMs();
+        return stats;
+    }
+
+private:
+    struct Resource {
+        std::string name;
+        bool transient;
+        GLenum format;
+        int width;
+        int height;
+        int firstUse = -1;        // позиции в порядке выполнения
+        int lastUse = -1;
+        int physical = -1;
+        unsigned int texture = 0;
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void()> execute;
+        std::vector<Handle> reads;
+        std::vector<Handle> writes;
+        std::vector<Handle> colors;
+        Handle depth = -1;
+        bool sideEffect = false;
+        bool alive = false;
+    };
+
+    struct Physical {
+        GLenum storageFormat;
+        int width;
+        int height;
+        unsigned int texture;
+        size_t bytes;
+        int busyUntil;            // последний проход текущего владельца
+        int idleFrames;
+        std::map<GLenum, unsigned int> views;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<int> order;
+    std::vector<Physical> physicals;
+    std::map<std::vector<unsigned int>, unsigned int> framebuffers;
+    std::map<std::string, std::unique_ptr<GpuTimer>> timers;
+    Stats period;
+
+    // Проходы, от которых зависят корни; обход от корней назад по чтениям
+    void cull() {
+        std::vector<int> stack;
+        for (size_t p = 0; p < passes.size(); ++p) {
+            Pass& pass = passes[p];
+            pass.alive = pass.sideEffect || std::find(pass.writes.begin(), pass.writes.end(), BACKBUFFER) != pass.writes.end();
+            if (pass.alive)
+                stack.push_back((int)p);
+        }
+        while (!stack.empty()) {
+            const Pass& reader = passes[stack.back()];
+            stack.pop_back();
+            std::vector<Handle> needs = reader.reads;
+            // Запись в уже существующее содержимое (вложения) тоже требует его авторов
+            needs.insert(needs.end(), reader.writes.begin(), reader.writes.end());
+            for (Handle resource : needs)
+                for (size_t w = 0; w < passes.size(); ++w) {
+                    Pass& writer = passes[w];
+                    if (writer.alive || &writer == &reader)
+                        continue;
+                    if (std::find(writer.writes.begin(), writer.writes.end(), resource) != writer.writes.end() &&
+                        (w < (size_t)(&reader - &passes[0]) || std::find(reader.reads.begin(), reader.reads.end(), resource) != reader.reads.end())) {
+                        writer.alive = true;
+                        stack.push_back((int)w);
+                    }
+                }
+        }
+    }
+
+    // Топологическая сортировка: писатель ресурса раньше читателей, записи - в порядке объявления;
+    // при равенстве сохраняется порядок объявления
+    void sortPasses() {
+        size_t count = passes.size();
+        std::vector<std::vector<int>> next(count);
+        std::vector<int> incoming(count, 0);
+        auto edge = [&](size_t from, size_t to) {
+            next[from].push_back((int)to);
+            incoming[to]++;
+        };
+        for (size_t a = 0; a < count; ++a) {
+            if (!passes[a].alive)
+                continue;
+            for (size_t b = 0; b < count; ++b) {
+                if (a == b || !passes[b].alive)
+                    continue;
+                bool before = false;
+                for (Handle resource : passes[a].writes) {
+                    bool bReads = std::find(passes[b].reads.begin(), passes[b].reads.end(), resource) != passes[b].reads.end();
+                    bool bWrites = std::find(passes[b].writes.begin(), passes[b].writes.end(), resource) != passes[b].writes.end();
+                    bool aReads = std::find(passes[a].reads.begin(), passes[a].reads.end(), resource) != passes[a].reads.end();
+                    if ((bReads && !aReads) || (bWrites && a < b))
+                        before = true;
+                }
+                if (before)
+                    edge(a, b);
+            }
+        }
+
+        order.clear();
+        std::vector<char> done(count, 0);
+        for (size_t step = 0; step < count; ++step) {
+            int pick = -1;
+            for (size_t p = 0; p < count && pick < 0; ++p)
+                if (passes[p].alive && !done[p] && incoming[p] == 0)
+                    pick = (int)p;
+            if (pick < 0)
+                break;
+            done[pick] = 1;
+            order.push_back(pick);
+            for (int n : next[pick])
+                incoming[n]--;
+        }
+
+        size_t alive = 0;
+        for (const Pass& pass : passes)
+            alive += pass.alive ? 1 : 0;
+        if (order.size() != alive) {
+            std::cerr << "ERROR::RENDER_GRAPH::CYCLE, falling back to declaration order" << std::endl;
+            order.clear();
+            for (size_t p = 0; p < count; ++p)
+                if (passes[p].alive)
+                    order.push_back((int)p);
+        }
+    }
+
+    // Времена жизни временных текстур и их размещение в физических
+    void allocate() {
+        for (size_t position = 0; position < order.size(); ++position) {
+            const Pass& pass = passes[order[position]];
+            std::vector<Handle> used = pass.reads;
+            used.insert(used.end(), pass.writes.begin(), pass.writes.end());
+            for (Handle handle : used) {
+                Resource& resource = resources[handle];
+                if (resource.firstUse < 0)
+                    resource.firstUse = (int)position;
+                resource.lastUse = (int)position;
+            }
+        }
+
+        std::vector<Handle> transients;
+        for (size_t h = 0; h < resources.size(); ++h)
+            if (resources[h].transient && resources[h].firstUse >= 0)
+                transients.push_back((Handle)h);
+        std::sort(transients.begin(), transients.end(), [&](Handle a, Handle b) {
+            return resources[a].firstUse < resources[b].firstUse;
+        });
+
+        for (Physical& physical : physicals)
+            physical.busyUntil = -1;
+        period.transientTextures = (unsigned int)transients.size();
+        period.transientBytes = 0;
+        period.physicalBytes = 0;
+        period.physicalTextures = 0;
+
+        for (Handle handle : transients) {
+            Resource& resource = resources[handle];
+            GLenum storage = storageFormat(resource.format);
+            int chosen = -1;
+            for (size_t i = 0; i < physicals.size() && chosen < 0; ++i) {
+                const Physical& physical = physicals[i];
+                if (physical.storageFormat == storage && physical.width == resource.width &&
+                    physical.height == resource.height && physical.busyUntil < resource.firstUse)
+                    chosen = (int)i;
+            }
+            if (chosen < 0) {
+                chosen = (int)physicals.size();
+                physicals.push_back(createPhysical(storage, resource.width, resource.height));
+            }
+
+            Physical& physical = physicals[chosen];
+            if (physical.busyUntil < 0) {
+                period.physicalTextures++;
+                period.physicalBytes += physical.bytes;
+            }
+            physical.busyUntil = resource.lastUse;
+            physical.idleFrames = 0;
+            resource.physical = chosen;
+            resource.texture = view(physical, resource.format);
+            period.transientBytes += physical.bytes;
+        }
+    }
+
+    void bindTargets(const Pass& pass) {
+        if (pass.colors.empty() && pass.depth < 0)
+            return;
+        bool backbuffer = pass.depth == BACKBUFFER ||
+            std::find(pass.colors.begin(), pass.colors.end(), BACKBUFFER) != pass.colors.end();
+        if (backbuffer) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return;
+        }
+
+        std::vector<unsigned int> key;
+        for (Handle color : pass.colors)
+            key.push_back(resources[color].texture);
+        key.push_back(pass.depth >= 0 ? resources[pass.depth].texture : 0);
+
+        unsigned int& framebuffer = framebuffers[key];
+        if (!framebuffer) {
+            glGenFramebuffers(1, &framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            std::vector<GLenum> drawBuffers;
+            for (size_t i = 0; i < pass.colors.size(); ++i) {
+                glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, key[i], 0);
+                drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+            }
+            if (pass.depth >= 0) {
+                GLenum format = resources[pass.depth].format;
+                glFramebufferTexture(GL_FRAMEBUFFER, format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8 ?
+                    GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, key.back(), 0);
+            }
+            if (drawBuffers.empty())
+                glDrawBuffer(GL_NONE);
+            else
+                glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cerr << "ERROR::RENDER_GRAPH::FRAMEBUFFER_INCOMPLETE: " << pass.name << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+
+    // Физические текстуры, не занятые MAX_IDLE_FRAMES кадров подряд, освобождаются
+    void releaseIdle() {
+        bool released = false;
+        for (size_t i = 0; i < physicals.size();) {
+            Physical& physical = physicals[i];
+            if (physical.busyUntil >= 0 || ++physical.idleFrames < MAX_IDLE_FRAMES) {
+                ++i;
+                continue;
+            }
+            for (auto& entry : physical.views)
+                if (entry.second != physical.texture)
+                    glDeleteTextures(1, &entry.second);
+            glDeleteTextures(1, &physical.texture);
+            physicals.erase(physicals.begin() + i);
+            released = true;
+        }
+        // Кадровые буферы могли ссылаться на удалённые текстуры
+        if (released) {
+            for (auto& entry : framebuffers)
+                glDeleteFramebuffers(1, &entry.second);
+            framebuffers.clear();
+        }
+    }
+
+    Physical createPhysical(GLenum storage, int width, int height) {
+        Physical physical;
+        physical.storageFormat = storage;
+        physical.width = width;
+        physical.height = height;
+        physical.bytes = (size_t)width * height * formatBytes(storage);
+        physical.busyUntil = -1;
+        physical.idleFrames = 0;
+        glGenTextures(1, &physical.texture);
+        glBindTexture(GL_TEXTURE_2D, physical.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, storage, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return physical;
+    }
+
+    // Представление физической текстуры в формате ресурса
+    unsigned int view(Physical& physical, GLenum format) {
+        if (format == physical.storageFormat)
+            return physical.texture;
+        unsigned int& texture = physical.views[format];
+        if (!texture) {
+            glGenTextures(1, &texture);
+            glTextureView(texture, GL_TEXTURE_2D, physical.texture, format, 0, 1, 0, 1);
+        }
+        return texture;
+    }
+
+    // Формат хранения: форматы одного класса совместимости glTextureView делят память
+    static GLenum storageFormat(GLenum format) {
+        switch (format) {
+        case GL_RGBA8: case GL_R32F: case GL_R32UI: case GL_RG16F: case GL_RGB10_A2: case GL_R11F_G11F_B10F:
+            return GL_R32UI;
+        case GL_RGBA16F: case GL_RG32F: case GL_RG32UI:
+            return GL_RG32UI;
+        case GL_R16F: case GL_RG8: case GL_R16UI:
+            return GL_R16UI;
+        case GL_R8: case GL_R8UI:
+            return GL_R8UI;
+        default:
+            return format;
+        }
+    }
+
+    static size_t formatBytes(GLenum format) {
+        switch (format) {
+        case GL_R8UI: case GL_R8:
+            return 1;
+        case GL_R16UI: case GL_R16F: case GL_RG8: case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RG32UI: case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8:
+            return 8;
+        case GL_RGBA32F:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+};
+
+#endif // RENDER_GRAPH_H
@@ -13,9 +13,14 @@ class Shader {
 public:
     unsigned int ID;
 
-    Shader(const char* vertexPath, const char* fragmentPath) {
-        std::string vertexCode = loadShaderFile(vertexPath);
-        std::string fragmentCode = loadShaderFile(fragmentPath);
+    Shader(const char* vertexPath, const char* fragmentPath)
+        : Shader(vertexPath, fragmentPath, "") {
+    }
+
+    // Вариант программы: defines ("#define NAME\n...") вставляются сразу после строки #version
+    Shader(const char* vertexPath, const char* fragmentPath, const std::string& defines) {
+        std::string vertexCode = withDefines(loadShaderFile(vertexPath), defines);
+        std::string fragmentCode = withDefines(loadShaderFile(fragmentPath), defines);
 
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
@@ -33,6 +38,19 @@ public:
         glDeleteShader(fragment);
     }
 
+    // Вычислительная программа из одного файла
+    Shader(const char* computePath) {
+        std::string computeCode = loadShaderFile(computePath);
+        unsigned int compute = compileShader(GL_COMPUTE_SHADER, computeCode.c_str());
+
+        ID = glCreateProgram();
+        glAttachShader(ID, compute);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+
+        glDeleteShader(compute);
+    }
+
     void use() {
         glUseProgram(ID);
     }
@@ -49,6 +67,14 @@ public:
         glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
     }
 
+    void setUint(const std::string& name, unsigned int value) const {
+        glUniform1ui(glGetUniformLocation(ID, name.c_str()), value);
+    }
+
+    void setVec2(const std::string& name, const glm::vec2& value) const {
+        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    }
+
     void setVec3(const std::string& name, const glm::vec3& value) const {
         glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
     }
@@ -58,6 +84,15 @@ public:
     }
 
 private:
+    static std::string withDefines(const std::string& code, const std::string& defines) {
+        if (defines.empty())
+            return code;
+        size_t lineEnd = code.find('\n');
+        if (code.compare(0, 8, "#version") != 0 || lineEnd == std::string::npos)
+            return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
+
     std::string loadShaderFile(const char* path) {
         std::ifstream file;
         file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -78,7 +113,8 @@ private:
         unsigned int shader = glCreateShader(type);
         glShaderSource(shader, 1, &code, NULL);
         glCompileShader(shader);
-        checkCompileErrors(shader, type == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT");
+        checkCompileErrors(shader, type == GL_VERTEX_SHADER ? "VERTEX" :
+            type == GL_COMPUTE_SHADER ? "COMPUTE" : "FRAGMENT");
         return shader;
     }
 
@@ -0,0 +1,224 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <glm.hpp>
+#include <matrix_transform.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "Model.h"
+#include "GpuTimer.h"
+
+// Тени от ключевого источника (light.position) в перспективной карте глубины.
+// Карта статических мешей (model.meshStatic) кэшируется и перерисовывается только при смене
+// положения источника или преобразования какой-либо статической детали; подвижные меши
+// рисуются в отдельную карту в каждом кадре, где они сдвинулись; шейдер берёт обе карты.
+// Проходы идут по потокам позиций (Model::EnablePositionStreams) и не зависят от отсечения камерой.
+class ShadowMap {
+public:
+    static const int SIZE = 2048;
+    static const int STATIC_UNIT = 1;  // текстурные блоки карт в основном шейдере
+    static const int DYNAMIC_UNIT = 2;
+
+    struct Stats {
+        unsigned int frames = 0;
+        unsigned int staticRebuilds = 0;
+        unsigned int dynamicPasses = 0;
+        double staticPassMs = 0.0;  // среднее время перерисовки статической карты
+        double dynamicPassMs = 0.0; // среднее время прохода подвижных мешей
+        bool caching = true;
+    };
+
+    // Без кэширования статическая карта перерисовывается каждый кадр (для сравнения)
+    bool caching = true;
+
+    ShadowMap(Model& model)
+        : model(model), depthShader("depth_vertex.glsl", "depth_fragment.glsl") {
+        model.EnablePositionStreams();
+        computeSceneBounds();
+        createTarget(staticTexture, staticFramebuffer);
+        createTarget(dynamicTexture, dynamicFramebuffer);
+    }
+
+    void SetLight(const glm::vec3& position) {
+        if (position != lightPosition)
+            valid = false;
+        lightPosition = position;
+    }
+
+    // Проходы теней за кадр; width/height - размер основного кадра для восстановления glViewport.
+    // Возвращает true, если тени изменились (кэши, хранящие освещённое изображение, устарели)
+    bool Update(int width, int height) {
+        GLint target = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glm::mat4 lightViewProj = LightViewProj();
+        bool staticChanged = !caching || !valid || !matches(true);
+        bool dynamicChanged = staticChanged || !matches(false);
+        period.frames++;
+        if (!dynamicChanged)
+            return false;
+
+        if (staticChanged) {
+            staticTimer.Begin();
+            renderLayer(staticFramebuffer, Model::DRAW_STATIC, lightViewProj);
+            staticTimer.End();
+            period.staticRebuilds++;
+        }
+        dynamicTimer.Begin();
+        renderLayer(dynamicFramebuffer, Model::DRAW_DYNAMIC, lightViewProj);
+        dynamicTimer.End();
+        period.dynamicPasses++;
+        remember();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    // Карты и матрица источника для основного шейдера
+    void Bind(Shader& shader) {
+        shader.use();
+        shader.setBool("shadowsEnabled", true);
+        shader.setMat4("lightViewProj", LightViewProj());
+        shader.setInt("staticShadowMap", STATIC_UNIT);
+        shader.setInt("dynamicShadowMap", DYNAMIC_UNIT);
+        glActiveTexture(GL_TEXTURE0 + STATIC_UNIT);
+        glBindTexture(GL_TEXTURE_2D, staticTexture);
+        glActiveTexture(GL_TEXTURE0 + DYNAMIC_UNIT);
+        glBindTexture(GL_TEXTURE_2D, dynamicTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Перспектива из источника на ограничивающую сферу сцены
+    glm::mat4 LightViewProj() const {
+        glm::vec3 toCenter = sceneCenter - lightPosition;
+        float distance = std::max(glm::length(toCenter), 1e-3f);
+        glm::vec3 up = std::fabs(toCenter.y) > 0.99f * distance ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 view = glm::lookAt(lightPosition, sceneCenter, up);
+
+        // Источник внутри сцены одной картой не покрыть: угол ограничен 150 градусами
+        float fov = distance > sceneRadius ? 2.0f * std::asin(sceneRadius / distance) : glm::radians(150.0f);
+        fov = std::min(fov, glm::radians(150.0f));
+        float zNear = std::max(distance - sceneRadius, sceneRadius * 0.01f);
+        float zFar = distance + sceneRadius;
+        return glm::perspective(fov, 1.0f, zNear, zFar) * view;
+    }
+
+    // Средние с прошлого вызова; если прохода за период не было - последний замер
+    Stats TakeStats() {
+        Stats stats = period;
+        stats.staticPassMs = staticTimer.TakeAverageMs();
+        if (stats.staticPassMs == 0.0)
+            stats.staticPassMs = staticTimer.LastMs();
+        stats.dynamicPassMs = dynamicTimer.TakeAverageMs();
+        if (stats.dynamicPassMs == 0.0)
+            stats.dynamicPassMs = dynamicTimer.LastMs();
+        stats.caching = caching;
+        period = Stats();
+        return stats;
+    }
+
+private:
+    Model& model;
+    Shader depthShader;
+    unsigned int staticTexture = 0, staticFramebuffer = 0;
+    unsigned int dynamicTexture = 0, dynamicFramebuffer = 0;
+    glm::vec3 lightPosition = glm::vec3(0.0f);
+    glm::vec3 sceneCenter = glm::vec3(0.0f);
+    float sceneRadius = 1.0f;
+
+    bool valid = false;
+    std::vector<glm::mat4> cachedTransforms;
+
+    GpuTimer staticTimer;
+    GpuTimer dynamicTimer;
+    Stats period;
+
+    // Ограничивающая сфера по исходному положению всех мешей с запасом на ход подвижных деталей
+    void computeSceneBounds() {
+        glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            const Mesh& mesh = model.meshes[i];
+            glm::mat4 world = model.WorldTransform(i);
+            for (int c = 0; c < 8; ++c) {
+                glm::vec3 corner((c & 1) ? mesh.aabbMax.x : mesh.aabbMin.x,
+                    (c & 2) ? mesh.aabbMax.y : mesh.aabbMin.y,
+                    (c & 4) ? mesh.aabbMax.z : mesh.aabbMin.z);
+                glm::vec3 p = glm::vec3(world * glm::vec4(corner, 1.0f));
+                bmin = glm::min(bmin, p);
+                bmax = glm::max(bmax, p);
+            }
+        }
+        if (model.meshes.empty())
+            bmin = bmax = glm::vec3(0.0f);
+        sceneCenter = (bmin + bmax) * 0.5f;
+        sceneRadius = std::max(glm::length(bmax - bmin) * 0.5f * 1.2f, 0.1f);
+    }
+
+    void createTarget(unsigned int& texture, unsigned int& framebuffer) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, SIZE, SIZE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::SHADOW_MAP::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Тени не зависят от камеры: на время прохода все меши видимы и без условной отрисовки
+    void renderLayer(unsigned int framebuffer, Model::DrawLayer layer, const glm::mat4& lightViewProj) {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, SIZE, SIZE);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        depthShader.use();
+        depthShader.setMat4("view", glm::mat4(1.0f));
+        depthShader.setMat4("projection", lightViewProj);
+        depthShader.setBool("lateLatched", false);
+
+        std::vector<char> visible(model.meshes.size(), 1);
+        std::vector<unsigned int> queries(model.meshes.size(), 0);
+        std::swap(visible, model.meshVisible);
+        std::swap(queries, model.meshQueries);
+
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        model.Draw(depthShader, layer, true);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+
+        std::swap(visible, model.meshVisible);
+        std::swap(queries, model.meshQueries);
+    }
+
+    // Совпадают ли преобразования статических (или подвижных) мешей с последним проходом
+    bool matches(bool staticMeshes) const {
+        for (size_t i = 0; i < model.meshes.size(); ++i)
+            if ((model.meshStatic[i] != 0) == staticMeshes && model.WorldTransform(i) != cachedTransforms[i])
+                return false;
+        return true;
+    }
+
+    void remember() {
+        cachedTransforms = model.WorldTransforms();
+        valid = true;
+    }
+};
+
+#endif // SHADOW_MAP_H
@@ -0,0 +1,345 @@
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <glm.hpp>
+#include "Model.h"
+#include "JobSystem.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Программное отсечение перекрытых мешей на процессоре.
+// Крупные меши (или их упрощённые заменители) растеризуются в буфер глубины низкого разрешения,
+// затем экранный прямоугольник каждого меша проверяется по этому буферу.
+// Растеризация и проверка мешей идут задачами планировщика: по тайлам, внутри тайла - по 8 пикселей (AVX2).
+class SoftwareOcclusion {
+public:
+    static const int WIDTH = 320;
+    static const int HEIGHT = 192;
+    static const int TILE_WIDTH = 64;
+    static const int TILE_HEIGHT = 32;
+    static const int TILES_X = WIDTH / TILE_WIDTH;
+    static const int TILES_Y = HEIGHT / TILE_HEIGHT;
+
+    struct Stats {
+        unsigned int occluders = 0;
+        unsigned int occluderTriangles = 0;
+        unsigned int testedMeshes = 0;
+        unsigned int culledMeshes = 0;
+        unsigned int culledTriangles = 0;
+    };
+
+    // Меши выбираются в окклюдеры по убыванию объёма, пока хватает бюджета треугольников
+    SoftwareOcclusion(Model& model, JobSystem& jobs, unsigned int triangleBudget = 20000)
+        : model(model), jobs(jobs), depth(WIDTH * HEIGHT, 1.0f) {
+        occluders.resize(model.meshes.size());
+
+        std::vector<size_t> order(model.meshes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return volume(model.meshes[a]) > volume(model.meshes[b]);
+        });
+
+        unsigned int triangles = 0;
+        for (size_t i : order) {
+            const Mesh& mesh = model.meshes[i];
+            unsigned int meshTriangles = (unsigned int)mesh.indices.size() / 3;
+            if (triangles > 0 && triangles + meshTriangles > triangleBudget)
+                continue;
+
+            Occluder& occluder = occluders[i];
+            occluder.enabled = true;
+            for (const Vertex& v : mesh.vertices)
+                occluder.positions.push_back(v.Position);
+            occluder.indices = mesh.indices;
+            triangles += meshTriangles;
+        }
+    }
+
+    // Упрощённая геометрия вместо меша; должна целиком лежать внутри исходного меша
+    void SetOccluderProxy(size_t meshIndex, const std::vector<glm::vec3>& positions,
+        const std::vector<unsigned int>& indices) {
+        Occluder& occluder = occluders[meshIndex];
+        occluder.enabled = true;
+        occluder.positions = positions;
+        occluder.indices = indices;
+    }
+
+    // Запуск растеризации и проверки в фоне; transforms - итоговые матрицы мешей (копируются)
+    void Begin(const glm::mat4& viewProj, const std::vector<glm::mat4>& transforms) {
+        pending = jobs.Schedule([this, viewProj, transforms]() {
+            run(viewProj, transforms);
+        });
+    }
+
+    // Ожидание результата и запись видимости мешей в meshVisible
+    void End(std::vector<char>& meshVisible) {
+        if (!pending)
+            return;
+        jobs.Wait(pending);
+        pending = nullptr;
+        meshVisible.assign(visible.begin(), visible.end());
+    }
+
+    const Stats& stats() const {
+        return lastStats;
+    }
+
+private:
+    struct Occluder {
+        bool enabled = false;
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+    };
+
+    struct ScreenTriangle {
+        glm::vec3 v[3];
+        int minX, minY, maxX, maxY;
+    };
+
+    Model& model;
+    JobSystem& jobs;
+    std::vector<Occluder> occluders;
+    std::vector<float> depth;
+    std::vector<ScreenTriangle> triangles;
+    std::vector<unsigned int> bins[TILES_X * TILES_Y];
+    std::vector<char> visible;
+    JobSystem::JobHandle pending;
+    Stats lastStats;
+
+    static float volume(const Mesh& mesh) {
+        glm::vec3 size = mesh.aabbMax - mesh.aabbMin;
+        return size.x * size.y * size.z;
+    }
+
+    void run(const glm::mat4& viewProj, const std::vector<glm::mat4>& transforms) {
+        Stats stats;
+        triangles.clear();
+        for (std::vector<unsigned int>& bin : bins)
+            bin.clear();
+
+        for (size_t i = 0; i < occluders.size(); ++i) {
+            if (!occluders[i].enabled)
+                continue;
+            stats.occluders++;
+            stats.occluderTriangles += setupTriangles(occluders[i], viewProj * transforms[i]);
+        }
+
+        binTriangles();
+        rasterizeTiles();
+
+        visible.assign(model.meshes.size(), 1);
+        jobs.ParallelFor(model.meshes.size(), 64, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const Mesh& mesh = model.meshes[i];
+                visible[i] = testBounds(viewProj * transforms[i], mesh.aabbMin, mesh.aabbMax);
+            }
+        });
+
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            const Mesh& mesh = model.meshes[i];
+            stats.testedMeshes++;
+            if (!visible[i]) {
+                stats.culledMeshes++;
+                stats.culledTriangles += (unsigned int)mesh.indices.size() / 3;
+            }
+        }
+
+        lastStats = stats;
+    }
+
+    // Перевод в экранные координаты буфера. Треугольники отсекаются ближней плоскостью (z >= -w)
+    // в пространстве отсечения: иначе окклюдер, пересекающий её, проецировался бы с неверной
+    // глубиной и закрывал бы меши, которые на самом деле видны
+    unsigned int setupTriangles(const Occluder& occluder, const glm::mat4& mvp) {
+        std::vector<glm::vec4> clip(occluder.positions.size());
+        for (size_t i = 0; i < clip.size(); ++i)
+            clip[i] = mvp * glm::vec4(occluder.positions[i], 1.0f);
+
+        unsigned int count = 0;
+        for (size_t t = 0; t + 2 < occluder.indices.size(); t += 3) {
+            glm::vec4 polygon[4];
+            int size = 0;
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec4& a = clip[occluder.indices[t + k]];
+                const glm::vec4& b = clip[occluder.indices[t + (k + 1) % 3]];
+                float da = a.z + a.w, db = b.z + b.w;
+                if (da >= 0.0f)
+                    polygon[size++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f))
+                    polygon[size++] = a + (b - a) * (da / (da - db));
+            }
+            for (int k = 1; k + 1 < size; ++k) {
+                if (addTriangle(polygon[0], polygon[k], polygon[k + 1]))
+                    count++;
+            }
+        }
+        return count;
+    }
+
+    // Треугольник перед ближней плоскостью в список растеризации; false - не попал в буфер
+    bool addTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2) {
+        const glm::vec4 corners[3] = { c0, c1, c2 };
+        ScreenTriangle tri;
+        for (int k = 0; k < 3; ++k) {
+            const glm::vec4& c = corners[k];
+            if (c.w <= 1e-6f)
+                return false;
+            glm::vec3 ndc = glm::vec3(c) / c.w;
+            tri.v[k] = glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z * 0.5f + 0.5f);
+        }
+
+        // Обход против часовой стрелки, чтобы функции рёбер были неотрицательны внутри
+        float area = edge(tri.v[0], tri.v[1], tri.v[2]);
+        if (area == 0.0f)
+            return false;
+        if (area < 0.0f)
+            std::swap(tri.v[1], tri.v[2]);
+
+        tri.minX = std::max(0, (int)std::floor(std::min({ tri.v[0].x, tri.v[1].x, tri.v[2].x })));
+        tri.minY = std::max(0, (int)std::floor(std::min({ tri.v[0].y, tri.v[1].y, tri.v[2].y })));
+        tri.maxX = std::min(WIDTH - 1, (int)std::ceil(std::max({ tri.v[0].x, tri.v[1].x, tri.v[2].x })));
+        tri.maxY = std::min(HEIGHT - 1, (int)std::ceil(std::max({ tri.v[0].y, tri.v[1].y, tri.v[2].y })));
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+            return false;
+        if (std::min({ tri.v[0].z, tri.v[1].z, tri.v[2].z }) > 1.0f)
+            return false;
+
+        triangles.push_back(tri);
+        return true;
+    }
+
+    void binTriangles() {
+        for (unsigned int t = 0; t < triangles.size(); ++t) {
+            const ScreenTriangle& tri = triangles[t];
+            for (int ty = tri.minY / TILE_HEIGHT; ty <= tri.maxY / TILE_HEIGHT; ++ty)
+                for (int tx = tri.minX / TILE_WIDTH; tx <= tri.maxX / TILE_WIDTH; ++tx)
+                    bins[ty * TILES_X + tx].push_back(t);
+        }
+    }
+
+    void rasterizeTiles() {
+        jobs.ParallelFor(TILES_X * TILES_Y, 1, [this](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; ++tile)
+                rasterizeTile((int)tile);
+        });
+    }
+
+    static float edge(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    }
+
+    void rasterizeTile(int tile) {
+        int tileX0 = (tile % TILES_X) * TILE_WIDTH;
+        int tileY0 = (tile / TILES_X) * TILE_HEIGHT;
+
+        for (int y = tileY0; y < tileY0 + TILE_HEIGHT; ++y)
+            std::fill(depth.begin() + y * WIDTH + tileX0, depth.begin() + y * WIDTH + tileX0 + TILE_WIDTH, 1.0f);
+
+        for (unsigned int t : bins[tile]) {
+            const ScreenTriangle& tri = triangles[t];
+            const glm::vec3& v0 = tri.v[0];
+            const glm::vec3& v1 = tri.v[1];
+            const glm::vec3& v2 = tri.v[2];
+            float invArea = 1.0f / edge(v0, v1, v2);
+
+            // Начало строки выровнено на 8 пикселей внутри тайла
+            int x0 = tileX0 + ((std::max(tri.minX, tileX0) - tileX0) & ~7);
+            int x1 = std::min(tri.maxX, tileX0 + TILE_WIDTH - 1);
+            int y0 = std::max(tri.minY, tileY0);
+            int y1 = std::min(tri.maxY, tileY0 + TILE_HEIGHT - 1);
+
+            // w_i(x, y) = a_i * x + b_i * y + c_i, глубина интерполируется весами w_i / area
+            float a0 = (v1.y - v2.y), b0 = (v2.x - v1.x), c0 = v1.x * v2.y - v1.y * v2.x;
+            float a1 = (v2.y - v0.y), b1 = (v0.x - v2.x), c1 = v2.x * v0.y - v2.y * v0.x;
+            float a2 = (v0.y - v1.y), b2 = (v1.x - v0.x), c2 = v0.x * v1.y - v0.y * v1.x;
+            float z1 = (v1.z - v0.z) * invArea, z2 = (v2.z - v0.z) * invArea;
+
+            for (int y = y0; y <= y1; ++y) {
+                float py = y + 0.5f;
+                float* row = &depth[y * WIDTH];
+                int x = x0;
+#ifdef __AVX2__
+                const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+                const __m256 zero = _mm256_setzero_ps();
+                for (; x <= x1; x += 8) {
+                    __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), lane);
+                    __m256 w0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a0), px), _mm256_set1_ps(b0 * py + c0));
+                    __m256 w1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a1), px), _mm256_set1_ps(b1 * py + c1));
+                    __m256 w2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a2), px), _mm256_set1_ps(b2 * py + c2));
+                    __m256 inside = _mm256_and_ps(_mm256_cmp_ps(w0, zero, _CMP_GE_OQ),
+                        _mm256_and_ps(_mm256_cmp_ps(w1, zero, _CMP_GE_OQ), _mm256_cmp_ps(w2, zero, _CMP_GE_OQ)));
+                    if (_mm256_movemask_ps(inside) == 0)
+                        continue;
+
+                    __m256 z = _mm256_add_ps(_mm256_set1_ps(v0.z), _mm256_add_ps(
+                        _mm256_mul_ps(w1, _mm256_set1_ps(z1)), _mm256_mul_ps(w2, _mm256_set1_ps(z2))));
+                    __m256 old = _mm256_loadu_ps(row + x);
+                    __m256 closer = _mm256_and_ps(inside, _mm256_cmp_ps(z, old, _CMP_LT_OQ));
+                    _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, z, closer));
+                }
+#endif
+                for (; x <= x1; ++x) {
+                    float px = x + 0.5f;
+                    float w0 = a0 * px + b0 * py + c0;
+                    float w1 = a1 * px + b1 * py + c1;
+                    float w2 = a2 * px + b2 * py + c2;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+                    float z = v0.z + w1 * z1 + w2 * z2;
+                    if (z < row[x])
+                        row[x] = z;
+                }
+            }
+        }
+    }
+
+    // true, если хотя бы один пиксель прямоугольника меша дальше его ближайшей точки
+    bool testBounds(const glm::mat4& mvp, const glm::vec3& bmin, const glm::vec3& bmax) const {
+        glm::vec2 lo(1e30f), hi(-1e30f);
+        float nearest = 1.0f;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec4 c = mvp * glm::vec4((i & 1) ? bmax.x : bmin.x, (i & 2) ? bmax.y : bmin.y,
+                (i & 4) ? bmax.z : bmin.z, 1.0f);
+            // Прямоугольник, пересекающий ближнюю плоскость, считается видимым
+            if (c.w <= 1e-4f || c.z < -c.w)
+                return true;
+            glm::vec3 ndc = glm::vec3(c) / c.w;
+            lo = glm::min(lo, glm::vec2(ndc));
+            hi = glm::max(hi, glm::vec2(ndc));
+            nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+
+        // Вне пирамиды видимости меш тоже не рисуется
+        if (hi.x < -1.0f || hi.y < -1.0f || lo.x > 1.0f || lo.y > 1.0f || nearest >= 1.0f)
+            return false;
+
+        int x0 = std::max(0, (int)std::floor((lo.x * 0.5f + 0.5f) * WIDTH));
+        int y0 = std::max(0, (int)std::floor((lo.y * 0.5f + 0.5f) * HEIGHT));
+        int x1 = std::min(WIDTH - 1, (int)std::ceil((hi.x * 0.5f + 0.5f) * WIDTH));
+        int y1 = std::min(HEIGHT - 1, (int)std::ceil((hi.y * 0.5f + 0.5f) * HEIGHT));
+
+        for (int y = y0; y <= y1; ++y) {
+            const float* row = &depth[y * WIDTH];
+            int x = x0;
+#ifdef __AVX2__
+            __m256 z = _mm256_set1_ps(nearest);
+            for (; x + 8 <= x1 + 1; x += 8) {
+                if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + x), z, _CMP_GE_OQ)) != 0)
+                    return true;
+            }
+#endif
+            for (; x <= x1; ++x) {
+                if (row[x] >= nearest)
+                    return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // SOFTWARE_OCCLUSION_H
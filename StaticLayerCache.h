@@ -0,0 +1,167 @@
+#ifndef STATIC_LAYER_CACHE_H
+#define STATIC_LAYER_CACHE_H
+
+#include <vector>
+#include <glm.hpp>
+#include "Shader.h"
+#include "Model.h"
+#include "DepthPrepass.h"
+
+// Кэш неподвижного слоя сцены. Статические меши (model.meshStatic) рисуются в собственные
+// цвет и глубину, пока не изменятся камера, размер кадра, положение или видимость статических мешей;
+// в остальных кадрах слой копируется в основной буфер через glBlitFramebuffer,
+// и поверх него рисуются только подвижные меши.
+class StaticLayerCache {
+public:
+    struct Stats {
+        unsigned int rebuilds = 0;      // перерисовок слоя за период
+        unsigned int reusedFrames = 0;  // кадров, взявших слой из кэша
+        unsigned int staticMeshes = 0;
+        unsigned int staticTriangles = 0; // не рисуются в кадрах из кэша
+    };
+
+    StaticLayerCache(Model& model)
+        : model(model) {
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (!model.meshStatic[i])
+                continue;
+            totals.staticMeshes++;
+            totals.staticTriangles += (unsigned int)model.meshes[i].indices.size() / 3;
+        }
+        periodStats = totals;
+    }
+
+    // Слои рисуются через предварительный проход по глубине (nullptr - напрямую)
+    void SetPrepass(DepthPrepass* newPrepass) {
+        prepass = newPrepass;
+    }
+
+    // Принудительная перерисовка слоя в следующем кадре
+    void Invalidate() {
+        valid = false;
+    }
+
+    // Кадр целиком: слой из кэша (или его перерисовка) и подвижные меши поверх.
+    // Целевой буфер (основной или внеэкранный) должен быть привязан, параметры камеры в shader уже заданы.
+    void Draw(Shader& shader, const glm::mat4& viewProj, int width, int height) {
+        GLint target = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        resize(width, height);
+
+        if (!valid || !matches(viewProj)) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // Без условной отрисовки: результат запроса кадра перестройки остался бы в слое
+            // на все кадры из кэша, и пропущенный по устаревшему запросу меш не вернулся бы
+            std::vector<unsigned int> queries(model.meshQueries.size(), 0);
+            std::swap(queries, model.meshQueries);
+            drawLayer(shader, Model::DRAW_STATIC);
+            std::swap(queries, model.meshQueries);
+            glBindFramebuffer(GL_FRAMEBUFFER, target);
+            remember(viewProj);
+            periodStats.rebuilds++;
+        }
+        else {
+            periodStats.reusedFrames++;
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+            GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+        drawLayer(shader, Model::DRAW_DYNAMIC);
+    }
+
+    // Счётчики с прошлого вызова
+    Stats TakeStats() {
+        Stats stats = periodStats;
+        periodStats = totals;
+        return stats;
+    }
+
+private:
+    Model& model;
+    DepthPrepass* prepass = nullptr;
+    unsigned int framebuffer = 0;
+    unsigned int colorTexture = 0;
+    unsigned int depthBuffer = 0;
+    int width = 0;
+    int height = 0;
+
+    bool valid = false;
+    glm::mat4 cachedViewProj = glm::mat4(1.0f);
+    std::vector<glm::mat4> cachedTransforms;
+    std::vector<char> cachedVisible;
+
+    Stats totals;
+    Stats periodStats;
+
+    void drawLayer(Shader& shader, Model::DrawLayer layer) {
+        if (prepass)
+            prepass->Draw(shader, layer);
+        else
+            model.Draw(shader, layer);
+    }
+
+    bool matches(const glm::mat4& viewProj) const {
+        if (viewProj != cachedViewProj)
+            return false;
+        for (size_t i = 0, k = 0; i < model.meshes.size(); ++i) {
+            if (!model.meshStatic[i])
+                continue;
+            if (model.meshVisible[i] != cachedVisible[k] || model.WorldTransform(i) != cachedTransforms[k])
+                return false;
+            k++;
+        }
+        return true;
+    }
+
+    void remember(const glm::mat4& viewProj) {
+        cachedViewProj = viewProj;
+        cachedTransforms.clear();
+        cachedVisible.clear();
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (!model.meshStatic[i])
+                continue;
+            cachedTransforms.push_back(model.WorldTransform(i));
+            cachedVisible.push_back(model.meshVisible[i]);
+        }
+        valid = true;
+    }
+
+    // Формат глубины совпадает с основным буфером (24 бита глубины + 8 трафарета), иначе blit не сработает
+    void resize(int newWidth, int newHeight) {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+        valid = false;
+
+        if (!framebuffer) {
+            glGenFramebuffers(1, &framebuffer);
+            glGenTextures(1, &colorTexture);
+            glGenRenderbuffers(1, &depthBuffer);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::STATIC_LAYER::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+#endif // STATIC_LAYER_CACHE_H
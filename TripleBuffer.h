@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Обмен данными между одним писателем и одним читателем без блокировок.
+// Писатель заполняет Back() и публикует его, читатель забирает самый свежий опубликованный слот.
+// Ни одна сторона не ждёт другую: промежуточные версии, которые читатель не успел взять, теряются.
+template <typename T>
+class TripleBuffer {
+public:
+    // Слот писателя
+    T& Back() {
+        return slots[back];
+    }
+
+    // Публикация Back(); писатель получает освободившийся слот
+    void Publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // true, если с прошлого вызова опубликована новая версия; она становится Front()
+    bool Acquire() {
+        if (!(middle.load(std::memory_order_acquire) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // Есть ли версия, ещё не взятая читателем
+    bool Fresh() const {
+        return (middle.load(std::memory_order_acquire) & FRESH) != 0;
+    }
+
+    // Слот читателя
+    const T& Front() const {
+        return slots[front];
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;
+
+    T slots[3];
+    int back = 0;
+    int front = 1;
+    std::atomic<int> middle{ 2 };
+};
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,248 @@
+#ifndef VERTEX_PULLING_H
+#define VERTEX_PULLING_H
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "Model.h"
+#include "GpuTimer.h"
+
+// Программная выборка вершин. Геометрия всех мешей лежит в одном SSBO 32-битными словами,
+// вершинный шейдер (pulling_vertex.glsl) сам читает их по gl_VertexID - gl_BaseVertex,
+// а смещение, формат и матрицы берёт из записи прохода по gl_DrawID. Форматов два:
+// полный (позиция и нормаль, 6 слов) и сжатый (позиция и нормаль в октаэдрической развёртке
+// snorm16x2, 4 слова); формат выбирается для каждой геометрии. За словами вершин в том же SSBO
+// лежат потоки запечённого затенения по байту на вершину, они копируются заново при изменении.
+// Видимые меши любых форматов
+// рисуются одним glMultiDrawElementsIndirect с единственным пустым VAO (в нём только общий
+// индексный буфер). Условная отрисовка по запросам видимости в этом пути не используется.
+class VertexPulling {
+public:
+    static const unsigned int VERTICES_BINDING = 10; // layout(binding = ...) в pulling_vertex.glsl
+    static const unsigned int DRAWS_BINDING = 11;
+    enum Format { FORMAT_FULL = 0, FORMAT_COMPACT = 1 };
+
+    struct Stats {
+        unsigned int frames = 0;
+        unsigned int draws = 0;        // команд в последнем вызове
+        unsigned int compactGeometries = 0;
+        unsigned int fullGeometries = 0;
+        size_t vertexBytes = 0;        // общий буфер вершин
+        size_t fixedBytes = 0;         // те же вершины в формате Vertex
+        double gpuMs = 0.0;
+    };
+
+    // compressNormals - сжимать нормали там, где это возможно (у геометрии без нормалей
+    // нулевые векторы не имеют развёртки, она остаётся в полном формате)
+    VertexPulling(Model& model, const std::string& defines = "", bool compressNormals = true)
+        : model(model), shader("pulling_vertex.glsl", "fragment_shader.glsl", defines) {
+        buildBuffers(compressNormals);
+    }
+
+    // Программа пути: материал, источники и тени задаются в ней так же, как в основной
+    Shader& GetShader() {
+        return shader;
+    }
+
+    // Все видимые меши одним вызовом
+    void Draw(const glm::mat4& view, const glm::mat4& projection, bool lateLatched) {
+        syncOcclusion();
+        timer.Begin();
+        commands.clear();
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (!model.meshVisible[i] || model.meshes[i].indices.empty())
+                continue;
+            const Geometry& geometry = geometries[model.meshGeometry[i]];
+            DrawRecord& draw = draws[commands.size()];
+            draw.world = model.WorldTransform(i);
+            draw.normalMatrix = glm::transpose(glm::inverse(draw.world));
+            draw.firstWord = geometry.firstWord;
+            draw.format = geometry.format;
+            draw.occlusionByte = geometry.occlusionByte;
+            commands.push_back({ (unsigned int)model.meshes[i].indices.size(), 1, geometry.firstIndex, geometry.baseVertex, 0 });
+        }
+
+        if (!commands.empty()) {
+            glNamedBufferSubData(drawBuffer, 0, commands.size() * sizeof(DrawRecord), draws.data());
+            glNamedBufferSubData(commandBuffer, 0, commands.size() * sizeof(Command), commands.data());
+
+            shader.use();
+            shader.setMat4("view", view);
+            shader.setMat4("projection", projection);
+            shader.setBool("lateLatched", lateLatched);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTICES_BINDING, vertexBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAWS_BINDING, drawBuffer);
+            glBindVertexArray(emptyVAO);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)commands.size(), 0);
+            glBindVertexArray(0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        timer.End();
+
+        period.frames++;
+        period.draws = (unsigned int)commands.size();
+    }
+
+    Stats TakeStats() {
+        Stats stats = period;
+        stats.compactGeometries = summary.compactGeometries;
+        stats.fullGeometries = summary.fullGeometries;
+        stats.vertexBytes = summary.vertexBytes;
+        stats.fixedBytes = summary.fixedBytes;
+        stats.gpuMs = timer.TakeAverageMs();
+        period = Stats();
+        return stats;
+    }
+
+    // Ожидание всех замеров (для бенчмарков)
+    void FinishTimers() {
+        timer.Finish();
+    }
+
+private:
+    // Запись прохода в формате std430, см. PulledDraw в pulling_vertex.glsl
+    struct DrawRecord {
+        glm::mat4 world;
+        glm::mat4 normalMatrix;
+        unsigned int firstWord;
+        unsigned int format;
+        unsigned int occlusionByte; // смещение потока затенения в буфере вершин, байт
+        unsigned int pad;
+    };
+
+    // Команда glMultiDrawElementsIndirect
+    struct Command {
+        unsigned int count;
+        unsigned int instanceCount;
+        unsigned int firstIndex;
+        unsigned int baseVertex;
+        unsigned int baseInstance;
+    };
+
+    struct Geometry {
+        unsigned int firstWord = 0;
+        unsigned int firstIndex = 0;
+        unsigned int baseVertex = 0;
+        unsigned int format = FORMAT_FULL;
+        unsigned int occlusionByte = 0;
+        unsigned int occlusionVersion = ~0u; // скопированная версия Mesh::OcclusionVersion
+    };
+
+    Model& model;
+    Shader shader;
+    std::vector<Geometry> geometries; // по индексу меша-источника
+    std::vector<DrawRecord> draws;
+    std::vector<Command> commands;
+    unsigned int vertexBuffer = 0, indexBuffer = 0, drawBuffer = 0, commandBuffer = 0;
+    unsigned int emptyVAO = 0;
+    GpuTimer timer;
+    Stats summary;
+    Stats period;
+
+    // Октаэдрическая развёртка единичного вектора в [-1, 1]^2
+    static glm::vec2 octEncode(glm::vec3 n) {
+        n /= std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+        glm::vec2 p(n.x, n.y);
+        if (n.z < 0.0f)
+            p = glm::vec2((1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+        return p;
+    }
+
+    // Как packSnorm2x16 в GLSL
+    static unsigned int packSnorm2x16(glm::vec2 v) {
+        unsigned int x = (unsigned int)(int)std::round(glm::clamp(v.x, -1.0f, 1.0f) * 32767.0f) & 0xFFFFu;
+        unsigned int y = (unsigned int)(int)std::round(glm::clamp(v.y, -1.0f, 1.0f) * 32767.0f) & 0xFFFFu;
+        return x | (y << 16);
+    }
+
+    static unsigned int floatBits(float value) {
+        unsigned int bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // Общие буферы: каждая уникальная геометрия один раз, в своём формате
+    void buildBuffers(bool compressNormals) {
+        std::vector<unsigned int> words;
+        std::vector<unsigned int> indices;
+        geometries.resize(model.meshes.size());
+        unsigned int vertexCount = 0;
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (model.meshGeometry[i] != (int)i)
+                continue;
+            const Mesh& mesh = model.meshes[i];
+            bool compact = compressNormals;
+            for (const Vertex& v : mesh.vertices)
+                if (glm::dot(v.Normal, v.Normal) < 1e-12f)
+                    compact = false;
+
+            Geometry& geometry = geometries[i];
+            geometry.firstWord = (unsigned int)words.size();
+            geometry.firstIndex = (unsigned int)indices.size();
+            geometry.baseVertex = vertexCount;
+            geometry.format = compact ? FORMAT_COMPACT : FORMAT_FULL;
+            for (const Vertex& v : mesh.vertices) {
+                words.push_back(floatBits(v.Position.x));
+                words.push_back(floatBits(v.Position.y));
+                words.push_back(floatBits(v.Position.z));
+                if (compact) {
+                    words.push_back(packSnorm2x16(octEncode(v.Normal)));
+                }
+                else {
+                    words.push_back(floatBits(v.Normal.x));
+                    words.push_back(floatBits(v.Normal.y));
+                    words.push_back(floatBits(v.Normal.z));
+                }
+            }
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+            vertexCount += (unsigned int)mesh.vertices.size();
+
+            (compact ? summary.compactGeometries : summary.fullGeometries)++;
+            summary.fixedBytes += mesh.vertices.size() * sizeof(Vertex);
+        }
+        size_t occlusionStart = words.size() * sizeof(unsigned int);
+        for (size_t i = 0; i < model.meshes.size(); ++i)
+            if (model.meshGeometry[i] == (int)i)
+                geometries[i].occlusionByte = (unsigned int)occlusionStart + geometries[i].baseVertex;
+        words.resize(words.size() + (vertexCount + 3) / 4, 0xFFFFFFFFu);
+        summary.vertexBytes = words.size() * sizeof(unsigned int);
+
+        glCreateBuffers(1, &vertexBuffer);
+        glNamedBufferStorage(vertexBuffer, std::max<size_t>(words.size(), 1) * sizeof(unsigned int),
+            words.empty() ? NULL : words.data(), 0);
+
+        draws.resize(std::max<size_t>(model.meshes.size(), 1));
+        glCreateBuffers(1, &drawBuffer);
+        glNamedBufferStorage(drawBuffer, draws.size() * sizeof(DrawRecord), NULL, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &commandBuffer);
+        glNamedBufferStorage(commandBuffer, draws.size() * sizeof(Command), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+        // Пустой VAO: атрибутов нет, только индексный буфер
+        glCreateBuffers(1, &indexBuffer);
+        glNamedBufferStorage(indexBuffer, std::max<size_t>(indices.size(), 1) * sizeof(unsigned int),
+            indices.empty() ? NULL : indices.data(), 0);
+        glCreateVertexArrays(1, &emptyVAO);
+        glVertexArrayElementBuffer(emptyVAO, indexBuffer);
+    }
+
+    // Копирование на GPU изменившихся потоков затенения (AmbientOcclusionBaker)
+    void syncOcclusion() {
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            const Mesh& mesh = model.meshes[i];
+            Geometry& geometry = geometries[i];
+            if (model.meshGeometry[i] != (int)i || mesh.vertices.empty() || geometry.occlusionVersion == mesh.OcclusionVersion())
+                continue;
+            glCopyNamedBufferSubData(mesh.OcclusionBuffer(), vertexBuffer, 0, geometry.occlusionByte, mesh.vertices.size());
+            geometry.occlusionVersion = mesh.OcclusionVersion();
+        }
+    }
+};
+
+#endif // VERTEX_PULLING_H
@@ -0,0 +1,289 @@
+#ifndef VISIBILITY_BUFFER_H
+#define VISIBILITY_BUFFER_H
+
+#include <string>
+#include <vector>
+#include <glm.hpp>
+#include <GL/glew.h>
+#include "Shader.h"
+#include "Model.h"
+#include "GpuTimer.h"
+
+// Отрисовка через буфер видимости. Геометрический проход пишет только глубину и 32-битный номер
+// треугольника в общей нумерации всех мешей (потоки позиций, без затенения); полноэкранный проход
+// находит по номеру меш и треугольник, восстанавливает позицию и нормаль из буферов вершин и индексов
+// и выполняет освещение из fragment_shader.glsl (вариант VISIBILITY_RESOLVE) по разу на пиксель.
+// Буферы мешей копируются на GPU в общие SSBO один раз при создании; запечённое затенение
+// (байт на вершину в конце буфера вершин) копируется заново при его изменении.
+class VisibilityBuffer {
+public:
+    static const unsigned int VERTICES_BINDING = 7; // layout(binding = ...) в fragment_shader.glsl
+    static const unsigned int INDICES_BINDING = 8;
+    static const unsigned int INSTANCES_BINDING = 9;
+    static const int ID_UNIT = 3;                   // текстурный блок буфера видимости
+
+    struct Stats {
+        unsigned int frames = 0;
+        unsigned int meshes = 0;      // нарисовано за кадр
+        unsigned int triangles = 0;
+        double geometryMs = 0.0;      // средние времена проходов на GPU
+        double resolveMs = 0.0;
+    };
+
+    // defines - те же определения варианта, что и у основного шейдера (SHADOW_PCF и т.п.)
+    VisibilityBuffer(Model& model, const std::string& defines = "")
+        : model(model), geometryShader("visbuffer_vertex.glsl", "visbuffer_fragment.glsl"),
+        resolveShader("fullscreen_vertex.glsl", "fragment_shader.glsl", defines + "#define VISIBILITY_RESOLVE\n") {
+        model.EnablePositionStreams();
+        buildBuffers();
+        glGenVertexArrays(1, &emptyVAO);
+        modelLocation = glGetUniformLocation(geometryShader.ID, "model");
+        triangleBaseLocation = glGetUniformLocation(geometryShader.ID, "triangleBase");
+    }
+
+    // Программа полноэкранного прохода: материал, источники и тени задаются в ней так же, как в основной
+    Shader& ResolveShader() {
+        return resolveShader;
+    }
+
+    // Кадр целиком в привязанный целевой буфер; глубина копируется в него для последующих проходов
+    void Draw(const glm::mat4& view, const glm::mat4& projection, bool lateLatched, int width, int height) {
+        DrawGeometry(view, projection, lateLatched, width, height);
+        Resolve(view, projection, lateLatched);
+    }
+
+    // Только геометрический проход: после него глубина кадра доступна в DepthTexture()
+    // (width x height) для проходов, идущих до Resolve
+    void DrawGeometry(const glm::mat4& view, const glm::mat4& projection, bool lateLatched, int width, int height) {
+        GLint target = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        resize(width, height);
+        uploadInstances();
+
+        geometryTimer.Begin();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        GLuint empty[] = { 0, 0, 0, 0 };
+        glClearBufferuiv(GL_COLOR, 0, empty);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        geometryShader.use();
+        geometryShader.setMat4("view", view);
+        geometryShader.setMat4("projection", projection);
+        geometryShader.setBool("lateLatched", lateLatched);
+        unsigned int meshes = 0, triangles = 0;
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (!model.meshVisible[i])
+                continue;
+            const Mesh& mesh = model.meshes[i];
+            glm::mat4 world = model.WorldTransform(i);
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &world[0][0]);
+            glUniform1ui(triangleBaseLocation, instances[i].triangleBase);
+            mesh.BindBuffers(Mesh::FORMAT_POSITION);
+            glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, 0);
+            meshes++;
+            triangles += (unsigned int)mesh.indices.size() / 3;
+        }
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        geometryTimer.End();
+
+        period.meshes = meshes;
+        period.triangles = triangles;
+    }
+
+    // Глубина и полноэкранный проход в привязанный целевой буфер по результату DrawGeometry
+    void Resolve(const glm::mat4& view, const glm::mat4& projection, bool lateLatched) {
+        GLint target = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        syncOcclusion();
+        resolveTimer.Begin();
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+        resolveShader.use();
+        resolveShader.setMat4("view", view);
+        resolveShader.setMat4("projection", projection);
+        resolveShader.setBool("lateLatched", lateLatched);
+        resolveShader.setInt("visibilityBuffer", ID_UNIT);
+        resolveShader.setUint("visibilityInstanceCount", (unsigned int)instances.size());
+        glActiveTexture(GL_TEXTURE0 + ID_UNIT);
+        glBindTexture(GL_TEXTURE_2D, idTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTICES_BINDING, vertexBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDICES_BINDING, indexBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, instanceBuffer);
+
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+        resolveTimer.End();
+        period.frames++;
+    }
+
+    // Глубина последнего геометрического прохода (24 + 8)
+    unsigned int DepthTexture() const {
+        return depthTexture;
+    }
+
+    // Статистика с прошлого вызова
+    Stats TakeStats() {
+        Stats stats = period;
+        stats.geometryMs = geometryTimer.TakeAverageMs();
+        stats.resolveMs = resolveTimer.TakeAverageMs();
+        period = Stats();
+        return stats;
+    }
+
+    // Ожидание всех замеров (для бенчмарков)
+    void FinishTimers() {
+        geometryTimer.Finish();
+        resolveTimer.Finish();
+    }
+
+private:
+    // Экземпляр в формате std430, см. VisibilityInstance в fragment_shader.glsl
+    struct Instance {
+        glm::mat4 world;
+        glm::mat4 normalMatrix;
+        unsigned int triangleBase;
+        unsigned int firstIndex;
+        unsigned int baseVertex;
+        unsigned int occlusionByte; // смещение потока затенения геометрии в буфере вершин, байт
+    };
+
+    Model& model;
+    Shader geometryShader;
+    Shader resolveShader;
+    int modelLocation = -1;
+    int triangleBaseLocation = -1;
+    std::vector<Instance> instances; // по мешу на экземпляр, в порядке возрастания triangleBase
+    std::vector<unsigned int> occlusionVersions; // скопированные версии Mesh::OcclusionVersion по геометрии
+    size_t occlusionStart = 0;                   // начало потоков затенения в буфере вершин, байт
+    unsigned int vertexBuffer = 0, indexBuffer = 0, instanceBuffer = 0;
+    unsigned int framebuffer = 0, idTexture = 0, depthTexture = 0;
+    unsigned int emptyVAO = 0;
+    int width = 0;
+    int height = 0;
+
+    GpuTimer geometryTimer;
+    GpuTimer resolveTimer;
+    Stats period;
+
+    // Общие буферы вершин и индексов: каждая уникальная геометрия копируется один раз
+    void buildBuffers() {
+        std::vector<unsigned int> firstIndex(model.meshes.size(), 0), baseVertex(model.meshes.size(), 0);
+        size_t vertexCount = 0, indexCount = 0;
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (model.meshGeometry[i] != (int)i)
+                continue;
+            baseVertex[i] = (unsigned int)vertexCount;
+            firstIndex[i] = (unsigned int)indexCount;
+            vertexCount += model.meshes[i].vertices.size();
+            indexCount += model.meshes[i].indices.size();
+        }
+
+        // Неизменяемое хранилище: копирование на GPU флагов не требует.
+        // За вершинами - потоки затенения по байту на вершину, выровненные до слова
+        occlusionStart = vertexCount * sizeof(Vertex);
+        glCreateBuffers(1, &vertexBuffer);
+        glNamedBufferStorage(vertexBuffer, std::max<size_t>(occlusionStart + (vertexCount + 3) / 4 * 4, 1), NULL, 0);
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (model.meshGeometry[i] != (int)i || model.meshes[i].vertices.empty())
+                continue;
+            glCopyNamedBufferSubData(model.meshes[i].VertexBuffer(), vertexBuffer, 0, baseVertex[i] * sizeof(Vertex),
+                model.meshes[i].vertices.size() * sizeof(Vertex));
+        }
+
+        glCreateBuffers(1, &indexBuffer);
+        glNamedBufferStorage(indexBuffer, std::max<size_t>(indexCount, 1) * sizeof(unsigned int), NULL, 0);
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            if (model.meshGeometry[i] != (int)i || model.meshes[i].indices.empty())
+                continue;
+            glCopyNamedBufferSubData(model.meshes[i].IndexBuffer(), indexBuffer, 0, firstIndex[i] * sizeof(unsigned int),
+                model.meshes[i].indices.size() * sizeof(unsigned int));
+        }
+
+        // Нумерация треугольников начинается с 1: ноль в буфере видимости - пустой пиксель
+        unsigned int triangleBase = 1;
+        instances.resize(model.meshes.size());
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            int geometry = model.meshGeometry[i];
+            instances[i].triangleBase = triangleBase;
+            instances[i].firstIndex = firstIndex[geometry];
+            instances[i].baseVertex = baseVertex[geometry];
+            instances[i].occlusionByte = (unsigned int)(occlusionStart + baseVertex[geometry]);
+            triangleBase += (unsigned int)model.meshes[i].indices.size() / 3;
+        }
+
+        glCreateBuffers(1, &instanceBuffer);
+        glNamedBufferStorage(instanceBuffer, std::max<size_t>(instances.size(), 1) * sizeof(Instance), NULL, GL_DYNAMIC_STORAGE_BIT);
+
+        // Ни одна версия не совпадает: при первом Resolve копируются все потоки
+        occlusionVersions.assign(model.meshes.size(), ~0u);
+    }
+
+    // Копирование на GPU изменившихся потоков затенения (AmbientOcclusionBaker)
+    void syncOcclusion() {
+        for (size_t i = 0; i < model.meshes.size(); ++i) {
+            const Mesh& mesh = model.meshes[i];
+            if (model.meshGeometry[i] != (int)i || mesh.vertices.empty() || occlusionVersions[i] == mesh.OcclusionVersion())
+                continue;
+            glCopyNamedBufferSubData(mesh.OcclusionBuffer(), vertexBuffer, 0, instances[i].occlusionByte, mesh.vertices.size());
+            occlusionVersions[i] = mesh.OcclusionVersion();
+        }
+    }
+
+    void uploadInstances() {
+        for (size_t i = 0; i < instances.size(); ++i) {
+            instances[i].world = model.WorldTransform(i);
+            instances[i].normalMatrix = glm::transpose(glm::inverse(instances[i].world));
+        }
+        if (instances.empty())
+            return;
+        glNamedBufferSubData(instanceBuffer, 0, instances.size() * sizeof(Instance), instances.data());
+    }
+
+    // Глубина в формате основного буфера (24 + 8), чтобы её можно было скопировать blit'ом
+    void resize(int newWidth, int newHeight) {
+        if (newWidth == width && newHeight == height)
+            return;
+        width = newWidth;
+        height = newHeight;
+
+        if (!framebuffer)
+            glGenFramebuffers(1, &framebuffer);
+        if (idTexture) {
+            glDeleteTextures(1, &idTexture);
+            glDeleteTextures(1, &depthTexture);
+        }
+
+        glGenTextures(1, &idTexture);
+        glBindTexture(GL_TEXTURE_2D, idTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, idTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "ERROR::VISIBILITY_BUFFER::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+#endif // VISIBILITY_BUFFER_H
@@ -0,0 +1,5 @@
+#version 460 core
+
+// Цвет не записывается, важен только факт прохождения теста глубины
+void main() {
+}
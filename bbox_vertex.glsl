@@ -0,0 +1,26 @@
+#version 460 core
+
+// Куб из 36 вершин по gl_VertexID, растянутый по ограничивающему объёму меша
+uniform vec3 boundsMin;
+uniform vec3 boundsMax;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+const int cubeIndices[36] = int[36](
+    0, 2, 1, 1, 2, 3,
+    4, 5, 6, 5, 7, 6,
+    0, 1, 4, 1, 5, 4,
+    2, 6, 3, 3, 6, 7,
+    0, 4, 2, 2, 4, 6,
+    1, 3, 5, 3, 7, 5
+);
+
+void main() {
+    int corner = cubeIndices[gl_VertexID];
+    vec3 pos = vec3((corner & 1) != 0 ? boundsMax.x : boundsMin.x,
+                    (corner & 2) != 0 ? boundsMax.y : boundsMin.y,
+                    (corner & 4) != 0 ? boundsMax.z : boundsMin.z);
+    gl_Position = projection * view * model * vec4(pos, 1.0);
+}
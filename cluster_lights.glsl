@@ -0,0 +1,117 @@
+#version 460 core
+layout(local_size_x = 64) in;
+
+// Распределение точечных источников по кластерам пирамиды видимости:
+// CLUSTER_GRID.x x CLUSTER_GRID.y экранных плиток, CLUSTER_GRID.z слоёв по глубине
+// с экспоненциальным шагом. Один поток - один кластер; источники читаются
+// пачками через разделяемую память. Размеры совпадают с ClusteredLights.h.
+// Списки кластеров лежат подряд в общем буфере индексов: кластер сначала считает свои
+// источники, занимает отрезок атомарным счётчиком и вторым проходом записывает индексы.
+// Не поместившиеся в буфер индексы отбрасываются и считаются в droppedIndices.
+const uvec3 CLUSTER_GRID = uvec3(16, 9, 24);
+
+struct PointLight {
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout(std430, binding = 4) readonly buffer Lights { PointLight lights[]; };
+layout(std430, binding = 5) writeonly buffer ClusterRanges { uvec2 clusterRanges[]; }; // начало и число индексов
+layout(std430, binding = 6) writeonly buffer ClusterIndices { uint clusterIndices[]; };
+layout(std430, binding = 15) buffer ClusterTotals {
+    uint requiredIndices;   // сколько индексов нужно кадру
+    uint droppedIndices;    // сколько не поместилось в indexCapacity
+};
+
+uniform mat4 view;
+uniform mat4 inverseProjection;
+uniform vec2 clusterDepthRange; // ближняя и дальняя плоскости
+uniform uint lightCount;
+uniform uint indexCapacity;
+
+shared vec4 batch[64]; // центр в координатах камеры и радиус
+
+// Точка на луче через ndc, лежащая на глубине depth (в координатах камеры)
+vec3 viewPoint(vec2 ndc, float depth) {
+    vec4 p = inverseProjection * vec4(ndc, -1.0, 1.0);
+    p.xyz /= p.w;
+    return p.xyz * (depth / -p.z);
+}
+
+// Пачка источников в разделяемую память; вызывается всеми потоками группы
+void loadBatch(uint first) {
+    uint index = first + gl_LocalInvocationIndex;
+    if (index < lightCount) {
+        vec4 light = lights[index].positionRadius;
+        batch[gl_LocalInvocationIndex] = vec4((view * vec4(light.xyz, 1.0)).xyz, light.w);
+    }
+    barrier();
+}
+
+// Сфера действия источника пересекает параллелепипед кластера
+bool touches(vec4 light, vec3 boxMin, vec3 boxMax) {
+    vec3 closest = clamp(light.xyz, boxMin, boxMax);
+    vec3 d = closest - light.xyz;
+    return dot(d, d) <= light.w * light.w;
+}
+
+void main() {
+    uint cluster = gl_GlobalInvocationID.x;
+    uint clusterCount = CLUSTER_GRID.x * CLUSTER_GRID.y * CLUSTER_GRID.z;
+    bool active = cluster < clusterCount;
+
+    uint x = cluster % CLUSTER_GRID.x;
+    uint y = (cluster / CLUSTER_GRID.x) % CLUSTER_GRID.y;
+    uint z = cluster / (CLUSTER_GRID.x * CLUSTER_GRID.y);
+
+    float zNear = clusterDepthRange.x, zFar = clusterDepthRange.y;
+    float depth0 = zNear * pow(zFar / zNear, float(z) / float(CLUSTER_GRID.z));
+    float depth1 = zNear * pow(zFar / zNear, float(z + 1u) / float(CLUSTER_GRID.z));
+    vec2 ndc0 = vec2(x, y) / vec2(CLUSTER_GRID.xy) * 2.0 - 1.0;
+    vec2 ndc1 = vec2(x + 1u, y + 1u) / vec2(CLUSTER_GRID.xy) * 2.0 - 1.0;
+
+    vec3 boxMin = vec3(1e30), boxMax = vec3(-1e30);
+    for (int i = 0; i < 8; ++i) {
+        vec2 ndc = vec2((i & 1) != 0 ? ndc1.x : ndc0.x, (i & 2) != 0 ? ndc1.y : ndc0.y);
+        vec3 p = viewPoint(ndc, (i & 4) != 0 ? depth1 : depth0);
+        boxMin = min(boxMin, p);
+        boxMax = max(boxMax, p);
+    }
+
+    // Проход 1: число источников кластера
+    uint count = 0u;
+    for (uint first = 0u; first < lightCount; first += 64u) {
+        loadBatch(first);
+        uint batchSize = min(64u, lightCount - first);
+        for (uint i = 0u; active && i < batchSize; ++i) {
+            if (touches(batch[i], boxMin, boxMax))
+                count++;
+        }
+        barrier();
+    }
+
+    uint offset = 0u, stored = 0u;
+    if (active && count > 0u) {
+        offset = atomicAdd(requiredIndices, count);
+        stored = offset < indexCapacity ? min(count, indexCapacity - offset) : 0u;
+        if (stored < count)
+            atomicAdd(droppedIndices, count - stored);
+    }
+
+    // Проход 2: индексы в свой отрезок
+    uint written = 0u;
+    for (uint first = 0u; first < lightCount; first += 64u) {
+        loadBatch(first);
+        uint batchSize = min(64u, lightCount - first);
+        for (uint i = 0u; i < batchSize && written < stored; ++i) {
+            if (touches(batch[i], boxMin, boxMax)) {
+                clusterIndices[offset + written] = first + i;
+                written++;
+            }
+        }
+        barrier();
+    }
+
+    if (active)
+        clusterRanges[cluster] = uvec2(offset, stored);
+}
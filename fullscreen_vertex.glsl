@@ -0,0 +1,7 @@
+#version 460 core
+
+// Треугольник на весь экран без вершинного буфера (glDrawArrays(GL_TRIANGLES, 0, 3))
+void main() {
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
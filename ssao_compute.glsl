@@ -0,0 +1,77 @@
+#version 460 core
+layout(local_size_x = 8, local_size_y = 8) in;
+
+// Затенение окружения в пониженном разрешении (AmbientOcclusion.h). Позиция и нормаль
+// восстанавливаются по глубине, выборки - в полусфере вокруг нормали с поворотом по пикселю
+// и кадру (накопление по кадрам сглаживает шум). Результат: (ao, линейная глубина)
+layout(binding = 0) uniform sampler2D depthMap;
+layout(rg16f, binding = 0) uniform writeonly image2D aoOutput;
+
+uniform vec2 outputSize;   // пониженное разрешение
+uniform vec2 uvScale;      // доля текстуры глубины, занятая кадром
+uniform mat4 projection;
+uniform mat4 inverseProjection;
+uniform int sampleCount;
+uniform float radius;
+uniform uint frameIndex;
+
+vec3 viewPosition(vec2 uv) {
+    float depth = textureLod(depthMap, uv * uvScale, 0.0).r;
+    vec4 position = inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+// Ближайший по глубине сосед с каждой стороны даёт нормаль без размывания на краях
+vec3 viewNormal(vec2 uv, vec3 center, vec2 texel) {
+    vec3 left = viewPosition(uv - vec2(texel.x, 0.0)), right = viewPosition(uv + vec2(texel.x, 0.0));
+    vec3 down = viewPosition(uv - vec2(0.0, texel.y)), up = viewPosition(uv + vec2(0.0, texel.y));
+    vec3 dx = abs(right.z - center.z) < abs(center.z - left.z) ? right - center : center - left;
+    vec3 dy = abs(up.z - center.z) < abs(center.z - down.z) ? up - center : center - down;
+    return normalize(cross(dx, dy));
+}
+
+float interleavedGradientNoise(vec2 pixel) {
+    pixel += float(frameIndex % 64u) * 5.588238;
+    return fract(52.9829189 * fract(dot(pixel, vec2(0.06711056, 0.00583715))));
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, ivec2(outputSize))))
+        return;
+
+    vec2 uv = (vec2(pixel) + 0.5) / outputSize;
+    if (textureLod(depthMap, uv * uvScale, 0.0).r >= 1.0) {
+        imageStore(aoOutput, pixel, vec4(1.0, 1e4, 0.0, 0.0));
+        return;
+    }
+    vec3 center = viewPosition(uv);
+    vec3 normal = viewNormal(uv, center, 1.0 / outputSize);
+
+    float rotation = interleavedGradientNoise(vec2(pixel)) * 6.2831853;
+    vec3 helper = abs(normal.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(helper, normal));
+    vec3 bitangent = cross(normal, tangent);
+
+    float occlusion = 0.0;
+    for (int i = 0; i < sampleCount; ++i) {
+        // Спираль по полусфере, ближе к центру - гуще
+        float t = (float(i) + 0.5) / float(sampleCount);
+        float phi = rotation + float(i) * 2.3999632;
+        float cosTheta = sqrt(1.0 - t);
+        float sinTheta = sqrt(t);
+        vec3 direction = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+        float scale = mix(0.1, 1.0, t * t);
+        vec3 samplePosition = center + (tangent * direction.x + bitangent * direction.y + normal * direction.z) * radius * scale;
+
+        vec4 clip = projection * vec4(samplePosition, 1.0);
+        vec2 sampleUv = clip.xy / clip.w * 0.5 + 0.5;
+        if (any(lessThan(sampleUv, vec2(0.0))) || any(greaterThan(sampleUv, vec2(1.0))))
+            continue;
+        float sceneZ = viewPosition(sampleUv).z;
+        float range = smoothstep(0.0, 1.0, radius / max(abs(center.z - sceneZ), 1e-4));
+        occlusion += (sceneZ >= samplePosition.z + 0.02 * radius ? 1.0 : 0.0) * range;
+    }
+
+    imageStore(aoOutput, pixel, vec4(1.0 - occlusion / float(sampleCount), -center.z, 0.0, 0.0));
+}
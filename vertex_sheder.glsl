@@ -1,16 +1,36 @@
 #version 460 core
 layout(location = 0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
+layout(location = 2) in float aOcclusion;   // запечённое затенение окружения (AmbientOcclusionBaker.h)
 
 out vec3 FragPos;
 out vec3 Normal;
+out float Occlusion;
+
+// Совпадает с depth_vertex.glsl для предварительного прохода с GL_EQUAL
+invariant gl_Position;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// Повторяющаяся геометрия рисуется инстансно, матрицы экземпляров - в буфере
+layout(std430, binding = 0) readonly buffer InstanceTransforms {
+    mat4 instanceModels[];
+};
+uniform bool instanced;
+uniform int instanceBase;
+
+// Режим низкой задержки: матрица вида защёлкивается в буфер перед самой отправкой кадра
+layout(std140, binding = 0) uniform LateLatch {
+    mat4 latchedView;
+};
+uniform bool lateLatched;
+
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    mat4 world = instanced ? instanceModels[instanceBase + gl_InstanceID] : model;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(world))) * aNormal;
+    Occlusion = aOcclusion;
+    gl_Position = projection * (lateLatched ? latchedView : view) * vec4(FragPos, 1.0);
 }
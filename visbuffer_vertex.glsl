@@ -0,0 +1,16 @@
+#version 460 core
+layout(location = 0) in vec3 aPos;
+
+// Геометрический проход буфера видимости (поток позиций)
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+layout(std140, binding = 0) uniform LateLatch {
+    mat4 latchedView;
+};
+uniform bool lateLatched;
+
+void main() {
+    gl_Position = projection * (lateLatched ? latchedView : view) * (model * vec4(aPos, 1.0));
+}